@@ -0,0 +1,51 @@
+    .friday_asm
+
+    # Суммарное число шагов Коллатца для всех чисел от 1 до n (n со входа). Нечетный случай записан первым, хотя
+    # четный встречается вдвое чаще: friday-asm --profile-train переставит блоки так, чтобы он шел без переходов
+    in
+    pop r1
+    push 0
+    pop r2
+    push 1
+    pop r3
+next_n:
+    push r3
+    pop r0
+step:
+    push r0
+    push 1
+    je n_done
+    push r0
+    push 2
+    mod
+    push 0
+    je even
+    push r0          # x = 3x + 1
+    push 3
+    mul
+    push 1
+    add
+    pop r0
+    jmp counted
+even:
+    push r0          # x = x / 2
+    push 2
+    div
+    pop r0
+counted:
+    push r2
+    push 1
+    add
+    pop r2
+    jmp step
+n_done:
+    push r3
+    push 1
+    add
+    pop r3
+    push r3
+    push r1
+    jbe next_n
+    push r2
+    out
+    end
@@ -0,0 +1,56 @@
+    .friday_asm
+
+    # Читаем n чисел в массив по адресу 4096, сортируем встроенной функцией и печатаем
+    in
+    pop r1     # r1 -- n
+    push 4096
+    pop r0     # r0 -- адрес следующего элемента
+    push r1
+    pop r2
+read:
+    in
+    st r0, 0
+    push r0
+    push 4
+    add
+    pop r0
+    push r2
+    push 1
+    sub
+    pop r2
+    push r2
+    push 0
+    ja read
+
+    push 4096
+    push r1
+    syscall 16     # sort
+    push 4096
+    pop r0
+    push r1
+    pop r2
+print:
+    ld r0, 0
+    out
+    push r0
+    push 4
+    add
+    pop r0
+    push r2
+    push 1
+    sub
+    pop r2
+    push r2
+    push 0
+    ja print
+
+    # Сумма массива и 2 ^ 10
+    push 4096
+    push r1
+    syscall 26     # sum
+    out
+    push 2.0
+    push 10.0
+    syscall 4      # powf
+    outf
+    end
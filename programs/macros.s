@@ -0,0 +1,61 @@
+    .friday_asm
+
+    # Макросы: \reg и \step -- параметры, \@ -- номер раскрытия, чтобы метки разных раскрытий не совпадали
+    .macro incr reg, step
+    push \reg
+    push \step
+    add
+    pop \reg
+    .endm
+
+    .macro countdown reg
+countdown_\@:
+    push \reg
+    out
+    incr \reg, -1
+    push \reg
+    push 0
+    ja countdown_\@
+    .endm
+
+    # Печатаем n, n - 1, ..., 1, затем 3, 2, 1
+    in
+    pop r1
+    countdown r1
+    push 3
+    pop r2
+    countdown r2
+
+    # С friday-asm -O вызовы min встраиваются, а square -- нет (.noinline)
+    push 10
+    push 32
+    call min
+    out
+    push 4
+    call square
+    out
+    end
+
+# min(a, b): r7 -- адрес возврата
+min:
+    pop r7
+    pop r1
+    pop r2
+    push r1
+    push r2
+    jb min_second
+    push r2
+    jmp min_done
+min_second:
+    push r1
+min_done:
+    push r7
+    ret
+
+    .noinline
+square:
+    pop r7
+    dup
+    mul
+    push r7
+    ret
@@ -0,0 +1,61 @@
+    .friday_asm
+
+    # Массив из 10 квадратов по адресу 4096: r0 - адрес элемента, r1 - счетчик
+    push 4096
+    pop r0
+    push 1
+    pop r1
+fill:
+    push r1
+    push r1
+    mul
+    st r0, 0
+    push r0
+    push 4
+    add
+    pop r0
+    push r1
+    push 1
+    add
+    pop r1
+    push r1
+    push 10
+    jbe fill
+
+    # Копируем массив в 8192 и сравниваем копии
+    push 8192
+    push 4096
+    push 40
+    memcpy
+    push 4096
+    push 8192
+    push 40
+    memcmp
+    out
+
+    # Последний элемент копии через стековый адрес и первые 8 через векторную загрузку
+    push 8228
+    ld
+    out
+    push 8192
+    pop r2
+    vld r2, 0
+    vhsum
+    out
+
+    # Обнуляем копию и сравниваем снова
+    push 8192
+    push 0
+    push 40
+    memset
+    push 4096
+    push 8192
+    push 40
+    memcmp
+    out
+
+    # Выход за пределы памяти
+    push -4
+    pop r2
+    ld r2, 0
+    end
@@ -0,0 +1,69 @@
+    .friday_asm
+
+    # Сумма квадратов от 1 до 1000 в 4 потоках: поток k считает числа от 250k+1 до 250k+250
+    push 0
+    spawn worker
+    pop r4
+    push 1
+    spawn worker
+    pop r5
+    push 2
+    spawn worker
+    pop r6
+    push 3
+    spawn worker
+    pop r7
+
+    # Сумма результатов потоков
+    push r4
+    join
+    push r5
+    join
+    add
+    push r6
+    join
+    add
+    push r7
+    join
+    add
+    out
+
+    # Сумма, которую потоки накопили в памяти через xadd
+    push 4096
+    ld
+    out
+    end
+
+worker:
+    push 250
+    mul
+    pop r1     # r1 -- последнее посчитанное число
+    push r1
+    push 250
+    add
+    pop r2     # r2 -- последнее число потока
+    push 0
+    pop r3     # r3 -- сумма
+loop:
+    push r1
+    push 1
+    add
+    pop r1
+    push r3
+    push r1
+    push r1
+    mul
+    add
+    pop r3
+    push r1
+    push r2
+    jb loop
+
+    push 4096
+    push r3
+    xadd
+    pop r0
+    push r3
+    out
+    push r3    # Результат потока для join
+    end
@@ -0,0 +1,21 @@
+    .friday_asm
+
+    # Складывает числа со входа до первого 0 и печатает сумму. Под friday-ctx-bench каждая копия ждет в in,
+    # пока ей не передадут следующее слово
+    push 0
+    pop r0
+loop:
+    in
+    pop r1
+    push r1
+    push 0
+    je done
+    push r0
+    push r1
+    add
+    pop r0
+    jmp loop
+done:
+    push r0
+    out
+    end
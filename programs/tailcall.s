@@ -0,0 +1,85 @@
+    .friday_asm
+
+    # Хвостовые вызовы. Без friday-asm -O каждый уровень рекурсии sum и gcd занимает 8 байт стека, и sum большого n
+    # переполняет его, а с -O рекурсия становится циклом, а вызов inc в twice_inc -- переходом
+    in
+    pop r1
+
+    # sum(n, 0) = n + (n - 1) + ... + 1
+    push 0
+    push r1
+    call sum
+    out
+
+    # gcd(n, 36)
+    push r1
+    push 36
+    call gcd
+    out
+
+    # twice_inc(n) = 2 * n + 1
+    push r1
+    call twice_inc
+    out
+    end
+
+# sum(n, acc) = acc + n + (n - 1) + ... + 1: r7 -- адрес возврата, r0 -- n, r2 -- acc
+sum:
+    pop r7
+    pop r0
+    pop r2
+    push r0
+    push 0
+    ja sum_next
+    push r2
+    push r7
+    ret
+sum_next:
+    push r7          # Адрес возврата сохраняется под аргументами вызова
+    push r2
+    push r0
+    add
+    push r0
+    push 1
+    sub
+    call sum
+    swap             # Результат sum возвращается по сохраненному адресу
+    ret
+
+# gcd(a, b): r6 -- адрес возврата, r3 -- b, r4 -- a
+gcd:
+    pop r6
+    pop r3
+    pop r4
+    push r3
+    push 0
+    jne gcd_next
+    push r4
+    push r6
+    ret
+gcd_next:
+    push r6
+    push r3
+    push r4
+    push r3
+    mod
+    call gcd
+    swap
+    ret
+
+# twice_inc(n) = 2 * n + 1: r5 -- адрес возврата
+twice_inc:
+    pop r5
+    dup
+    add
+    call inc
+    push r5
+    ret
+
+    .noinline
+inc:
+    pop r7
+    push 1
+    add
+    push r7
+    ret
@@ -0,0 +1,27 @@
+    .friday_asm
+
+    # Вектор из 8 чисел: нулевая дорожка лежит на вершине стека, поэтому кладем с конца
+    push 8.0
+    push 7.0
+    push 6.0
+    push 5.0
+    push 4.0
+    push 3.0
+    push 2.0
+    push 1.0
+
+    # Скалярное произведение на (2, 2, ..., 2)
+    push 2.0
+    vsplat
+    vmulf
+    vhsumf
+    outf
+
+    # Сумма корней 8 девяток
+    push 9.0
+    vsplat
+    vsqrtf
+    vhsumf
+    outf
+
+    end
@@ -0,0 +1,47 @@
+#include "AotRuntime.hpp"
+#include "friday_asm_lang.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+using namespace FridayArch;
+
+AotRuntime::AotRuntime(const char *program, int program_size) :
+    input(STDIN_FILENO)
+{
+    emu.LoadMemory(program, program_size);
+    emu.input = &input;
+}
+
+int32_t AotRuntime::Execute(int32_t address, int32_t *regs, int32_t sp) {
+    const Instruction* inst = GetInstructionByBytecode(emu.mem[address]);
+    // The generated code has MAX_REGISTER_INDEX registers, friday-aot rejects headers with more
+    size_t count = std::min<size_t>(MAX_REGISTER_INDEX, emu.regs.size());
+    std::copy(regs, regs + count, emu.regs.begin());
+    emu.sp = sp;
+    emu.ap = address + static_cast<int32_t>(sizeof(friday_inst_t));
+    emu.ip = address + static_cast<int32_t>(inst->inst_full_size);
+    inst->callback(&emu);
+    std::copy(emu.regs.begin(), emu.regs.begin() + count, regs);
+
+    if (emu.signal != Emulator::NO_SIGNAL) {
+        stopped = true;
+        emu.HandleSignal();
+    }
+    return emu.sp;
+}
+
+void AotRuntime::Raise(int signal, int32_t ip, int32_t sp) {
+    emu.signal = signal;
+    emu.ip = ip;
+    emu.sp = sp;
+    stopped = true;
+    emu.HandleSignal();
+}
+
+int FridayArch::RunAotProgram(const char *program, int program_size, void (*body)(AotRuntime &)) {
+    AotRuntime runtime(program, program_size);
+    body(runtime);
+    fflush(stdout);
+    return 0;
+}
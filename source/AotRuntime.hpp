@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "Emulator.hpp"
+#include "InputSource.hpp"
+
+namespace FridayArch {
+
+// Среда исполнения программ, переведенных friday-aot в C++. Сгенерированный код держит регистры и sp в локальных
+// переменных, а память -- в emu.mem. Инструкции, которые friday-aot не переводит сам, исполняет эмулятор (Execute)
+class AotRuntime {
+public:
+    Emulator emu;
+
+    // Загружает образ программы в память emu, in и in_f читают stdin
+    AotRuntime(const char* program, int program_size);
+
+    AotRuntime(const AotRuntime&) = delete;
+    AotRuntime& operator=(const AotRuntime&) = delete;
+
+    // Исполняет эмулятором инструкцию по адресу address. regs и sp копируются в emu и обратно. Возвращает новое
+    // значение sp. Если инструкция подняла сигнал, он уже напечатан и Stopped() возвращает true
+    int32_t Execute(int32_t address, int32_t* regs, int32_t sp);
+    // Останавливает программу с сигналом signal и печатает его так же, как эмулятор. ip -- адрес следующей инструкции
+    void Raise(int signal, int32_t ip, int32_t sp);
+
+    bool Stopped() const {
+        return stopped;
+    }
+
+private:
+    PrefetchedInput input;
+    bool stopped = false;
+};
+
+// Запускает body -- функцию, сгенерированную friday-aot. Возвращает код возврата процесса
+int RunAotProgram(const char* program, int program_size, void (*body)(AotRuntime&));
+
+// Помощники для сгенерированного кода. Значения на стеке и в регистрах -- 4 байта, float хранится своими битами
+namespace Aot {
+    inline void Push(char* mem, int32_t& sp, int32_t value) {
+        sp -= sizeof(value);
+        std::memcpy(mem + sp, &value, sizeof(value));
+    }
+    inline int32_t Pop(const char* mem, int32_t& sp) {
+        int32_t value;
+        std::memcpy(&value, mem + sp, sizeof(value));
+        sp += sizeof(value);
+        return value;
+    }
+    // slot 0 -- вершина стека
+    inline int32_t Peek(const char* mem, int32_t sp, int slot) {
+        int32_t value;
+        std::memcpy(&value, mem + sp + slot * sizeof(value), sizeof(value));
+        return value;
+    }
+    inline float AsFloat(int32_t bits) {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    inline int32_t AsInt(float value) {
+        int32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    // Лежит ли [address, address + length) целиком в памяти эмулятора (см. Emulator::get_memory_range)
+    inline bool InMemory(int32_t address, uint32_t length) {
+        auto begin = static_cast<uint32_t>(address);
+        return begin <= static_cast<uint32_t>(Emulator::MEMORY_SIZE) - length;
+    }
+}
+
+}
@@ -0,0 +1,184 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "assembler_inside_facade.hpp"
+#include "utility/FileHelper.hpp"
+
+using namespace FridayArch;
+
+namespace {
+
+// FNV-1a на 128 битах. Ключ кэша -- единственное, что отличает программы в кэше, поэтому 64 бит мало
+class CacheKey {
+    __uint128_t hash = (static_cast<__uint128_t>(0x6c62272e07bb0142ULL) << 64) | 0x62b821756295c58dULL;
+
+public:
+    void Add(const void* data, size_t size) {
+        const __uint128_t prime = (static_cast<__uint128_t>(1) << 88) | 0x13b;
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= prime;
+        }
+    }
+
+    template <typename T>
+    void AddValue(const T& value) {
+        Add(&value, sizeof(value));
+    }
+
+    std::string Hex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string result(32, '0');
+        __uint128_t value = hash;
+        for (int i = 31; i >= 0; --i) {
+            result[i] = digits[static_cast<int>(value & 0xf)];
+            value >>= 4;
+        }
+        return result;
+    }
+};
+
+}
+
+std::string GetBytecodeCacheDirectory() {
+    const char* directory = getenv("FRIDAY_CACHE_DIR");
+    if (directory != nullptr && directory[0] != '\0') {
+        return directory;
+    }
+    const char* cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home != nullptr && cache_home[0] != '\0') {
+        return std::string(cache_home) + "/friday";
+    }
+    const char* home = getenv("HOME");
+    if (home != nullptr && home[0] != '\0') {
+        return std::string(home) + "/.cache/friday";
+    }
+    return "/tmp/friday-cache-" + std::to_string(getuid());
+}
+
+// Создает каталог и недостающие каталоги над ним. Бросает std::system_error в случае ошибки
+static void MakeDirectories(const std::string& directory) {
+    for (size_t end = directory.find('/', 1); ; end = directory.find('/', end + 1)) {
+        std::string path = directory.substr(0, end);
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw std::system_error(errno, std::generic_category(), "mkdir");
+        }
+        if (end == std::string::npos) {
+            return;
+        }
+    }
+}
+
+// Создает пустой файл path, в который AssemblyAndLink запишет программу. Бросает std::system_error в случае ошибки
+static void CreateOutputFile(const std::string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open");
+    }
+    close(fd);
+}
+
+// Ключ программы: содержимое исходников по порядку, опции сборки и сам ассемблер. Вместо номера версии ассемблера
+// берутся размер и время изменения исполняемого файла: любая пересборка инструментов сбрасывает кэш
+static std::string ComputeCacheKey(const std::vector<FileHelper::MappedFile>& sources, const AssemblerArgs& args) {
+    CacheKey key;
+    key.AddValue(ARCH_VERSION);
+    struct stat executable = {};
+    if (stat("/proc/self/exe", &executable) == 0) {
+        key.AddValue(executable.st_size);
+        key.AddValue(executable.st_mtim.tv_sec);
+        key.AddValue(executable.st_mtim.tv_nsec);
+    }
+    key.AddValue(args.optimize);
+    key.AddValue(sources.size());
+    for (const FileHelper::MappedFile& source : sources) {
+        // The size separates files, so "ab" + "c" and "a" + "bc" get different keys
+        key.AddValue(source.size());
+        key.Add(source.data(), source.size());
+    }
+    return key.Hex();
+}
+
+// Отображает в память входные файлы args. Возвращает false, если какой-то не удалось прочитать
+static bool MapSources(const AssemblerArgs& args, std::vector<FileHelper::MappedFile>& sources) {
+    sources.clear();
+    for (char* filename : args.input_files) {
+        try {
+            sources.emplace_back(filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(filename, "reading", exc);
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string AssembleCached(const AssemblerArgs& args, bool& cache_hit, bool& temporary) {
+    cache_hit = false;
+    temporary = false;
+    std::vector<FileHelper::MappedFile> sources;
+    if (!MapSources(args, sources)) {
+        return std::string();
+    }
+
+    std::string directory = GetBytecodeCacheDirectory();
+    std::string key = ComputeCacheKey(sources, args);
+    std::string path = directory + "/" + key + ".friday";
+    if (access(path.c_str(), R_OK) == 0) {
+        cache_hit = true;
+        return path;
+    }
+
+    // Other processes may assemble the same program at the same time, each one into its own temporary file
+    std::string output = path + ".tmp" + std::to_string(getpid());
+    try {
+        MakeDirectories(directory);
+        CreateOutputFile(output);
+    } catch (const std::exception&) {
+        // The cache only saves time, so a cache which cannot be written must not stop the run
+        char private_output[] = "/tmp/friday-emu-XXXXXX";
+        int fd = mkstemp(private_output);
+        if (fd < 0) {
+            printf("error: cannot create temporary file: %s\n", strerror(errno));
+            return std::string();
+        }
+        close(fd);
+        output = private_output;
+        temporary = true;
+    }
+
+    std::string messages;
+    AssemblerArgs build = args;
+    build.output_filename = output.c_str();
+    build.map_filename = nullptr;
+    build.messages = &messages;
+    bool ok = AssemblyAndLink(build);
+
+    // AssemblyAndLink reads the files again, so the program is stored under key only if they are still the same
+    if (ok && !temporary && (!MapSources(args, sources) || ComputeCacheKey(sources, args) != key)) {
+        printf("error: input files changed while they were assembled\n");
+        ok = false;
+    }
+    if (!ok) {
+        unlink(output.c_str());
+        printf("%s", messages.c_str());
+        return std::string();
+    }
+    if (temporary) {
+        return output;
+    }
+    // Unlike FileHelper::ReplaceFile, a failed rename keeps the temporary file: the program is run from it
+    if (rename(output.c_str(), path.c_str()) != 0) {
+        temporary = true;
+        return output;
+    }
+    return path;
+}
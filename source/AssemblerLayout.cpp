@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+#include "assembler_inside_facade.hpp"
+#include "Emulator.hpp"
+#include "GuestScheduler.hpp"
+#include "InputSource.hpp"
+#include "Profile.hpp"
+#include "friday_asm_lang.hpp"
+
+using namespace FridayArch;
+
+// Префикс меток, которые получают блоки без своей метки
+const static char* const BLOCK_LABEL_PREFIX = "__block";
+
+namespace {
+
+enum BlockExit {
+    EXIT_NEXT,    // Исполнение продолжается в блоке successor: следующей строкой или переходом jmp
+    EXIT_BRANCH,  // Условный переход на target, иначе -- в successor
+    EXIT_STOP     // ret, end или jmp на метку другого файла: конец блока не меняется
+};
+
+// Базовый блок: строки от метки (или от конца предыдущего блока) до перехода, ret, end или следующей метки
+struct Block {
+    std::string name;           // Первая метка блока или BLOCK_LABEL_PREFIX с номером
+    bool own_label = false;     // Метка name есть в исходнике, иначе она вставляется перед первой инструкцией
+    std::vector<AsmLine> body;
+    BlockExit exit = EXIT_NEXT;
+    std::string successor;      // Пусто, если исполнение уходит за конец файла
+    std::string target;         // Метка условного перехода
+    int branch_line = -1;       // Индекс условного перехода в body
+    int jump_line = -1;         // Индекс jmp на successor в конце body, его заменяет EmitBlocks
+    bool has_instructions = false;
+};
+
+}
+
+static bool IsLabel(const AsmLine& line) {
+    return line.words[0][0] != '.' && line.words[0].back() == ':';
+}
+
+static std::string LabelName(const AsmLine& line) {
+    return line.words[0].substr(0, line.words[0].size() - 1);
+}
+
+static InstructionFlow GetFlow(const std::string& name) {
+    static const std::unordered_map<std::string, InstructionFlow> flows = [] {
+        std::unordered_map<std::string, InstructionFlow> result;
+        for (const Instruction& inst : GetInstructionSet()) {
+            result.emplace(inst.name, inst.flow);
+        }
+        return result;
+    }();
+    auto found = flows.find(name);
+    return found != flows.end() ? found->second : FLOW_NEXT;
+}
+
+// Условный переход с противоположным условием. У сравнений дробных чисел, кроме равенства, его нет: с NaN ложны
+// и a > b, и a <= b
+static const char* InvertedBranch(const std::string& name) {
+    static const std::unordered_map<std::string, const char*> inverted = {
+        {"ja", "jbe"}, {"jbe", "ja"}, {"jae", "jb"}, {"jb", "jae"}, {"je", "jne"}, {"jne", "je"},
+        {"jef", "jnef"}, {"jnef", "jef"}};
+    auto found = inverted.find(name);
+    return found != inverted.end() ? found->second : nullptr;
+}
+
+// Делит строки на базовые блоки. Блок начинается меткой или инструкцией после перехода, ret или end; метки подряд
+// принадлежат одному блоку. jmp сразу после условного перехода остается в его блоке
+static std::vector<Block> SplitBlocks(std::vector<AsmLine>& lines, BlockLayout& layout) {
+    std::vector<Block> blocks(1);
+    bool closed = false;       // Последняя инструкция блока передает управление
+    bool after_branch = false;
+    for (AsmLine& line : lines) {
+        Block* block = &blocks.back();
+        if (IsLabel(line)) {
+            if (block->has_instructions) {
+                blocks.emplace_back();
+                block = &blocks.back();
+                closed = after_branch = false;
+            }
+            if (block->name.empty()) {
+                block->name = LabelName(line);
+                block->own_label = true;
+            }
+            block->body.push_back(std::move(line));
+            continue;
+        }
+        if (line.words[0][0] == '.') {
+            block->body.push_back(std::move(line));
+            continue;
+        }
+
+        InstructionFlow flow = GetFlow(line.words[0]);
+        if (closed && !(after_branch && flow == FLOW_JUMP)) {
+            blocks.emplace_back();
+            block = &blocks.back();
+        }
+        closed = flow == FLOW_JUMP || flow == FLOW_BRANCH || flow == FLOW_RET || flow == FLOW_EXIT;
+        after_branch = flow == FLOW_BRANCH;
+        block->has_instructions = true;
+        block->body.push_back(std::move(line));
+    }
+    for (Block& block : blocks) {
+        if (block.name.empty()) {
+            block.name = BLOCK_LABEL_PREFIX + std::to_string(layout.next_block++);
+        }
+    }
+    return blocks;
+}
+
+// Определяет, куда блоки передают управление
+static void FindExits(std::vector<Block>& blocks) {
+    std::unordered_set<std::string> labels;
+    for (const Block& block : blocks) {
+        for (const AsmLine& line : block.body) {
+            if (IsLabel(line)) {
+                labels.insert(LabelName(line));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        Block& block = blocks[i];
+        block.successor = i + 1 < blocks.size() ? blocks[i + 1].name : std::string();
+        if (!block.has_instructions) {
+            continue;
+        }
+        int last = static_cast<int>(block.body.size()) - 1;
+        while (block.body[last].words[0][0] == '.') {
+            --last;
+        }
+        const AsmLine& line = block.body[last];
+        InstructionFlow flow = GetFlow(line.words[0]);
+        std::string label = line.words.back();
+        if (flow == FLOW_RET || flow == FLOW_EXIT || (flow == FLOW_JUMP && labels.count(label) == 0)) {
+            block.exit = EXIT_STOP;
+            continue;
+        }
+        if (flow == FLOW_JUMP) {
+            block.successor = label;
+            block.jump_line = last;
+            // A block of "jCC target; jmp label" branches to target or goes on to label
+            for (int k = last - 1; k >= 0; --k) {
+                if (block.body[k].words[0][0] == '.') {
+                    continue;
+                }
+                if (!IsLabel(block.body[k]) && GetFlow(block.body[k].words[0]) == FLOW_BRANCH) {
+                    last = k;
+                    flow = FLOW_BRANCH;
+                }
+                break;
+            }
+        }
+        if (flow != FLOW_BRANCH) {
+            continue;
+        }
+        const std::string& target = block.body[last].words.back();
+        if (labels.count(target) == 0) {
+            // A branch to another file is kept as is, the block still falls through to its successor
+            continue;
+        }
+        block.exit = EXIT_BRANCH;
+        block.target = target;
+        block.branch_line = last;
+    }
+}
+
+// Порядок блоков: первый блок остается первым, затем цепочки, в которых за блоком идет его самый частый
+// преемник; новая цепочка начинается с самого частого из неразмещенных блоков. Блоки, которые не исполнялись,
+// идут в конце в исходном порядке, а последний блок, из которого исполнение уходит за конец файла, -- последним
+static std::vector<size_t> OrderBlocks(const std::vector<Block>& blocks, const BlockLayout& layout) {
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        for (const AsmLine& line : blocks[i].body) {
+            if (IsLabel(line)) {
+                index.emplace(LabelName(line), i);
+            }
+        }
+        index.emplace(blocks[i].name, i);
+    }
+    auto counts = [&layout] (const Block& block) {
+        auto found = layout.counts.find(block.name);
+        return found != layout.counts.end() ? found->second : BlockCounts{};
+    };
+
+    size_t pinned_last = blocks.size();
+    const Block& last = blocks.back();
+    if (last.exit != EXIT_STOP && last.successor.empty()) {
+        pinned_last = blocks.size() - 1;
+    }
+    std::vector<bool> placed(blocks.size(), false);
+    std::vector<size_t> order;
+    auto place = [&] (size_t i) {
+        placed[i] = true;
+        order.push_back(i);
+    };
+
+    size_t current = 0;
+    place(0);
+    while (true) {
+        // The hottest successor which is not placed yet continues the chain
+        const Block& block = blocks[current];
+        BlockCounts block_counts = counts(block);
+        std::vector<std::pair<uint64_t, std::string>> exits;
+        if (block.exit == EXIT_NEXT) {
+            exits.emplace_back(block_counts.executions, block.successor);
+        } else if (block.exit == EXIT_BRANCH) {
+            exits.emplace_back(block_counts.taken, block.target);
+            exits.emplace_back(block_counts.not_taken, block.successor);
+        }
+        size_t next = blocks.size();
+        uint64_t next_weight = 0;
+        for (auto& [weight, label] : exits) {
+            auto found = index.find(label);
+            if (found != index.end() && !placed[found->second] && found->second != pinned_last &&
+                    weight > next_weight && counts(blocks[found->second]).executions > 0) {
+                next = found->second;
+                next_weight = weight;
+            }
+        }
+        if (next == blocks.size()) {
+            uint64_t hottest = 0;
+            for (size_t i = 0; i < blocks.size(); ++i) {
+                uint64_t executions = counts(blocks[i]).executions;
+                if (!placed[i] && i != pinned_last && executions > hottest) {
+                    next = i;
+                    hottest = executions;
+                }
+            }
+        }
+        if (next == blocks.size()) {
+            break;
+        }
+        place(next);
+        current = next;
+    }
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (!placed[i] && i != pinned_last) {
+            place(i);
+        }
+    }
+    if (pinned_last < blocks.size() && !placed[pinned_last]) {
+        place(pinned_last);
+    }
+    return order;
+}
+
+// Записывает блоки в порядке order, вставляя метки блоков без своей метки. Если за блоком идет не тот, куда он
+// передает управление, добавляет jmp или, если следующий блок -- цель условного перехода, обращает условие
+static void EmitBlocks(std::vector<Block>& blocks, const std::vector<size_t>& order, std::vector<AsmLine>& lines,
+                       int& inverted, int& removed_jumps, int& added_jumps) {
+    lines.clear();
+    for (size_t k = 0; k < order.size(); ++k) {
+        Block& block = blocks[order[k]];
+        const std::string& next = k + 1 < order.size() ? blocks[order[k + 1]].name : std::string();
+        int source_line = block.body.empty() ? 0 : block.body.back().source_line;
+
+        bool label_written = block.own_label;
+        for (int i = 0; i < static_cast<int>(block.body.size()); ++i) {
+            AsmLine& line = block.body[i];
+            if (i == block.jump_line) {
+                continue;
+            }
+            if (!label_written && !IsLabel(line) && line.words[0][0] != '.') {
+                lines.push_back({{block.name + ":"}, line.source_line});
+                label_written = true;
+            }
+            if (i == block.branch_line && block.exit == EXIT_BRANCH && block.target == next &&
+                    !block.successor.empty() && InvertedBranch(line.words[0]) != nullptr) {
+                // The target follows the branch, so the branch goes to the former fall-through block instead
+                line.words[0] = InvertedBranch(line.words[0]);
+                line.words.back() = block.successor;
+                block.successor = block.target;
+                ++inverted;
+            }
+            lines.push_back(std::move(line));
+        }
+        if (!label_written) {
+            lines.push_back({{block.name + ":"}, source_line});
+        }
+        if (block.exit != EXIT_STOP && !block.successor.empty() && block.successor != next) {
+            lines.push_back({{"jmp", block.successor}, source_line});
+            added_jumps += block.jump_line < 0;
+        } else {
+            removed_jumps += block.jump_line >= 0;
+        }
+    }
+}
+
+void LayOutBlocks(std::vector<AsmLine>& lines, BlockLayout& layout, const TextLocation& loc) {
+    if (lines.empty()) {
+        return;
+    }
+    std::vector<Block> blocks = SplitBlocks(lines, layout);
+    FindExits(blocks);
+
+    std::vector<size_t> order(blocks.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    bool profiled = false;
+    for (const Block& block : blocks) {
+        auto found = layout.counts.find(block.name);
+        profiled |= found != layout.counts.end() && found->second.executions > 0;
+    }
+    if (layout.reorder && profiled) {
+        order = OrderBlocks(blocks, layout);
+    }
+
+    int moved = 0, cold = 0, inverted = 0, removed_jumps = 0, added_jumps = 0;
+    if (layout.reorder && profiled) {
+        for (size_t k = 0; k < order.size(); ++k) {
+            moved += order[k] != k;
+            auto found = layout.counts.find(blocks[order[k]].name);
+            cold += found == layout.counts.end() || found->second.executions == 0;
+        }
+        EmitBlocks(blocks, order, lines, inverted, removed_jumps, added_jumps);
+        TextLocation at = loc;
+        at.source_lines = nullptr;
+        at.line = lines.front().source_line;
+        at.PrintCompileMessage("note: profile-guided layout: %d of %zu blocks moved, %d never executed, "
+                               "%d branches inverted, %d jumps removed, %d added", moved, blocks.size(), cold,
+                               inverted, removed_jumps, added_jumps);
+        return;
+    }
+
+    // Only the labels of the blocks are added, so the code stays the same as without the layout
+    std::vector<AsmLine> result;
+    result.reserve(lines.size() + blocks.size());
+    for (Block& block : blocks) {
+        bool label_written = block.own_label;
+        for (AsmLine& line : block.body) {
+            if (!label_written && !IsLabel(line) && line.words[0][0] != '.') {
+                result.push_back({{block.name + ":"}, line.source_line});
+                label_written = true;
+            }
+            result.push_back(std::move(line));
+        }
+        if (!label_written) {
+            result.push_back({{block.name + ":"}, block.body.empty() ? 0 : block.body.back().source_line});
+        }
+    }
+    lines = std::move(result);
+}
+
+bool CountBlocks(const std::vector<char>& image, const SymbolMap& symbols, const Profile& profile,
+                 BlockLayout& layout) {
+    // The profile must be of this very code: every executed address starts an instruction
+    std::vector<bool> starts(image.size(), false);
+    for (size_t address = HEADER_SIZE; address < image.size();) {
+        const Instruction* inst = GetInstructionByBytecode(image[address]);
+        if (inst == nullptr) {
+            return false;
+        }
+        starts[address] = true;
+        address += inst->inst_full_size;
+    }
+    for (size_t address = 0; address < profile.executions.size(); ++address) {
+        if (profile.executions[address] > 0 && (address >= image.size() || !starts[address])) {
+            return false;
+        }
+    }
+
+    const std::vector<SymbolMap::Symbol>& list = symbols.GetSymbols();
+    for (size_t i = 0; i < list.size(); ++i) {
+        size_t begin = list[i].address;
+        size_t end = image.size();
+        for (size_t j = i + 1; j < list.size(); ++j) {
+            if (list[j].address != begin) {
+                end = list[j].address;
+                break;
+            }
+        }
+
+        BlockCounts& counts = layout.counts[list[i].name];
+        counts.executions = profile.GetExecutions(static_cast<int>(begin));
+        auto inst = [&image] (size_t address) { return GetInstructionByBytecode(image[address]); };
+        int last = -1, before_last = -1;
+        for (size_t address = begin; address < end; address += inst(address)->inst_full_size) {
+            before_last = last;
+            last = static_cast<int>(address);
+        }
+        auto flow = [&inst] (int address) { return inst(address)->flow; };
+        int branch = -1;
+        if (last >= 0 && flow(last) == FLOW_BRANCH) {
+            branch = last;
+        } else if (last >= 0 && flow(last) == FLOW_JUMP && before_last >= 0 && flow(before_last) == FLOW_BRANCH) {
+            branch = before_last;
+        }
+        if (branch >= 0) {
+            counts.taken = profile.GetTaken(branch);
+            counts.not_taken = profile.GetExecutions(branch) - counts.taken;
+        }
+    }
+    return true;
+}
+
+int TrainProgram(const std::vector<char>& image, const char* input_filename, Profile& profile) {
+    size_t input_size = 0;
+    int fd = FileHelper::OpenRegularFile(input_filename, input_size);
+    Emulator emu;
+    std::string output;
+    {
+        PrefetchedInput input(fd);
+        emu.LoadMemory(image.data(), static_cast<int>(image.size()));
+        emu.output_buffer = &output;
+        emu.output_stream = nullptr;
+        emu.input = &input;
+        GuestScheduler scheduler(emu, static_cast<int>(std::thread::hardware_concurrency()), true);
+        scheduler.Run(false, &profile);
+        emu.input = nullptr;
+    }
+    close(fd);
+    return emu.signal;
+}
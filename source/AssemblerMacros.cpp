@@ -0,0 +1,332 @@
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "assembler_inside_facade.hpp"
+
+using namespace FridayArch;
+
+// Функция с телом длиннее стольких инструкций встраивается, только если перед ее меткой стоит .inline
+const static int INLINE_MAX_INSTRUCTIONS = 8;
+// Глубина вложенных раскрытий макросов, после которой макрос считается рекурсивным
+const static int MAX_MACRO_DEPTH = 64;
+
+namespace {
+
+struct Macro {
+    std::vector<std::string> params;
+    std::vector<AsmLine> body;
+    int definition_line;
+};
+
+// Функция, вызовы которой можно встроить: ее тело -- строки [body_begin, body_end) между pop адреса возврата и
+// push перед ret
+struct InlineFunction {
+    size_t body_begin;
+    size_t body_end;
+};
+
+struct MacroExpansion {
+    TextLocation& loc;
+    std::unordered_map<std::string, Macro> macros{};
+    int expansions = 0;  // Номер следующего раскрытия, его подставляет \@
+    std::vector<AsmLine> lines{};
+};
+
+}
+
+static std::string_view WithoutComma(std::string_view word) {
+    if (!word.empty() && word.back() == ',') {
+        word.remove_suffix(1);
+    }
+    return word;
+}
+
+static bool IsLabelLine(const std::vector<std::string>& words) {
+    return !words.empty() && words[0][0] != '.' && words[0].back() == ':';
+}
+
+static bool IsInstructionName(std::string_view name) {
+    for (int code = 0; code < 256; ++code) {
+        const Instruction* inst = GetInstructionByBytecode(static_cast<friday_inst_t>(code));
+        if (inst != nullptr && name == inst->name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void AppendLine(const std::vector<std::string>& words, int source_line, CompactSource& result) {
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (i > 0) {
+            result.text.push_back(' ');
+        }
+        result.text += words[i];
+    }
+    result.text.push_back('\n');
+    result.source_lines.push_back(source_line);
+}
+
+// Подставляет в слово тела макроса аргументы вместо \param и номер раскрытия вместо \@. Если после '\' нет имени
+// параметра, возвращает false
+static bool SubstituteParams(const std::string& word, const Macro& macro, const std::vector<std::string>& args,
+                             int expansion, std::string& result) {
+    result.clear();
+    for (size_t i = 0; i < word.size();) {
+        if (word[i] != '\\') {
+            result.push_back(word[i++]);
+            continue;
+        }
+        if (i + 1 < word.size() && word[i + 1] == '@') {
+            result += std::to_string(expansion);
+            i += 2;
+            continue;
+        }
+
+        // The longest name wins, so that \ab is not taken for \a followed by 'b'
+        int param = -1;
+        size_t param_length = 0;
+        for (size_t p = 0; p < macro.params.size(); ++p) {
+            const std::string& name = macro.params[p];
+            if (name.size() > param_length && word.compare(i + 1, name.size(), name) == 0) {
+                param = static_cast<int>(p);
+                param_length = name.size();
+            }
+        }
+        if (param < 0) {
+            return false;
+        }
+        result += args[param];
+        i += 1 + param_length;
+    }
+    return true;
+}
+
+// Добавляет строку в expansion.lines, раскрывая ее, если это вызов макроса
+static bool EmitLine(MacroExpansion& expansion, std::vector<std::string> words, int source_line, int depth) {
+    auto found = words.empty() ? expansion.macros.end() : expansion.macros.find(words[0]);
+    if (found == expansion.macros.end()) {
+        if (!words.empty()) {
+            expansion.lines.push_back({std::move(words), source_line});
+        }
+        return true;
+    }
+
+    const Macro& macro = found->second;
+    if (depth >= MAX_MACRO_DEPTH) {
+        expansion.loc.PrintCompileMessage("error: macro '%s' is expanded more than %d times inside itself",
+                                          words[0].c_str(), MAX_MACRO_DEPTH);
+        return false;
+    }
+    std::vector<std::string> args;
+    for (size_t i = 1; i < words.size(); ++i) {
+        std::string_view arg = WithoutComma(words[i]);
+        if (!arg.empty()) {
+            args.emplace_back(arg);
+        }
+    }
+    if (args.size() != macro.params.size()) {
+        expansion.loc.PrintCompileMessage("error: macro '%s' expects %zu arguments, but %zu are given",
+                                          words[0].c_str(), macro.params.size(), args.size());
+        return false;
+    }
+
+    int number = expansion.expansions++;
+    for (const AsmLine& body_line : macro.body) {
+        std::vector<std::string> expanded(body_line.words.size());
+        for (size_t i = 0; i < expanded.size(); ++i) {
+            if (!SubstituteParams(body_line.words[i], macro, args, number, expanded[i])) {
+                expansion.loc.PrintCompileMessage("error: unknown macro parameter in '%s' (line %d of macro '%s')",
+                                                  body_line.words[i].c_str(), body_line.source_line,
+                                                  words[0].c_str());
+                return false;
+            }
+        }
+        // Errors inside the expansion are reported at the line which uses the macro
+        if (!EmitLine(expansion, std::move(expanded), source_line, depth + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ExpandMacros(std::string_view file, MacroExpansion& expansion) {
+    TextLocation& loc = expansion.loc;
+    Macro* defining = nullptr;
+
+    loc.ResetFile();
+    for (int index = 0; index < static_cast<int>(file.size()) && file[index] != '\0'; ++index, loc.IncLine()) {
+        auto views = SplitLine(file, index);
+        std::vector<std::string> words(views.begin(), views.end());
+
+        if (!words.empty() && words[0] == ".macro") {
+            if (defining != nullptr) {
+                loc.PrintCompileMessage("error: .macro inside of another macro");
+                return false;
+            }
+            std::string name = words.size() > 1 ? std::string(WithoutComma(words[1])) : std::string();
+            if (name.empty() || name[0] == '.' || name.back() == ':' || IsInstructionName(name)) {
+                loc.PrintCompileMessage("error: expected macro name after .macro, which is not an instruction");
+                return false;
+            }
+            if (expansion.macros.count(name) > 0) {
+                loc.PrintCompileMessage("error: macro '%s' is already defined", name.c_str());
+                return false;
+            }
+            defining = &expansion.macros[name];
+            defining->definition_line = loc.line;
+            for (size_t i = 2; i < words.size(); ++i) {
+                std::string_view param = WithoutComma(words[i]);
+                if (!param.empty()) {
+                    defining->params.emplace_back(param);
+                }
+            }
+        } else if (!words.empty() && words[0] == ".endm") {
+            if (defining == nullptr) {
+                loc.PrintCompileMessage("error: .endm without .macro");
+                return false;
+            }
+            defining = nullptr;
+        } else if (defining != nullptr) {
+            if (!words.empty()) {
+                defining->body.push_back({std::move(words), loc.SourceLine()});
+            }
+        } else if (!EmitLine(expansion, std::move(words), loc.SourceLine(), 0)) {
+            return false;
+        }
+    }
+
+    if (defining != nullptr) {
+        loc.line = defining->definition_line;
+        loc.PrintCompileMessage("error: .macro without .endm");
+        return false;
+    }
+    return true;
+}
+
+// Ищет функции, вызовы которых можно встроить. За меткой такой функции идет pop rX (адрес возврата), в конце --
+// push rX и ret. В теле нет call, ret, dep, spawn и дот-команд, rX не используется, а все метки, на которые
+// ссылается тело, объявлены в нем же. Тело длиннее INLINE_MAX_INSTRUCTIONS инструкций встраивается только с .inline
+// перед меткой, а с .noinline функция не встраивается
+static std::unordered_map<std::string, InlineFunction> FindInlineFunctions(const std::vector<AsmLine>& lines) {
+    std::unordered_set<std::string> labels;
+    for (auto& line : lines) {
+        if (IsLabelLine(line.words)) {
+            labels.insert(line.words[0].substr(0, line.words[0].size() - 1));
+        }
+    }
+
+    std::unordered_map<std::string, InlineFunction> result;
+    for (size_t i = 0; i + 1 < lines.size(); ++i) {
+        if (!IsLabelLine(lines[i].words)) {
+            continue;
+        }
+        const std::string hint = i > 0 ? lines[i - 1].words[0] : std::string();
+        const std::vector<std::string>& first = lines[i + 1].words;
+        if (hint == ".noinline" || first.size() != 2 || first[0] != "pop" || !IsRegisterWord(first[1])) {
+            continue;
+        }
+        const std::string& return_register = first[1];
+
+        size_t ret = i + 2;
+        bool ok = true;
+        std::unordered_set<std::string> local_labels;
+        for (; ret < lines.size() && lines[ret].words[0] != "ret"; ++ret) {
+            const std::string& word = lines[ret].words[0];
+            if (word[0] == '.' || word == "call" || word == "dep" || word == "spawn") {
+                ok = false;
+                break;
+            }
+            if (IsLabelLine(lines[ret].words)) {
+                local_labels.insert(word.substr(0, word.size() - 1));
+            }
+        }
+        if (!ok || ret >= lines.size() || ret < i + 3 || lines[ret].words.size() != 1 ||
+                lines[ret - 1].words != std::vector<std::string>{"push", return_register}) {
+            continue;
+        }
+
+        int instructions = 0;
+        for (size_t j = i + 2; ok && j + 1 < ret; ++j) {
+            const std::vector<std::string>& words = lines[j].words;
+            if (IsLabelLine(words)) {
+                continue;
+            }
+            ++instructions;
+            for (size_t k = 1; k < words.size(); ++k) {
+                std::string arg(WithoutComma(words[k]));
+                ok &= arg != return_register && (labels.count(arg) == 0 || local_labels.count(arg) > 0);
+            }
+        }
+        if (ok && (instructions <= INLINE_MAX_INSTRUCTIONS || hint == ".inline")) {
+            const std::string& label = lines[i].words[0];
+            result[label.substr(0, label.size() - 1)] = {i + 2, ret - 1};
+        }
+    }
+    return result;
+}
+
+// Заменяет call встраиваемых функций их телами. Метки тела в каждой копии получают свои имена
+static std::vector<AsmLine> InlineCalls(const std::vector<AsmLine>& lines,
+                                        const std::unordered_map<std::string, InlineFunction>& functions) {
+    std::vector<AsmLine> result;
+    int copies = 0;
+    for (const AsmLine& line : lines) {
+        auto found = line.words.size() == 2 && line.words[0] == "call" ? functions.find(line.words[1])
+                                                                        : functions.end();
+        if (found == functions.end()) {
+            result.push_back(line);
+            continue;
+        }
+
+        const InlineFunction& function = found->second;
+        std::unordered_set<std::string> local_labels;
+        for (size_t j = function.body_begin; j < function.body_end; ++j) {
+            if (IsLabelLine(lines[j].words)) {
+                local_labels.insert(lines[j].words[0].substr(0, lines[j].words[0].size() - 1));
+            }
+        }
+        std::string suffix = "__inline" + std::to_string(copies++);
+        for (size_t j = function.body_begin; j < function.body_end; ++j) {
+            std::vector<std::string> words = lines[j].words;
+            bool label_line = IsLabelLine(words);
+            for (size_t k = label_line ? 0 : 1; k < words.size(); ++k) {
+                // A label is declared as "name:" and used as "name" or "name,"
+                std::string& word = words[k];
+                size_t length = word.size() - (word.back() == ':' || word.back() == ',' ? 1 : 0);
+                if (local_labels.count(word.substr(0, length)) > 0) {
+                    word.insert(length, suffix);
+                }
+            }
+            result.push_back({std::move(words), lines[j].source_line});
+        }
+    }
+    return result;
+}
+
+bool NeedsExpansion(std::string_view file, bool optimize) {
+    return file.find(".macro") != std::string_view::npos || file.find(".endm") != std::string_view::npos ||
+           (optimize && file.find("call") != std::string_view::npos);
+}
+
+bool ExpandMacrosAndOptimize(std::string_view file, TextLocation& loc, bool optimize, CompactSource& result,
+                             BlockLayout* layout) {
+    MacroExpansion expansion{loc};
+    if (!ExpandMacros(file, expansion)) {
+        return false;
+    }
+    std::vector<AsmLine>& lines = expansion.lines;
+    if (optimize) {
+        // Inlined calls are gone before tail calls are looked for: inlining removes the call altogether
+        lines = InlineCalls(lines, FindInlineFunctions(lines));
+        EliminateTailCalls(lines, loc);
+    }
+    if (layout != nullptr) {
+        // Blocks are laid out last, when calls and jumps between them do not change anymore
+        LayOutBlocks(lines, *layout, loc);
+    }
+    for (const AsmLine& line : lines) {
+        AppendLine(line.words, line.source_line, result);
+    }
+    return true;
+}
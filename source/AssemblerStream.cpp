@@ -0,0 +1,127 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "assembler_inside_facade.hpp"
+
+// Кусок, которым читается исходник. Строка длиннее куска -- ошибка
+const static size_t READ_CHUNK_SIZE = 1024 * 1024;
+
+// Добавляет к source строку исходника, если в ней есть что-то кроме пробелов и комментария
+static void AppendCompactLine(const std::vector<std::string_view>& words, int source_line, CompactSource& source) {
+    if (words.empty()) {
+        return;
+    }
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (i > 0) {
+            source.text.push_back(' ');
+        }
+        source.text.append(words[i]);
+    }
+    source.text.push_back('\n');
+    source.source_lines.push_back(source_line);
+}
+
+void ReadCompactSource(int fd, CompactSource &source) {
+    std::vector<char> buffer(READ_CHUNK_SIZE);
+    size_t filled = 0;         // The line cut by the end of the previous chunk is at the start of buffer
+    bool end_of_file = false;
+    bool end_of_text = false;  // As in CompileFilePass, '\0' at the start of a line ends the text
+
+    while (!end_of_file && !end_of_text) {
+        ssize_t length = read(fd, buffer.data() + filled, buffer.size() - filled);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "read");
+        }
+        end_of_file = length == 0;
+        filled += length;
+
+        std::string_view chunk(buffer.data(), filled);
+        size_t start = 0;
+        while (start < filled) {
+            if (chunk[start] == '\0') {
+                end_of_text = true;
+                break;
+            }
+            auto newline = static_cast<const char*>(std::memchr(chunk.data() + start, '\n', filled - start));
+            if (newline == nullptr && !end_of_file) {
+                break;  // The rest of the line comes with the next chunk
+            }
+            size_t end = newline != nullptr ? newline - chunk.data() : filled;
+
+            // Most lines of generated sources are comments, skip them without splitting. A line with '\0' is split:
+            // SplitLine ends a line on it
+            size_t first = start;
+            while (first < end && (chunk[first] == ' ' || chunk[first] == '\t')) {
+                ++first;
+            }
+            bool comment = first == end || chunk[first] == '#';
+            if (comment && std::memchr(chunk.data() + first, '\0', end - first) == nullptr) {
+                ++source.lines_read;
+                start = end + 1;
+                continue;
+            }
+
+            int index = static_cast<int>(start);
+            auto words = SplitLine(chunk.substr(0, end), index);
+            ++source.lines_read;
+            AppendCompactLine(words, static_cast<int>(source.lines_read), source);
+            start = index + 1;
+        }
+
+        size_t rest = start < filled ? filled - start : 0;
+        if (rest == buffer.size()) {
+            throw std::length_error("line " + std::to_string(source.lines_read + 1) + " is longer than " +
+                                    std::to_string(READ_CHUNK_SIZE) + " bytes");
+        }
+        std::memmove(buffer.data(), buffer.data() + start, rest);
+        filled = rest;
+    }
+}
+
+void ReadAsmSource(const char *filename, AsmSource &source) {
+    if (strcmp(filename, "-") == 0) {
+        source.name = "<stdin>";
+        source.streamed = true;
+        ReadCompactSource(STDIN_FILENO, source.compact);
+        return;
+    }
+
+    source.name = filename;
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open");
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "fstat");
+    }
+    if (S_ISDIR(st.st_mode)) {
+        close(fd);
+        throw std::system_error(EISDIR, std::generic_category(), "not a file");
+    }
+    if (S_ISREG(st.st_mode) && static_cast<size_t>(st.st_size) < AsmSource::STREAMED_FILE_SIZE) {
+        close(fd);
+        source.mapped = FileHelper::MappedFile(filename);
+        return;
+    }
+
+    // Pipes and process substitutions cannot be mapped, huge generated files should not be
+    source.streamed = true;
+    try {
+        ReadCompactSource(fd, source.compact);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
@@ -0,0 +1,259 @@
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "assembler_inside_facade.hpp"
+#include "friday_asm_lang.hpp"
+
+using namespace FridayArch;
+
+// Суффикс метки, которую получает начало тела функции с хвостовой рекурсией
+const static char* const TAIL_LOOP_SUFFIX = "__tail_loop";
+
+namespace {
+
+// Функция по соглашению о вызовах: за ее меткой идет pop rX (адрес возврата), затем pop аргументов
+struct Function {
+    std::string name;
+    size_t label_line;
+    size_t end_line;              // Метка следующей функции или конец текста
+    std::string return_register;
+    int args_count;               // Сколько pop регистров идет сразу за pop rX
+};
+
+enum ReturnSequence {
+    NOT_RETURN,
+    RETURN_SAVED,    // swap; ret или swap; pop rX; push rX; ret -- результат возвращается по адресу со стека
+    RETURN_REGISTER  // push rX; ret -- результат возвращается по адресу из rX
+};
+
+}
+
+static bool IsLabel(const AsmLine& line) {
+    return line.words[0][0] != '.' && line.words[0].back() == ':';
+}
+
+static std::string LabelName(const AsmLine& line) {
+    return line.words[0].substr(0, line.words[0].size() - 1);
+}
+
+static bool IsPopRegister(const AsmLine& line) {
+    return line.words.size() == 2 && line.words[0] == "pop" && IsRegisterWord(line.words[1]);
+}
+
+// Есть ли word среди аргументов строки. Аргумент может заканчиваться запятой
+static bool HasArgument(const AsmLine& line, const std::string& word) {
+    for (size_t k = 1; k < line.words.size(); ++k) {
+        const std::string& arg = line.words[k];
+        if (arg.compare(0, word.size(), word) == 0 &&
+                (arg.size() == word.size() || (arg.size() == word.size() + 1 && arg.back() == ','))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Инструкция с именем и числом аргументов строки. Ее формы различаются только кодированием аргументов, поэтому
+// поток управления и работа со стеком у них общие
+static const Instruction* FindInstruction(const AsmLine& line) {
+    for (const Instruction& inst : GetInstructionSet()) {
+        if (line.words[0] == inst.name && inst.args_count == static_cast<int>(line.words.size()) - 1) {
+            return &inst;
+        }
+    }
+    return nullptr;
+}
+
+static std::vector<Function> FindFunctions(const std::vector<AsmLine>& lines) {
+    std::vector<Function> result;
+    for (size_t i = 0; i + 1 < lines.size(); ++i) {
+        if (!IsLabel(lines[i]) || !IsPopRegister(lines[i + 1])) {
+            continue;
+        }
+        if (!result.empty()) {
+            result.back().end_line = i;
+        }
+        int args_count = 0;
+        while (i + 2 + args_count < lines.size() && IsPopRegister(lines[i + 2 + args_count])) {
+            ++args_count;
+        }
+        result.push_back({LabelName(lines[i]), i, lines.size(), lines[i + 1].words[1], args_count});
+    }
+    return result;
+}
+
+static ReturnSequence MatchReturnSequence(const std::vector<AsmLine>& lines, size_t call_line,
+                                          const std::string& return_register) {
+    // Labels may stand between the call and the return: the sequence stays in place for the jumps to them
+    std::vector<const std::vector<std::string>*> next;
+    for (size_t i = call_line + 1; i < lines.size() && next.size() < 4; ++i) {
+        if (!IsLabel(lines[i])) {
+            next.push_back(&lines[i].words);
+        }
+    }
+    auto is = [&next] (size_t k, const std::vector<std::string>& words) {
+        return k < next.size() && *next[k] == words;
+    };
+    const std::vector<std::string> push = {"push", return_register}, pop = {"pop", return_register};
+    if (is(0, {"swap"}) && (is(1, {"ret"}) || (is(1, pop) && is(2, push) && is(3, {"ret"})))) {
+        return RETURN_SAVED;
+    }
+    if (is(0, push) && is(1, {"ret"})) {
+        return RETURN_REGISTER;
+    }
+    return NOT_RETURN;
+}
+
+// Ищет push rX, которым перед вызовом в строке call_line сохранен адрес возврата. Между ними не должно быть меток,
+// переходов и упоминаний rX, а код аргументов не должен снимать сохраненное значение со стека. Возвращает номер
+// строки push или -1, в args_size записывает, сколько байт лежит на стеке над сохраненным адресом перед call
+static int FindSavedReturnAddress(const std::vector<AsmLine>& lines, size_t call_line,
+                                  const std::string& return_register, int& args_size) {
+    int saved = -1;
+    for (size_t i = call_line; i-- > 0;) {
+        const AsmLine& line = lines[i];
+        if (line.words == std::vector<std::string>{"push", return_register}) {
+            saved = static_cast<int>(i);
+            break;
+        }
+        const Instruction* inst = IsLabel(line) ? nullptr : FindInstruction(line);
+        if (inst == nullptr || inst->flow != FLOW_NEXT || inst->stack_pops < 0 || HasArgument(line, return_register)) {
+            return -1;
+        }
+    }
+    if (saved < 0) {
+        return -1;
+    }
+
+    int depth = 0;
+    for (size_t i = saved + 1; i < call_line; ++i) {
+        const Instruction* inst = FindInstruction(lines[i]);
+        if (inst->stack_pops > depth) {
+            return -1;
+        }
+        depth += inst->stack_pushes - inst->stack_pops;
+    }
+    args_size = depth;
+    return saved;
+}
+
+// Можно ли перейти в function, не сохраняя register_name: функция его не использует, никого не вызывает и не
+// переходит на метки вне себя
+static bool PreservesRegister(const std::vector<AsmLine>& lines, const Function& function,
+                              const std::unordered_set<std::string>& labels, const std::string& register_name) {
+    if (function.return_register == register_name) {
+        return false;
+    }
+    std::unordered_set<std::string> own_labels;
+    for (size_t i = function.label_line; i < function.end_line; ++i) {
+        if (IsLabel(lines[i])) {
+            own_labels.insert(LabelName(lines[i]));
+        }
+    }
+    for (size_t i = function.label_line + 1; i < function.end_line; ++i) {
+        const AsmLine& line = lines[i];
+        if (line.words[0] == "call" || line.words[0] == "dep" || HasArgument(line, register_name)) {
+            return false;
+        }
+        for (size_t k = 1; k < line.words.size(); ++k) {
+            std::string arg = line.words[k].back() == ',' ? line.words[k].substr(0, line.words[k].size() - 1)
+                                                          : line.words[k];
+            if (labels.count(arg) > 0 && own_labels.count(arg) == 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Хвостовой вызов g из f распознается в двух видах:
+//   - f сохранила адрес возврата (push rX) под аргументами g, а после call g идет swap; ret. Тогда push rX убирается,
+//     а call g заменяется на push rX; jmp g, и g возвращается прямо к вызвавшему f. Если g -- сама f, вместо этого
+//     call заменяется переходом на pop аргументов f, то есть рекурсия становится циклом;
+//   - после call g идет push rX; ret, а g не трогает rX. Тогда call g заменяется на push rX; jmp g.
+// Код после call и так не восстанавливал регистры, а rX по соглашению о вызовах не сохраняется, поэтому после
+// возврата в нем может оказаться другое значение
+void EliminateTailCalls(std::vector<AsmLine>& lines, const TextLocation& loc) {
+    std::vector<Function> functions = FindFunctions(lines);
+    if (functions.empty()) {
+        return;
+    }
+    std::unordered_map<std::string, const Function*> by_name;
+    for (const Function& function : functions) {
+        by_name[function.name] = &function;
+    }
+    std::unordered_set<std::string> labels;
+    for (const AsmLine& line : lines) {
+        if (IsLabel(line)) {
+            labels.insert(LabelName(line));
+        }
+    }
+
+    std::vector<bool> removed(lines.size(), false);
+    std::unordered_map<size_t, std::vector<AsmLine>> replaced;
+    std::unordered_map<size_t, std::string> loop_starts;  // Строки pop rX, после которых ставятся метки циклов
+    size_t current = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        while (current + 1 < functions.size() && functions[current + 1].label_line <= i) {
+            ++current;
+        }
+        const Function& caller = functions[current];
+        if (i <= caller.label_line || lines[i].words.size() != 2 || lines[i].words[0] != "call") {
+            continue;
+        }
+        auto callee = by_name.find(lines[i].words[1]);
+        if (callee == by_name.end()) {
+            continue;
+        }
+        const Function& target = *callee->second;
+        const std::string& rx = caller.return_register;
+        int source_line = lines[i].source_line;
+
+        ReturnSequence sequence = MatchReturnSequence(lines, i, rx);
+        TextLocation at = loc;
+        at.source_lines = nullptr;
+        at.line = source_line;
+        if (sequence == RETURN_SAVED) {
+            int args_size = 0;
+            int saved = FindSavedReturnAddress(lines, i, rx, args_size);
+            int expected_size = target.args_count * static_cast<int>(sizeof(friday_constant_t));
+            if (saved < 0 || removed[saved] || args_size != expected_size) {
+                continue;
+            }
+            removed[saved] = true;
+            if (&target == &caller) {
+                // The arguments are popped again on each iteration, the return address stays in rX
+                loop_starts[caller.label_line + 1] = caller.name + TAIL_LOOP_SUFFIX;
+                replaced[i] = {{{"jmp", caller.name + TAIL_LOOP_SUFFIX}, source_line}};
+                at.PrintCompileMessage("note: self-recursive tail call of '%s' is replaced with a loop",
+                                       caller.name.c_str());
+            } else {
+                replaced[i] = {{{"push", rx}, source_line}, {{"jmp", target.name}, source_line}};
+                at.PrintCompileMessage("note: tail call of '%s' is replaced with a jump", target.name.c_str());
+            }
+        } else if (sequence == RETURN_REGISTER && &target != &caller && PreservesRegister(lines, target, labels, rx)) {
+            replaced[i] = {{{"push", rx}, source_line}, {{"jmp", target.name}, source_line}};
+            at.PrintCompileMessage("note: tail call of '%s' is replaced with a jump", target.name.c_str());
+        }
+    }
+    if (replaced.empty()) {
+        return;
+    }
+
+    std::vector<AsmLine> result;
+    result.reserve(lines.size() + replaced.size() + loop_starts.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+        int source_line = lines[i].source_line;
+        auto replacement = replaced.find(i);
+        if (replacement != replaced.end()) {
+            result.insert(result.end(), replacement->second.begin(), replacement->second.end());
+        } else if (!removed[i]) {
+            result.push_back(std::move(lines[i]));
+        }
+        auto loop_start = loop_starts.find(i);
+        if (loop_start != loop_starts.end()) {
+            result.push_back({{loop_start->second + ":"}, source_line});
+        }
+    }
+    lines = std::move(result);
+}
@@ -0,0 +1,180 @@
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "assembler_inside_facade.hpp"
+#include "utility/FileHelper.hpp"
+
+using namespace FridayArch;
+
+// Сколько ждать, пока редактор допишет все файлы, прежде чем пересобирать программу
+const static int SETTLE_TIME_MS = 20;
+
+namespace {
+
+// Входной файл и результат его последней компиляции
+struct WatchedFile {
+    const char* filename;
+    int watch = -1;       // Дескриптор inotify каталога файла
+    std::string name;     // Имя файла внутри каталога
+    std::string source;   // Текст, из которого получен object
+    AsmObject object;
+    bool compiled = false;
+};
+
+}
+
+// Собирает программу так же, как AssemblyAndLink, но файл, текст которого не менялся и перед которым код и метки
+// всех файлов остались прежними, не компилируется: его сохраненный код дописывается как есть. Поэтому программа
+// совпадает с результатом friday-asm побайтно. Возвращает число перекомпилированных файлов или -1, если программа
+// не собралась. up_to_date -- записан ли результат прошлой сборки
+static int Rebuild(std::vector<WatchedFile>& files, const AssemblerArgs& args, bool& up_to_date) {
+    TextLocation loc;
+    FridayAsmWriter writer(&loc);
+    writer.WriteHeader();
+
+    int recompiled = 0;
+    bool ok = true;
+    bool same_prefix = true;  // Все файлы до текущего дали тот же код и те же метки, что в прошлый раз
+    for (auto& file : files) {
+        FileHelper::MappedFile mapped;
+        try {
+            mapped = FileHelper::MappedFile(file.filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(file.filename, "reading", exc);
+            file.compiled = false;
+            ok = false;
+            break;
+        }
+
+        friday_address_t start = writer.GetCurrentCodeOffset();
+        if (same_prefix && file.compiled && file.object.start == start && mapped.view() == file.source) {
+            writer.AppendObject(file.object);
+            continue;
+        }
+
+        ++recompiled;
+        file.source.assign(mapped.view());
+        size_t first_label = writer.GetLabelCount();
+        loc.SetFile(file.filename);
+        bool compiled = CompileAndLinkFile(file.source, loc, writer, args.optimize);
+        AsmObject object;
+        if (compiled) {
+            writer.ExtractObject(start, first_label, object);
+        }
+        // Later files depend on this one only through its code and labels
+        same_prefix = same_prefix && compiled && file.compiled && object == file.object;
+        file.object = std::move(object);
+        file.compiled = compiled;
+        ok &= compiled;
+    }
+    if (!ok) {
+        up_to_date = false;
+        return -1;
+    }
+    if (recompiled == 0 && up_to_date) {
+        return 0;
+    }
+    up_to_date = false;
+
+    try {
+        FileHelper::WriteFileAtomically(args.output_filename, writer.GetBytecode());
+    } catch (const std::exception& exc) {
+        FileHelper::PrintErrorWorkingWithFile(args.output_filename, "writing to", exc);
+        return -1;
+    }
+    if (args.map_filename != nullptr) {
+        std::string temporary = std::string(args.map_filename) + ".tmp" + std::to_string(getpid());
+        try {
+            writer.GetSymbolMap().Save(temporary.c_str());
+            FileHelper::ReplaceFile(temporary.c_str(), args.map_filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.map_filename, "writing to", exc);
+        }
+    }
+    up_to_date = true;
+    return recompiled;
+}
+
+static void RebuildAndReport(std::vector<WatchedFile>& files, const AssemblerArgs& args, bool& up_to_date) {
+    auto start = std::chrono::steady_clock::now();
+    bool was_up_to_date = up_to_date;
+    int recompiled = Rebuild(files, args, up_to_date);
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (recompiled < 0) {
+        printf("friday-asm: '%s' is not updated because of errors\n", args.output_filename);
+    } else if (recompiled > 0 || !was_up_to_date) {
+        printf("friday-asm: '%s' updated, %d of %zu files re-assembled in %.1f ms\n", args.output_filename,
+               recompiled, files.size(), elapsed_ms);
+    }
+    fflush(stdout);
+}
+
+bool WatchAndAssemble(const AssemblerArgs &args) {
+    int inotify = inotify_init1(IN_CLOEXEC);
+    if (inotify < 0) {
+        printf("error: cannot watch files: %s\n", strerror(errno));
+        return false;
+    }
+
+    // Editors often save a file by writing a new one and renaming it over the old one, so watch directories
+    std::vector<WatchedFile> files(args.input_files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string path = args.input_files[i];
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+        files[i].filename = args.input_files[i];
+        files[i].name = slash == std::string::npos ? path : path.substr(slash + 1);
+        files[i].watch = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (files[i].watch < 0) {
+            printf("error: cannot watch directory '%s': %s\n", directory.c_str(), strerror(errno));
+            close(inotify);
+            return false;
+        }
+    }
+
+    bool up_to_date = false;
+    RebuildAndReport(files, args, up_to_date);
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    while (true) {
+        // Wait for a change of an input file, then for the rest of the changes made by the same save
+        bool changed = false;
+        int timeout = -1;
+        while (true) {
+            pollfd request = {inotify, POLLIN, 0};
+            int ready = poll(&request, 1, timeout);
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready <= 0) {
+                break;
+            }
+            ssize_t length = read(inotify, buffer, sizeof(buffer));
+            if (length < 0 && errno == EINTR) {
+                continue;
+            }
+            if (length <= 0) {
+                printf("error: cannot watch files: %s\n", strerror(errno));
+                close(inotify);
+                return false;
+            }
+            for (ssize_t offset = 0; offset < length;) {
+                auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                for (auto& file : files) {
+                    changed |= event->len > 0 && event->wd == file.watch && file.name == event->name;
+                }
+                offset += sizeof(inotify_event) + event->len;
+            }
+            if (changed) {
+                timeout = SETTLE_TIME_MS;
+            }
+        }
+        RebuildAndReport(files, args, up_to_date);
+    }
+}
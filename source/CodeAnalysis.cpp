@@ -0,0 +1,63 @@
+#include "CodeAnalysis.hpp"
+#include "utility/BytesHelper.hpp"
+
+using namespace FridayArch;
+using namespace BytesHelper;
+
+int FridayArch::GetJumpTarget(const Instruction &inst, const char *inst_code, int address) {
+    const char* arg = inst_code + sizeof(friday_inst_t);
+    for (int i = 0; i < inst.args_count; ++i) {
+        if (inst.args[i] == LABEL) {
+            return ReadFromBytes<friday_address_t>(arg);
+        }
+        if (inst.args[i] == LABEL_REL_8) {
+            return address + static_cast<int>(inst.inst_full_size) + ReadFromBytes<friday_short_offset_t>(arg);
+        }
+        arg += GetInstructionArgumentSize(inst.args[i]);
+    }
+    return -1;
+}
+
+bool FridayArch::DecodeProgram(const char *code, int code_size, std::vector<DecodedInstruction> &result) {
+    for (int address = HEADER_SIZE; address < code_size;) {
+        const Instruction* inst = GetInstructionByBytecode(code[address]);
+        if (inst == nullptr || address + static_cast<int>(inst->inst_full_size) > code_size) {
+            return false;
+        }
+        result.push_back({address, inst, GetJumpTarget(*inst, code + address, address)});
+        address += inst->inst_full_size;
+    }
+    return true;
+}
+
+std::vector<BasicBlock> FridayArch::SplitIntoBasicBlocks(const std::vector<DecodedInstruction> &decoded) {
+    std::vector<BasicBlock> blocks;
+    if (decoded.empty()) {
+        return blocks;
+    }
+
+    // Mark leaders by address
+    int code_end = decoded.back().address + static_cast<int>(decoded.back().inst->inst_full_size);
+    std::vector<bool> leader(code_end + 1, false);
+    leader[decoded.front().address] = true;
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        auto& inst = decoded[i];
+        if (inst.jump_target >= 0 && inst.jump_target < code_end) {
+            leader[inst.jump_target] = true;
+        }
+        if (inst.inst->flow != FLOW_NEXT && i + 1 < decoded.size()) {
+            leader[decoded[i + 1].address] = true;
+        }
+    }
+
+    for (int i = 0; i < static_cast<int>(decoded.size()); ++i) {
+        if (leader[decoded[i].address]) {
+            if (!blocks.empty()) {
+                blocks.back().last = i - 1;
+            }
+            blocks.push_back({i, i});
+        }
+    }
+    blocks.back().last = static_cast<int>(decoded.size()) - 1;
+    return blocks;
+}
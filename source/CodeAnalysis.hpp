@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include "friday_asm_lang.hpp"
+
+namespace FridayArch {
+
+// Инструкция, прочитанная из образа программы
+struct DecodedInstruction {
+    int address;
+    const Instruction* inst;
+    int jump_target;  // Адрес метки из аргументов инструкции или -1, если метки нет
+};
+
+// Базовый блок: инструкции decoded[first..last], управление входит только в первую, а уходит только из последней
+struct BasicBlock {
+    int first;
+    int last;
+};
+
+// Последовательно читает инструкции из code[HEADER_SIZE..code_size). Возвращает false, если встретился байт,
+// не являющийся инструкцией, или инструкция обрезана концом кода; все инструкции до него будут в result
+bool DecodeProgram(const char* code, int code_size, std::vector<DecodedInstruction>& result);
+
+// Возвращает адрес метки из аргументов инструкции, расположенной по адресу address, или -1
+int GetJumpTarget(const Instruction& inst, const char* inst_code, int address);
+
+// Делит прочитанную программу на базовые блоки. Блок начинается с начала программы, с метки перехода и после
+// инструкции, меняющей поток управления; заканчивается такой инструкцией или перед началом следующего блока
+std::vector<BasicBlock> SplitIntoBasicBlocks(const std::vector<DecodedInstruction>& decoded);
+
+}
@@ -0,0 +1,276 @@
+#include "ContextScheduler.hpp"
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include "Emulator.hpp"
+#include "EmulatorObserver.hpp"
+#include "InputSource.hpp"
+#include "Verifier.hpp"
+#include "friday_asm_lang.hpp"
+#include "utility/BytesHelper.hpp"
+
+using namespace FridayArch;
+
+struct ContextScheduler::Context {
+    int64_t id;
+    Emulator emu;
+    QueuedInput input;
+    std::string output;
+    std::shared_ptr<const Program> program;  // Держит проверку программы, которую использует emu
+    std::mutex lock;                         // Упорядочивает передачу ввода с засыпанием в ожидании ввода
+    bool waiting_input = false;              // Контекст ждет ввода и не стоит в очереди. Защищен lock
+    bool finished = false;                   // Защищен contexts_lock
+
+    Context(int64_t id, int32_t memory_size) : id(id), emu(memory_size) {}
+};
+
+struct ContextScheduler::Worker {
+    std::mutex lock;
+    std::deque<Context*> tasks;
+};
+
+// Номер очереди потока хоста, -1 у остальных потоков
+static thread_local int current_worker = -1;
+
+std::shared_ptr<const ContextScheduler::Program> ContextScheduler::PrepareProgram(const char *image, size_t size) {
+    if (size < static_cast<size_t>(HEADER_SIZE) || !CheckForFRDY(image)) {
+        throw std::runtime_error("program is not a .friday executable");
+    }
+    if (size > static_cast<size_t>(Emulator::MEMORY_SIZE)) {
+        throw std::runtime_error("program does not fit in emulator memory");
+    }
+    auto version = BytesHelper::ReadFromBytes<int16_t>(image, HEADER_ASM_VER_OFFSET);
+    if (version > ARCH_VERSION) {
+        throw std::runtime_error("program is compiled for arch version " + std::to_string(version) +
+                                 ", but emulator supports up to " + std::to_string(ARCH_VERSION));
+    }
+
+    auto program = std::make_shared<Program>();
+    program->image.assign(image, image + size);
+    program->verification = std::make_shared<const VerifiedProgram>(
+            VerifyProgram(program->image.data(), static_cast<int>(size)));
+    return program;
+}
+
+ContextScheduler::ContextScheduler(int host_threads, int32_t memory_size) :
+    memory_size(std::clamp(memory_size, static_cast<int32_t>(MIN_MEMORY_SIZE),
+                           static_cast<int32_t>(Emulator::MEMORY_SIZE)))
+{
+    int count = std::max(host_threads, 1);
+    for (int i = 0; i < count; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < count; ++i) {
+        this->host_threads.emplace_back(&ContextScheduler::WorkerLoop, this, i);
+    }
+}
+
+ContextScheduler::~ContextScheduler() {
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        stopping = true;
+    }
+    idle_cv.notify_all();
+    for (auto& thread : host_threads) {
+        thread.join();
+    }
+}
+
+int64_t ContextScheduler::Start(std::shared_ptr<const Program> program, int64_t fuel) {
+    if (program->image.size() > static_cast<size_t>(memory_size)) {
+        throw std::runtime_error("program does not fit in context memory");
+    }
+    int64_t id;
+    {
+        std::lock_guard<std::mutex> guard(contexts_lock);
+        id = next_id++;
+    }
+
+    auto context = std::make_shared<Context>(id, memory_size);
+    Emulator& emu = context->emu;
+    emu.LoadMemory(program->image.data(), static_cast<int>(program->image.size()), program->verification);
+    emu.output_buffer = &context->output;
+    emu.output_stream = nullptr;
+    emu.input = &context->input;
+    if (fuel >= 0) {
+        emu.AddFuel(fuel);
+    }
+    context->program = std::move(program);
+
+    {
+        std::lock_guard<std::mutex> guard(contexts_lock);
+        contexts[id] = context;
+    }
+    Enqueue(context.get());
+    return id;
+}
+
+std::shared_ptr<ContextScheduler::Context> ContextScheduler::Find(int64_t id) {
+    std::lock_guard<std::mutex> guard(contexts_lock);
+    auto found = contexts.find(id);
+    return found != contexts.end() ? found->second : nullptr;
+}
+
+bool ContextScheduler::Feed(int64_t id, std::string_view text) {
+    std::shared_ptr<Context> context = Find(id);
+    if (context == nullptr) {
+        return false;
+    }
+    bool wake;
+    {
+        std::lock_guard<std::mutex> guard(context->lock);
+        context->input.Push(text);
+        wake = context->waiting_input;
+        context->waiting_input = false;
+    }
+    if (wake) {
+        --waiting;
+        context->emu.signal = Emulator::NO_SIGNAL;
+        Enqueue(context.get());
+    }
+    return true;
+}
+
+bool ContextScheduler::CloseInput(int64_t id) {
+    std::shared_ptr<Context> context = Find(id);
+    if (context == nullptr) {
+        return false;
+    }
+    bool wake;
+    {
+        std::lock_guard<std::mutex> guard(context->lock);
+        context->input.Close();
+        wake = context->waiting_input;
+        context->waiting_input = false;
+    }
+    if (wake) {
+        --waiting;
+        context->emu.signal = Emulator::NO_SIGNAL;
+        Enqueue(context.get());
+    }
+    return true;
+}
+
+bool ContextScheduler::Wait(int64_t id, Result &result) {
+    std::unique_lock<std::mutex> guard(contexts_lock);
+    auto found = contexts.find(id);
+    if (found == contexts.end()) {
+        return false;
+    }
+    std::shared_ptr<Context> context = found->second;
+    finished_cv.wait(guard, [&context] { return context->finished; });
+    contexts.erase(id);
+    guard.unlock();
+
+    const Emulator& emu = context->emu;
+    result.signal = emu.signal;
+    result.ip = emu.ip;
+    result.sp = emu.sp;
+    result.output = std::move(context->output);
+    return true;
+}
+
+size_t ContextScheduler::LiveContexts() {
+    std::lock_guard<std::mutex> guard(contexts_lock);
+    return contexts.size();
+}
+
+void ContextScheduler::Enqueue(Context *context, bool to_front) {
+    int index = current_worker >= 0 ? current_worker
+                                    : static_cast<int>(next_worker++ % static_cast<unsigned>(workers.size()));
+    Worker& worker = *workers[index];
+    {
+        std::lock_guard<std::mutex> guard(worker.lock);
+        if (to_front) {
+            worker.tasks.push_front(context);
+        } else {
+            worker.tasks.push_back(context);
+        }
+    }
+    ++queued;
+    // Захват idle_lock упорядочивает увеличение queued с проверкой условия в WorkerLoop: пробуждение не теряется
+    { std::lock_guard<std::mutex> guard(idle_lock); }
+    idle_cv.notify_one();
+}
+
+ContextScheduler::Context *ContextScheduler::TakeTask(int worker_index) {
+    {
+        Worker& own = *workers[worker_index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            Context* context = own.tasks.back();
+            own.tasks.pop_back();
+            --queued;
+            return context;
+        }
+    }
+
+    int count = static_cast<int>(workers.size());
+    for (int i = 1; i < count; ++i) {
+        Worker& victim = *workers[(worker_index + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            Context* context = victim.tasks.front();
+            victim.tasks.pop_front();
+            --queued;
+            return context;
+        }
+    }
+    return nullptr;
+}
+
+void ContextScheduler::WorkerLoop(int worker_index) {
+    current_worker = worker_index;
+    while (!stopping) {
+        Context* context = TakeTask(worker_index);
+        if (context != nullptr) {
+            Execute(context);
+            continue;
+        }
+
+        // Unlike guest threads, contexts which all wait for input are not a deadlock: Feed wakes them up
+        std::unique_lock<std::mutex> guard(idle_lock);
+        idle_cv.wait(guard, [this] { return stopping || queued > 0; });
+    }
+    current_worker = -1;
+}
+
+void ContextScheduler::Execute(Context *context) {
+    Emulator& emu = context->emu;
+    NullObserver observer;
+    while (true) {
+        bool stopped = emu.RunSlice(SLICE_STEPS, observer);
+        if (stopping) {
+            return;
+        }
+        if (!stopped) {
+            if (queued > 0) {
+                Enqueue(context, true);
+                return;
+            }
+            continue;
+        }
+
+        if (emu.signal == Emulator::SIGNAL_WAITING_INPUT) {
+            std::lock_guard<std::mutex> guard(context->lock);
+            if (context->input.Ready()) {
+                // Ввод пришел, пока контекст выходил из RunSlice: in можно повторить сразу
+                emu.signal = Emulator::NO_SIGNAL;
+                continue;
+            }
+            context->waiting_input = true;
+            ++waiting;
+            return;
+        }
+        Finish(context);
+        return;
+    }
+}
+
+void ContextScheduler::Finish(Context *context) {
+    {
+        std::lock_guard<std::mutex> guard(contexts_lock);
+        context->finished = true;
+    }
+    finished_cv.notify_all();
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace FridayArch {
+
+struct VerifiedProgram;
+
+// Множество независимых программ Friday (контекстов) на нескольких потоках хоста. Контекст -- Emulator с
+// небольшой памятью (страницы выделяются при первом обращении), своим вводом и накопленным выводом.
+// У каждого потока хоста своя очередь контекстов: новые и разбуженные он берет с конца, а когда она пуста, ворует
+// из начала чужих. Контекст исполняется порциями по SLICE_STEPS инструкций и между порциями уступает место другим,
+// если они ждут. Контекст, которому in нечего прочитать, не занимает поток хоста, пока Feed не передаст ему ввод.
+// Гостевые потоки контекстам недоступны: spawn и join поднимают SIGILL
+class ContextScheduler {
+public:
+    const static int32_t DEFAULT_MEMORY_SIZE = 1024 * 1024;
+    const static int32_t MIN_MEMORY_SIZE = 64 * 1024;
+    const static int SLICE_STEPS = 16 * 1024;
+
+    // Образ программы, проверенный один раз и общий для всех контекстов, которые его исполняют
+    struct Program {
+        std::vector<char> image;
+        std::shared_ptr<const VerifiedProgram> verification;
+    };
+
+    struct Result {
+        int signal = 0;       // SIGNAL_EXIT, фатальный сигнал или SIGNAL_OUT_OF_FUEL
+        int32_t ip = -1;
+        int32_t sp = -1;
+        std::string output;   // Все, что напечатали out и outf
+    };
+
+    // Проверяет заголовок образа и саму программу (VerifyProgram). Бросает std::runtime_error, если это не
+    // программа Friday или она собрана для более новой версии архитектуры
+    static std::shared_ptr<const Program> PrepareProgram(const char* image, size_t size);
+
+    // memory_size -- память каждого контекста, не меньше MIN_MEMORY_SIZE и не больше Emulator::MEMORY_SIZE.
+    // Потоки хоста запускаются сразу
+    ContextScheduler(int host_threads, int32_t memory_size = DEFAULT_MEMORY_SIZE);
+    // Останавливает потоки хоста, незаконченные контексты удаляются
+    ~ContextScheduler();
+
+    ContextScheduler(const ContextScheduler&) = delete;
+    ContextScheduler& operator=(const ContextScheduler&) = delete;
+
+    // Создает контекст, исполняющий program, и ставит его в очередь. fuel >= 0 -- бюджет инструкций контекста
+    // (см. Emulator::AddFuel). Возвращает номер контекста. Бросает std::runtime_error, если программа не
+    // помещается в память контекста
+    int64_t Start(std::shared_ptr<const Program> program, int64_t fuel = -1);
+    // Передает контексту id слова ввода text (см. QueuedInput::Push). Контекст, ждущий in, продолжит исполнение.
+    // Возвращает false, если контекста нет
+    bool Feed(int64_t id, std::string_view text);
+    // Закрывает ввод контекста id: когда переданные значения кончатся, in будет получать 0
+    bool CloseInput(int64_t id);
+    // Ждет окончания контекста id, записывает его результат в result и удаляет контекст. Возвращает false, если
+    // контекста нет
+    bool Wait(int64_t id, Result& result);
+
+    // Сколько контекстов создано и еще не удалено Wait
+    size_t LiveContexts();
+    // Сколько контекстов сейчас ждет ввода
+    size_t WaitingContexts() const { return waiting; }
+
+private:
+    struct Context;
+    struct Worker;
+
+    const int32_t memory_size;
+
+    // Контексты по номерам. Защищены contexts_lock, окончание контекста ждут на finished_cv
+    std::mutex contexts_lock;
+    std::condition_variable finished_cv;
+    std::unordered_map<int64_t, std::shared_ptr<Context>> contexts;
+    int64_t next_id = 1;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> host_threads;
+    std::atomic<unsigned> next_worker{0};  // Очередь для контекстов, которые ставит в очередь не поток хоста
+    std::atomic<int> queued{0};            // Сколько контекстов ждет в очередях
+    std::atomic<size_t> waiting{0};
+    std::atomic<bool> stopping{false};
+    std::mutex idle_lock;
+    std::condition_variable idle_cv;
+
+    std::shared_ptr<Context> Find(int64_t id);
+    void WorkerLoop(int worker_index);
+    void Enqueue(Context* context, bool to_front = false);
+    Context* TakeTask(int worker_index);
+    // Исполняет контекст до ожидания ввода, окончания или пока другие контексты ждут очереди
+    void Execute(Context* context);
+    void Finish(Context* context);
+};
+
+}
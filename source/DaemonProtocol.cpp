@@ -0,0 +1,127 @@
+#include "DaemonProtocol.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace FridayArch;
+
+const static int MAX_DESCRIPTORS = 4;
+
+std::string FridayArch::GetDefaultDaemonSocket() {
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir != nullptr && runtime_dir[0] != '\0') {
+        return std::string(runtime_dir) + "/friday-emud.sock";
+    }
+    return "/tmp/friday-emud-" + std::to_string(getuid()) + ".sock";
+}
+
+bool FridayArch::SendAll(int socket, const void *data, size_t length) {
+    auto bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t sent = send(socket, bytes, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+bool FridayArch::ReceiveAll(int socket, void *data, size_t length) {
+    auto bytes = static_cast<char*>(data);
+    while (length > 0) {
+        ssize_t received = recv(socket, bytes, length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        bytes += received;
+        length -= received;
+    }
+    return true;
+}
+
+bool FridayArch::SendWithDescriptors(int socket, const void *data, size_t length, const int *fds, int fds_count) {
+    if (length == 0 || fds_count > MAX_DESCRIPTORS) {
+        return false;
+    }
+    char control[CMSG_SPACE(sizeof(int) * MAX_DESCRIPTORS)] = {};
+    iovec iov = {const_cast<void*>(data), length};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * fds_count);
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * fds_count);
+    std::memcpy(CMSG_DATA(header), fds, sizeof(int) * fds_count);
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0) {
+        return false;
+    }
+    // Descriptors went with the first byte, the rest is plain data
+    return SendAll(socket, static_cast<const char*>(data) + sent, length - sent);
+}
+
+bool FridayArch::ReceiveWithDescriptors(int socket, void *data, size_t length, int *fds, int fds_count) {
+    if (length == 0 || fds_count > MAX_DESCRIPTORS) {
+        return false;
+    }
+    char control[CMSG_SPACE(sizeof(int) * MAX_DESCRIPTORS)] = {};
+    iovec iov = {data, length};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+
+    int received_fds = 0;
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int count = static_cast<int>((header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            if (received_fds < fds_count) {
+                fds[received_fds] = fd;
+            } else {
+                close(fd);
+            }
+            ++received_fds;
+        }
+    }
+    bool ok = received_fds == fds_count && (message.msg_flags & MSG_CTRUNC) == 0 &&
+              ReceiveAll(socket, static_cast<char*>(data) + received, length - received);
+    if (!ok) {
+        for (int i = 0; i < std::min(received_fds, fds_count); ++i) {
+            close(fds[i]);
+        }
+    }
+    return ok;
+}
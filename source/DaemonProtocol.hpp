@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace FridayArch {
+
+// Протокол friday-emud. Клиент подключается к Unix-сокету и отправляет DaemonRequest, к которому прикреплены
+// (SCM_RIGHTS) два дескриптора: откуда программе читать ввод и куда печатать вывод. Следом идут program_length
+// байт: путь к программе или сама программа. Программа печатает прямо в переданный дескриптор, а когда она
+// закончится, демон отвечает DaemonReply и закрывает соединение
+const char DAEMON_MAGIC[4] = {'F', 'E', 'M', 'D'};
+const uint32_t DAEMON_PROGRAM_PATH = 0;
+const uint32_t DAEMON_PROGRAM_BYTES = 1;
+
+struct DaemonRequest {
+    char magic[4];
+    uint32_t program_kind;    // DAEMON_PROGRAM_PATH или DAEMON_PROGRAM_BYTES
+    uint32_t program_length;
+    int32_t threads_count;    // Как у friday-emu -j, 0 -- по числу ядер
+    uint32_t ordered_output;  // Как у friday-emu --ordered-output
+};
+
+struct DaemonReply {
+    int32_t signal;  // Сигнал, которым закончилась программа (SIGNAL_EXIT -- без ошибок), -1 -- не удалось загрузить
+};
+
+// $XDG_RUNTIME_DIR/friday-emud.sock или /tmp/friday-emud-<uid>.sock
+std::string GetDefaultDaemonSocket();
+
+// Отправляют и читают ровно length байт. Возвращают false, если соединение закрыто или произошла ошибка
+bool SendAll(int socket, const void* data, size_t length);
+bool ReceiveAll(int socket, void* data, size_t length);
+// То же, но вместе с первыми байтами передаются дескрипторы fds
+bool SendWithDescriptors(int socket, const void* data, size_t length, const int* fds, int fds_count);
+// Если дескрипторов пришло не fds_count, полученные закрываются и возвращается false
+bool ReceiveWithDescriptors(int socket, void* data, size_t length, int* fds, int fds_count);
+
+}
@@ -0,0 +1,287 @@
+#include "Debugger.hpp"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include "CodeAnalysis.hpp"
+#include "EmulatorObserver.hpp"
+#include "ListingGenerator.hpp"
+#include "friday_asm_lang.hpp"
+#include "utility/BytesHelper.hpp"
+
+using namespace FridayArch;
+
+static const char* DEBUGGER_HELP =
+        "b <address|label>  set breakpoint\n"
+        "d <address|label>  delete breakpoint\n"
+        "w r<N>             stop when register rN changes\n"
+        "uw r<N>            delete watchpoint\n"
+        "s [count]          execute count instructions, 1 by default\n"
+        "c                  continue until breakpoint, watchpoint or end of program\n"
+        "regs               print registers\n"
+        "stack [count]      print count values from the top of the stack, 8 by default\n"
+        "info               print breakpoints and watchpoints\n"
+        "q                  quit\n";
+
+Debugger::Debugger(Emulator &emu, const SymbolMap *symbols, FILE *commands) :
+    emu(emu),
+    symbols(symbols),
+    commands(commands),
+    instruction_starts(std::max(emu.program_size, 0), false)
+{
+    std::vector<DecodedInstruction> decoded;
+    DecodeProgram(emu.mem, emu.program_size, decoded);
+    for (auto& inst : decoded) {
+        instruction_starts[inst.address] = true;
+    }
+    emu.under_debugger = true;
+}
+
+void Debugger::Run() {
+    printf("Friday debugger. Type 'help' for the list of commands\n");
+    PrintLocation();
+
+    char line[256];
+    while (true) {
+        printf("(fdb) ");
+        fflush(stdout);
+        if (fgets(line, sizeof(line), commands) == nullptr) {
+            printf("\n");
+            return;
+        }
+
+        char command[32] = "";
+        char argument[224] = "";
+        int parsed = sscanf(line, "%31s %223s", command, argument);
+        if (parsed < 1) {
+            continue;
+        }
+        std::string name = command;
+        std::string arg = parsed > 1 ? argument : "";
+
+        int value = 0;
+        if (name == "q" || name == "quit") {
+            return;
+        } else if (name == "help" || name == "h") {
+            printf("%s", DEBUGGER_HELP);
+        } else if (name == "b" || name == "break") {
+            if (ParseAddress(arg, value)) {
+                breakpoints.emplace(value, '\0');  // Исходный байт запоминается, когда ставится trap
+                printf("Breakpoint at 0x%04x\n", value);
+            }
+        } else if (name == "d" || name == "delete") {
+            if (ParseAddress(arg, value) && breakpoints.erase(value) == 0) {
+                printf("No breakpoint at 0x%04x\n", value);
+            }
+        } else if (name == "w" || name == "watch") {
+            if (ParseRegister(arg, value)) {
+                watchpoints.push_back({value, emu.regs[value]});
+                printf("Watchpoint on r%d\n", value);
+            }
+        } else if (name == "uw" || name == "unwatch") {
+            if (ParseRegister(arg, value)) {
+                watchpoints.erase(std::remove_if(watchpoints.begin(), watchpoints.end(),
+                        [value] (const Watchpoint& watch) { return watch.reg == value; }), watchpoints.end());
+            }
+        } else if (name == "s" || name == "step") {
+            Step(arg.empty() ? 1 : atoi(arg.c_str()));
+        } else if (name == "c" || name == "continue") {
+            Continue();
+        } else if (name == "regs") {
+            PrintRegisters();
+        } else if (name == "stack") {
+            PrintStack(arg.empty() ? 8 : atoi(arg.c_str()));
+        } else if (name == "info") {
+            PrintInfo();
+        } else {
+            printf("Unknown command '%s'. Type 'help' for the list of commands\n", command);
+        }
+    }
+}
+
+bool Debugger::ParseAddress(const std::string &text, int &address) const {
+    if (text.empty()) {
+        printf("Expected address or label\n");
+        return false;
+    }
+    if (isdigit(static_cast<unsigned char>(text[0]))) {
+        char* end = nullptr;
+        address = static_cast<int>(strtol(text.c_str(), &end, 0));
+        if (*end != '\0') {
+            printf("Bad address '%s'\n", text.c_str());
+            return false;
+        }
+    } else {
+        const SymbolMap::Symbol* symbol = symbols != nullptr ? symbols->FindByName(text) : nullptr;
+        if (symbol == nullptr) {
+            printf("Unknown label '%s'%s\n", text.c_str(), symbols == nullptr ? " (no symbol map, see -m)" : "");
+            return false;
+        }
+        address = symbol->address;
+    }
+
+    if (address < 0 || address >= static_cast<int>(instruction_starts.size()) || !instruction_starts[address]) {
+        printf("No instruction starts at 0x%04x\n", address);
+        return false;
+    }
+    return true;
+}
+
+bool Debugger::ParseRegister(const std::string &text, int &reg) const {
+    if (text.size() < 2 || text[0] != 'r' || !isdigit(static_cast<unsigned char>(text[1]))) {
+        printf("Expected register, for example r0\n");
+        return false;
+    }
+    reg = atoi(text.c_str() + 1);
+    if (reg >= static_cast<int>(emu.regs.size())) {
+        printf("Program has only %zu registers\n", emu.regs.size());
+        return false;
+    }
+    return true;
+}
+
+void Debugger::InsertTraps() {
+    for (auto& breakpoint : breakpoints) {
+        breakpoint.second = emu.mem[breakpoint.first];
+        emu.mem[breakpoint.first] = TRAP_INSTRUCTION;
+    }
+}
+
+void Debugger::RemoveTraps() {
+    for (auto& breakpoint : breakpoints) {
+        emu.mem[breakpoint.first] = breakpoint.second;
+    }
+}
+
+bool Debugger::StepInstruction() {
+    NullObserver observer;
+    return !emu.RunSlice(1, observer);
+}
+
+bool Debugger::CheckWatchpoints() {
+    bool fired = false;
+    for (auto& watch : watchpoints) {
+        int32_t value = emu.regs[watch.reg];
+        if (value != watch.last_value) {
+            printf("Watchpoint r%d: %d -> %d\n", watch.reg, watch.last_value, value);
+            watch.last_value = value;
+            fired = true;
+        }
+    }
+    return fired;
+}
+
+void Debugger::Continue() {
+    if (!IsRunning()) {
+        printf("The program is not running\n");
+        return;
+    }
+
+    // Инструкция, на которой стоим, исполняется без trap, иначе точка сработала бы снова
+    if (breakpoints.count(emu.ip) != 0) {
+        if (!StepInstruction() || CheckWatchpoints()) {
+            if (ReportStop()) {
+                PrintLocation();
+            }
+            return;
+        }
+    }
+
+    InsertTraps();
+    if (watchpoints.empty()) {
+        NullObserver observer;
+        while (!emu.RunSlice(INT_MAX, observer)) {}
+    } else {
+        while (StepInstruction() && !CheckWatchpoints()) {}
+    }
+    RemoveTraps();
+
+    if (ReportStop()) {
+        PrintLocation();
+    }
+}
+
+void Debugger::Step(int count) {
+    for (int i = 0; i < count; ++i) {
+        if (!IsRunning()) {
+            printf("The program is not running\n");
+            return;
+        }
+        if (!StepInstruction() || CheckWatchpoints()) {
+            break;
+        }
+    }
+    if (ReportStop()) {
+        PrintLocation();
+    }
+}
+
+bool Debugger::ReportStop() {
+    switch (emu.signal) {
+        case Emulator::NO_SIGNAL:
+            return true;
+        case Emulator::SIGNAL_TRAP:
+            if (breakpoints.count(emu.ip) != 0) {
+                printf("Breakpoint at 0x%04x\n", emu.ip);
+            } else {
+                // trap записан в самой программе: продолжим со следующей инструкции
+                printf("Trap instruction at 0x%04x\n", emu.ip);
+                emu.ip += sizeof(friday_inst_t);
+            }
+            emu.signal = Emulator::NO_SIGNAL;
+            return true;
+        case Emulator::SIGNAL_EXIT:
+            printf("The program finished\n");
+            return false;
+        default:
+            printf("The program stopped with signal %d\n", emu.signal);
+            return false;
+    }
+}
+
+void Debugger::PrintLocation() const {
+    if (!IsRunning()) {
+        return;
+    }
+    ListingAnnotations annotations;
+    annotations.symbols = symbols;
+    ListingGenerator listing(stdout, emu.ip, &annotations);
+    if (emu.ip < 0 || emu.ip >= emu.program_size ||
+            listing.PrintInstruction(emu.mem + emu.ip, emu.program_size - emu.ip) < 0) {
+        printf("0x%04x: not an instruction\n", emu.ip);
+    }
+    listing.Flush();
+}
+
+void Debugger::PrintRegisters() const {
+    for (size_t i = 0; i < emu.regs.size(); ++i) {
+        printf("r%zu = %d (0x%08x)\n", i, emu.regs[i], static_cast<uint32_t>(emu.regs[i]));
+    }
+    printf("ip = 0x%08x, sp = 0x%08x\n", emu.ip, emu.sp);
+}
+
+void Debugger::PrintStack(int count) const {
+    for (int i = 0; i < count; ++i) {
+        int address = emu.sp + i * static_cast<int>(sizeof(int32_t));
+        if (address + static_cast<int>(sizeof(int32_t)) > emu.memory_size) {
+            break;
+        }
+        auto value = BytesHelper::BytesAs<int32_t>(emu.mem, address);
+        printf("0x%08x: %d (float: %g)\n", address, value, BytesHelper::BytesAs<float>(emu.mem, address));
+    }
+}
+
+void Debugger::PrintInfo() const {
+    for (auto& breakpoint : breakpoints) {
+        const SymbolMap::Symbol* symbol = symbols != nullptr ? symbols->FindByAddress(breakpoint.first) : nullptr;
+        printf("breakpoint 0x%04x%s%s\n", breakpoint.first, symbol != nullptr ? " " : "",
+               symbol != nullptr ? symbol->name.c_str() : "");
+    }
+    for (auto& watch : watchpoints) {
+        printf("watchpoint r%d = %d\n", watch.reg, watch.last_value);
+    }
+}
+
+bool Debugger::IsRunning() const {
+    return emu.signal == Emulator::NO_SIGNAL;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "Emulator.hpp"
+#include "SymbolMap.hpp"
+
+namespace FridayArch {
+
+// Интерактивный отладчик. Точки останова ставятся как в int3: пока программа исполняется, первый байт инструкции
+// заменяется на trap, так что до срабатывания программа работает с обычной скоростью. На время команд
+// отладчика исходные байты возвращаются на место. Точки наблюдения за регистрами проверяются после каждой
+// инструкции, поэтому, пока они есть, программа исполняется по шагам.
+// Гостевые потоки под отладчиком не поддерживаются: у эмулятора нет планировщика, spawn вызывает SIGILL
+class Debugger {
+public:
+    // symbols может быть nullptr, тогда точки останова задаются только адресами. Команды читаются из commands
+    Debugger(Emulator& emu, const SymbolMap* symbols, FILE* commands);
+
+    // Исполняет команды, пока они не закончатся или не будет введено q
+    void Run();
+
+private:
+    struct Watchpoint {
+        int reg;
+        int32_t last_value;
+    };
+
+    Emulator& emu;
+    const SymbolMap* symbols;
+    FILE* commands;
+    std::vector<bool> instruction_starts;  // По адресу начинается инструкция, на нее можно поставить точку
+    std::map<int, char> breakpoints;       // Адрес -> исходный байт
+    std::vector<Watchpoint> watchpoints;
+
+    // Возвращает false и печатает ошибку, если text -- не адрес инструкции и не метка
+    bool ParseAddress(const std::string& text, int& address) const;
+    bool ParseRegister(const std::string& text, int& reg) const;
+
+    void InsertTraps();
+    void RemoveTraps();
+    // Исполняет одну инструкцию без точек останова. Возвращает false, если программа остановилась сигналом
+    bool StepInstruction();
+    // Проверяет точки наблюдения и печатает сработавшие. Возвращает true, если хоть одна сработала
+    bool CheckWatchpoints();
+    void Continue();
+    void Step(int count);
+    // Сообщает, почему остановилась программа. Возвращает true, если ее можно продолжать
+    bool ReportStop();
+
+    void PrintLocation() const;
+    void PrintRegisters() const;
+    void PrintStack(int count) const;
+    void PrintInfo() const;
+    bool IsRunning() const;
+};
+
+}
@@ -1,20 +1,53 @@
 #include "Emulator.hpp"
 #include "friday_asm_lang.hpp"
+#include <algorithm>
 #include <cstring>
 #include "utility/BytesHelper.hpp"
+#include "utility/FileHelper.hpp"
+#include "EmulatorObserver.hpp"
+#include "Verifier.hpp"
 #include <cstdio>
+#include <cerrno>
+#include <new>
+#include <system_error>
+#include <unistd.h>
+#include <sys/mman.h>
 
 using namespace FridayArch;
 
-Emulator::Emulator() :
+// Память эмулятора -- анонимное отображение: страницы выделяются ядром лениво, при первом обращении,
+// а поверх начала можно отобразить файл программы
+static char* MapAnonymousMemory(char* addr, size_t size) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (addr != nullptr ? MAP_FIXED : 0);
+    void* result = mmap(addr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (result == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    return static_cast<char*>(result);
+}
+
+Emulator::Emulator(int32_t memory_size) :
     sp(-1),
     ip(-1),
     ap(-1),
-    mem(new char[MEMORY_SIZE])
+    mem(MapAnonymousMemory(nullptr, memory_size + STACK_GUARD_SIZE)),
+    memory_size(memory_size),
+    owns_memory(true)
+{}
+
+Emulator::Emulator(char *shared_memory, int32_t memory_size) :
+    sp(-1),
+    ip(-1),
+    ap(-1),
+    mem(shared_memory),
+    memory_size(memory_size),
+    owns_memory(false)
 {}
 
 Emulator::~Emulator() {
-    delete[] mem;
+    if (owns_memory) {
+        munmap(mem, memory_size + STACK_GUARD_SIZE);
+    }
 }
 
 void Emulator::push(const char *bytes, int length) {
@@ -34,6 +67,25 @@ char *Emulator::get_stack_ptr() const {
     return mem + sp;
 }
 
+char *Emulator::get_memory_range(int32_t address, uint32_t length) {
+    auto begin = static_cast<uint32_t>(address);  // Negative addresses become huge and fail the check
+    if (length > static_cast<uint32_t>(memory_size) || begin > static_cast<uint32_t>(memory_size) - length) {
+        signal = SIGNAL_SIGSEGV;
+        return nullptr;
+    }
+    return mem + begin;
+}
+
+char *Emulator::get_writable_range(int32_t address, uint32_t length) {
+    char* result = get_memory_range(address, length);
+    if (result != nullptr && verification != nullptr && verification->ok &&
+            static_cast<uint32_t>(address) < static_cast<uint32_t>(program_size)) {
+        signal = SIGNAL_SIGSEGV;
+        return nullptr;
+    }
+    return result;
+}
+
 int Emulator::pop_int() {
     int res = BytesHelper::BytesAs<int>(mem + sp);
     sp += 4;
@@ -46,43 +98,199 @@ float Emulator::pop_float() {
     return res;
 }
 
-void Emulator::LoadMemory(const char *program, int program_size) {
+void Emulator::Reset() {
+    UnmapImage();
+    madvise(mem, memory_size + STACK_GUARD_SIZE, MADV_DONTNEED);
+    regs.clear();
+    sp = ip = ap = -1;
+    stack_base = stack_limit = -1;
+    signal = SIGNAL_MEMORY_NOT_READY;
+    program_size = 0;
+    scheduler = nullptr;
+    thread_id = 0;
+    output_buffer = nullptr;
+    output_stream = stdout;
+    input = nullptr;
+    under_debugger = false;
+    verification.reset();
+    force_runtime_checks = false;
+    fuel_metering = false;
+    fuel = 0;
+    fuel_tank = nullptr;
+    run_lengths = nullptr;
+}
+
+void Emulator::LoadMemory(const char *program, int program_size,
+                          std::shared_ptr<const VerifiedProgram> verification) {
+    UnmapImage();
     std::memcpy(mem, program, program_size);
-    int regs_count = BytesHelper::BytesAs<int>(program, HEADER_REG_COUNT_OFFSET);
+    this->program_size = program_size;
+    InitRegistersFromHeader();
+    VerifyLoadedProgram(std::move(verification));
+}
+
+void Emulator::LoadMemoryFromFile(const char *filename) {
+    UnmapImage();
+
+    size_t size = 0;
+    int fd = FileHelper::OpenRegularFile(filename, size);
+    if (size > static_cast<size_t>(memory_size)) {
+        close(fd);
+        throw std::system_error(EFBIG, std::generic_category(), "program does not fit in emulator memory");
+    }
+
+    if (size > 0) {
+        // Страницы файла становятся страницами mem; запись в них копирует страницу, файл не меняется.
+        // Хвост последней страницы после конца файла ядро заполняет нулями
+        void* addr = mmap(mem, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        if (addr == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "mmap");
+        }
+        mapped_image_size = static_cast<int>(size);
+    }
+    close(fd);
+    program_size = static_cast<int>(size);
+    InitRegistersFromHeader();
+    VerifyLoadedProgram(nullptr);
+}
+
+void Emulator::UnmapImage() {
+    if (mapped_image_size > 0) {
+        MapAnonymousMemory(mem, mapped_image_size);
+        mapped_image_size = 0;
+    }
+}
+
+void Emulator::InitRegistersFromHeader() {
+    int regs_count = BytesHelper::BytesAs<friday_reg_t>(mem, HEADER_REG_COUNT_OFFSET);
     regs.assign(regs_count, 0);
     ip = HEADER_SIZE;
-    sp = MEMORY_SIZE - 1;
+    sp = memory_size - 1;
     signal = NO_SIGNAL;
 }
 
-void Emulator::Run(bool debug_mode) {
-    while (true) {
-        if (debug_mode) {
-            PrintDebugInfo();
-        }
+void Emulator::VerifyLoadedProgram(std::shared_ptr<const VerifiedProgram> ready) {
+    verification = ready != nullptr ? std::move(ready)
+                                    : std::make_shared<const VerifiedProgram>(VerifyProgram(mem, program_size));
+    run_lengths = verification->ok ? verification->run_lengths.data() : nullptr;
+    bool bound_known = verification->ok && verification->stack_bound >= 0;
+    stack_base = sp;
+    // A small memory may not hold the computed stack between the program and its end: then the stack is checked
+    bool bound_fits = bound_known && verification->stack_bound <= stack_base - program_size;
+    force_runtime_checks = bound_known && !bound_fits;
+    int32_t default_stack = memory_size / 2 < STACK_SIZE ? memory_size / 2 : STACK_SIZE;
+    stack_limit = stack_base - (bound_fits ? verification->stack_bound : default_stack);
+}
+
+bool Emulator::HandleSignal() {
+    switch (signal) {
+        case SIGNAL_MEMORY_NOT_READY:
+            if (output_stream != nullptr) {
+                fprintf(output_stream, "Emulator error: memory for emulator is not loaded, cannot run.\n");
+            }
+            return true;
+        case SIGNAL_EXIT:
+        case SIGNAL_BLOCKED:
+        case SIGNAL_WAITING_INPUT:
+            return true;
+        case SIGNAL_OUT_OF_FUEL:
+            if (output_stream == nullptr) {
+                return true;
+            }
+            if (thread_id == 0) {
+                fprintf(output_stream, "OUT OF FUEL. ip = 0x%08x, sp = 0x%08x\n", ip, sp);
+            } else {
+                fprintf(output_stream, "OUT OF FUEL in thread %d. ip = 0x%08x, sp = 0x%08x\n", thread_id, ip, sp);
+            }
+            return true;
+        case SIGNAL_TRAP:
+            if (under_debugger) {
+                return true;
+            }
+            [[fallthrough]];
+        case SIGNAL_SIGILL:
+        case SIGNAL_SIGSEGV:
+            if (output_stream == nullptr) {
+                return true;
+            }
+            if (thread_id == 0) {
+                fprintf(output_stream, "FATAL SIGNAL %d. ip = 0x%08x, sp = 0x%08x\n", signal, ip, sp);
+            } else {
+                fprintf(output_stream, "FATAL SIGNAL %d in thread %d. ip = 0x%08x, sp = 0x%08x\n",
+                        signal, thread_id, ip, sp);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Emulator::AddFuel(int64_t amount) {
+    bool uncharged = !fuel_metering || signal == SIGNAL_OUT_OF_FUEL;
+    fuel_metering = true;
+    fuel += amount;
+    if (signal == SIGNAL_OUT_OF_FUEL) {
+        signal = NO_SIGNAL;
+    }
+    // The run at ip is not paid for yet: metering starts in the middle of it, or it did not fit in the budget
+    if (uncharged && signal == NO_SIGNAL) {
+        ChargeFuel();
+    }
+}
 
-        // Check signals
-        switch (signal) {
-            case SIGNAL_MEMORY_NOT_READY:
-                printf("Emulator error: memory for emulator is not loaded, cannot run.\n");
-                return;
-            case SIGNAL_EXIT:
-                return;
-            case SIGNAL_SIGILL:
-            case SIGNAL_SIGSEGV:
-                printf("FATAL SIGNAL %d. ip = 0x%08x, sp = 0x%08x\n", signal, ip, sp);
-                return;
-            default: break;
+bool Emulator::RefillFuel(int32_t cost) {
+    if (fuel_tank == nullptr) {
+        return false;
+    }
+    int64_t available = fuel_tank->load(std::memory_order_relaxed);
+    int64_t taken;
+    do {
+        if (fuel + available < cost) {
+            return false;
         }
+        // Portions shrink with the budget, so that one thread does not take the whole rest of it
+        int64_t portion = std::min<int64_t>(FUEL_REFILL, available / FUEL_REFILL_SHARE);
+        taken = std::min<int64_t>(available, std::max<int64_t>(cost - fuel, portion));
+    } while (!fuel_tank->compare_exchange_weak(available, available - taken, std::memory_order_relaxed));
+    fuel += taken;
+    return true;
+}
 
-        Instruction* inst = GetInstructionByBytecode(mem[ip]);
-        if (inst == nullptr) {
-            signal = SIGNAL_SIGILL;
-        } else {
-            ap = ip + sizeof(friday_inst_t);
-            ip += inst->inst_full_size;
-            inst->callback(this);
+int32_t Emulator::RunLength(int32_t address) const {
+    if (verification != nullptr && verification->ok && verification->IsInstructionStart(address)) {
+        return verification->run_lengths[address];
+    }
+    // Code which the verifier has not seen is decoded now, an unknown instruction ends the run with SIGILL
+    int32_t length = 0;
+    while (static_cast<uint32_t>(address) < static_cast<uint32_t>(memory_size)) {
+        const Instruction* inst = GetInstructionByBytecode(mem[address]);
+        ++length;
+        if (inst == nullptr || inst->flow != FLOW_NEXT) {
+            break;
         }
+        address += static_cast<int32_t>(inst->inst_full_size);
+    }
+    return std::max(length, 1);
+}
+
+void Emulator::Run(bool debug_mode) {
+    if (debug_mode) {
+        PrintDebugInfo();
+        DebugObserver observer;
+        Run(observer);
+    } else {
+        NullObserver observer;
+        Run(observer);
+    }
+}
+
+void Emulator::WriteOutput(const char *text, size_t length) {
+    if (output_buffer != nullptr) {
+        output_buffer->append(text, length);
+    } else {
+        fwrite(text, 1, length, output_stream);
     }
 }
 
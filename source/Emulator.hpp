@@ -1,10 +1,20 @@
 #pragma once
 
+#include <atomic>
 #include <vector>
+#include <string>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <memory>
 
 namespace FridayArch {
 
+class GuestScheduler;
+class InputSource;
+struct Instruction;
+struct VerifiedProgram;
+
 class Emulator {
 public:
     const static int MEMORY_SIZE = 128 * 1024 * 1024;  // 128 kb
@@ -12,14 +22,58 @@ public:
     const static int SIGNAL_EXIT = 1;
     const static int SIGNAL_SIGSEGV = 2;
     const static int SIGNAL_SIGILL = 3;
+    const static int SIGNAL_BLOCKED = 4;  // Гостевой поток ждет в join, его продолжит GuestScheduler
+    const static int SIGNAL_TRAP = 5;     // Исполнена инструкция trap, ip указывает на нее
+    // Кончился бюджет инструкций (см. AddFuel). ip указывает на начало участка, который не оплачен, и после
+    // пополнения бюджета исполнение продолжается с него
+    const static int SIGNAL_OUT_OF_FUEL = 6;
+    // in или in_f ждет значения, которого еще нет (InputSource::READ_PENDING). ip указывает на эту инструкцию, и
+    // когда значение появится, исполнение продолжается с нее (см. ContextScheduler)
+    const static int SIGNAL_WAITING_INPUT = 7;
     const static int SIGNAL_MEMORY_NOT_READY = -1;
+    // Стек главного потока -- верхние STACK_SIZE байт памяти (но не больше половины памяти), если проверка программы
+    // не вычислила, сколько ему нужно. Выход за стек -- SIGSEGV
+    const static int STACK_SIZE = 8 * 1024 * 1024;
+    // За концом памяти лежит еще страница: инструкция, снимающая значения с пустого стека, читает ее, а не память
+    // хоста, и эмулятор успевает заметить ошибку
+    const static int STACK_GUARD_SIZE = 4096;
+    // Сколько инструкций гостевой поток берет за раз из общего бюджета fuel_tank: FUEL_REFILL, но не больше
+    // 1 / FUEL_REFILL_SHARE остатка
+    const static int FUEL_REFILL = 64 * 1024;
+    const static int FUEL_REFILL_SHARE = 16;
 
     std::vector<int32_t> regs;
     int32_t sp, ip, ap;  // special regs: stack ptr, instruction ptr (addr of next inst), argument ptr
+    int32_t stack_base = -1;   // sp пустого стека
+    int32_t stack_limit = -1;  // Наименьший допустимый sp
     char* const mem;
+    const int32_t memory_size;  // Размер mem, MEMORY_SIZE, если эмулятор создан без размера
     int signal = SIGNAL_MEMORY_NOT_READY;
+    int program_size = 0;  // Размер загруженного образа программы
+
+    GuestScheduler* scheduler = nullptr;  // Планировщик гостевых потоков, nullptr -- spawn и join недоступны
+    int thread_id = 0;                    // Номер гостевого потока, 0 -- главный
+    std::string* output_buffer = nullptr; // Куда копить вывод out/outf, nullptr -- сразу в output_stream
+    // Куда печатать вывод и сообщения о фатальных сигналах. nullptr -- сообщения не печатаются, тогда вывод
+    // должен копиться в output_buffer
+    FILE* output_stream = stdout;
+    InputSource* input = nullptr;         // Откуда читают in/in_f, nullptr -- scanf из stdin
+    bool under_debugger = false;          // SIGNAL_TRAP обрабатывает отладчик, а не считается фатальным
+    // Результат проверки загруженной программы, общий для всех ее потоков (см. Verifier.hpp)
+    std::shared_ptr<const VerifiedProgram> verification;
+    bool force_runtime_checks = false;    // Исполнять с проверками, даже если программа проверена
+    // Бюджет инструкций. Он списывается не на каждой инструкции, а участками: переходы, call, ret и spawn оплачивают
+    // участок кода с нового ip до следующей такой инструкции включительно (VerifiedProgram::run_lengths)
+    bool fuel_metering = false;
+    int64_t fuel = 0;
+    std::atomic<int64_t>* fuel_tank = nullptr;  // Общий бюджет гостевых потоков, из него пополняется fuel
+    // verification->run_lengths, если программа проверена, иначе nullptr. 0 -- не начало проверенной инструкции
+    const int32_t* run_lengths = nullptr;
 
-    Emulator();
+    // Память резервируется целиком, но страницы выделяются при первом обращении
+    explicit Emulator(int32_t memory_size = MEMORY_SIZE);
+    // Гостевой поток: свои регистры и стек, но общая память shared_memory размером memory_size, которой он не владеет
+    Emulator(char* shared_memory, int32_t memory_size);
     ~Emulator();
 
     Emulator(const Emulator&) = delete;
@@ -27,7 +81,17 @@ public:
     Emulator& operator=(const Emulator&) = delete;
     Emulator& operator=(Emulator&&) = delete;
 
-    void LoadMemory(const char* program, int program_size);
+    // Возвращает эмулятор в состояние сразу после конструктора: память обнуляется (страницы отдаются ядру и при
+    // следующем обращении снова выделяются нулевыми), поля сбрасываются. Только для эмулятора, владеющего памятью
+    void Reset();
+
+    // Загрузка программы проверяет ее (VerifyProgram) и по результату выбирает размер стека. Если verification не
+    // nullptr, это уже готовый результат VerifyProgram для того же образа, и программа не проверяется заново
+    void LoadMemory(const char* program, int program_size,
+                    std::shared_ptr<const VerifiedProgram> verification = nullptr);
+    // Отображает файл программы прямо в начало mem (MAP_PRIVATE, copy-on-write) без промежуточных копий.
+    // Бросает std::system_error, если файл не удалось открыть или он не помещается в память эмулятора
+    void LoadMemoryFromFile(const char* filename);
 
     void push(const char* bytes, int length);
     int pop_int();
@@ -41,8 +105,57 @@ public:
     const char* get_arg_ptr() const;
     char* get_stack_ptr() const;
 
+    // Возвращает указатель на байты mem[address, address + length), если они целиком лежат в памяти эмулятора.
+    // Иначе выставляет SIGNAL_SIGSEGV и возвращает nullptr. Граница проверяется один раз на весь диапазон
+    char* get_memory_range(int32_t address, uint32_t length);
+    // То же для записи. Код проверенной программы записывать нельзя, иначе исполнялся бы непроверенный код
+    char* get_writable_range(int32_t address, uint32_t length);
+
+    // Печатает текст программы: в output_buffer, если он задан, иначе в output_stream
+    void WriteOutput(const char* text, size_t length);
+
     void PrintDebugInfo() const;
     void Run(bool debug_mode);
+    // Исполняет программу до сигнала, сообщая о событиях observer (см. EmulatorObserver.hpp)
+    template <typename Observer>
+    void Run(Observer& observer);
+    // Исполняет не больше max_steps инструкций. Возвращает true, если исполнение остановлено сигналом
+    // (его значение остается в signal). Проверенная программа исполняется без проверок, которые сделал VerifyProgram
+    template <typename Observer>
+    bool RunSlice(int max_steps, Observer& observer);
+    // Обрабатывает текущий сигнал (печатает фатальные). Возвращает true, если исполнение нужно остановить
+    bool HandleSignal();
+
+    // Включает учет бюджета инструкций и добавляет к нему amount. Вызывается после загрузки программы; если
+    // исполнение остановлено SIGNAL_OUT_OF_FUEL, снимает сигнал, и RunSlice продолжит программу
+    void AddFuel(int64_t amount);
+    // Оплачивает участок кода, который начинается с ip. Вызывается инструкциями, которые заканчивают участок. Если
+    // бюджета не хватает, выставляет SIGNAL_OUT_OF_FUEL
+    void ChargeFuel();
+    // Сколько инструкций подряд исполнится с address до инструкции, меняющей поток управления, включительно
+    int32_t RunLength(int32_t address) const;
+
+private:
+    // Какие проверки делает RunSlice перед и после каждой инструкции
+    enum RuntimeChecks {
+        CHECK_NONE = 0,
+        CHECK_CODE = 1,   // ip в памяти, инструкция известна, номера регистров в аргументах в пределах regs
+        CHECK_STACK = 2   // Инструкции хватает значений на стеке, sp не выходит за стек
+    };
+
+    const bool owns_memory;
+    int mapped_image_size = 0;  // Размер отображенного файла программы, 0 если программа скопирована в mem
+
+    void UnmapImage();
+    void InitRegistersFromHeader();
+    void VerifyLoadedProgram(std::shared_ptr<const VerifiedProgram> ready);
+    // Берет из fuel_tank столько, чтобы fuel хватило на cost. Возвращает false, если в общем бюджете не хватает
+    bool RefillFuel(int32_t cost);
+
+    template <int CHECKS, typename Observer>
+    bool RunSliceWithChecks(int max_steps, Observer& observer);
 };
 
 }
+
+#include "Emulator_impl.hpp"
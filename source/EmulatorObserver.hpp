@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include "Emulator.hpp"
+#include "Profile.hpp"
+#include "friday_asm_lang.hpp"
+
+namespace FridayArch {
+
+// Наблюдатели за исполнением -- параметр шаблона Emulator::Run и Emulator::RunSlice. Эмулятор вызывает:
+//   OnInstruction -- после исполнения каждой инструкции, ip уже указывает на следующую;
+//   OnCall, OnRet -- после call и dep / ret, target -- новый ip;
+//   OnBranch      -- после условного перехода, taken -- совершен ли переход;
+//   OnIO          -- у in и in_f после чтения, у out и outf перед печатью; value -- биты значения на вершине стека;
+//   OnSignal      -- когда исполнение останавливается сигналом (в том числе SIGNAL_BLOCKED гостевого потока).
+// Методы NullObserver пустые, и компилятор выбрасывает их вызовы: Run<NullObserver> не медленнее цикла без
+// наблюдателя. Свой наблюдатель удобно наследовать от NullObserver и скрыть только нужные методы
+struct NullObserver {
+    void OnInstruction(const Emulator& /*emu*/, int /*address*/, const Instruction& /*inst*/) {}
+    void OnCall(const Emulator& /*emu*/, int /*address*/, int /*target*/) {}
+    void OnRet(const Emulator& /*emu*/, int /*address*/, int /*target*/) {}
+    void OnBranch(const Emulator& /*emu*/, int /*address*/, bool /*taken*/) {}
+    void OnIO(const Emulator& /*emu*/, int /*address*/, const Instruction& /*inst*/, int32_t /*value*/) {}
+    void OnSignal(const Emulator& /*emu*/, int /*signal*/) {}
+};
+
+// Наблюдатель, подключаемый во время исполнения: Run<DynamicObserver> вызывает виртуальные методы, поэтому
+// инструменту достаточно передать наследника этого класса, не пересобирая эмулятор
+class DynamicObserver {
+public:
+    virtual ~DynamicObserver() = default;
+
+    virtual void OnInstruction(const Emulator& /*emu*/, int /*address*/, const Instruction& /*inst*/) {}
+    virtual void OnCall(const Emulator& /*emu*/, int /*address*/, int /*target*/) {}
+    virtual void OnRet(const Emulator& /*emu*/, int /*address*/, int /*target*/) {}
+    virtual void OnBranch(const Emulator& /*emu*/, int /*address*/, bool /*taken*/) {}
+    virtual void OnIO(const Emulator& /*emu*/, int /*address*/, const Instruction& /*inst*/, int32_t /*value*/) {}
+    virtual void OnSignal(const Emulator& /*emu*/, int /*signal*/) {}
+};
+
+// Печатает состояние эмулятора после каждой инструкции (режим -d)
+struct DebugObserver : NullObserver {
+    void OnInstruction(const Emulator& emu, int /*address*/, const Instruction& /*inst*/) {
+        emu.PrintDebugInfo();
+    }
+};
+
+// Записывает каждую исполненную инструкцию в профиль
+struct ProfileObserver : NullObserver {
+    Profile& profile;
+
+    explicit ProfileObserver(Profile& profile) : profile(profile) {}
+
+    void OnInstruction(const Emulator& emu, int address, const Instruction& inst) {
+        profile.Record(address, emu.ip != address + static_cast<int>(inst.inst_full_size));
+    }
+};
+
+// Передает каждое событие сначала first, затем second
+template <typename First, typename Second>
+struct ObserverPair {
+    First& first;
+    Second& second;
+
+    ObserverPair(First& first, Second& second) : first(first), second(second) {}
+
+    void OnInstruction(const Emulator& emu, int address, const Instruction& inst) {
+        first.OnInstruction(emu, address, inst);
+        second.OnInstruction(emu, address, inst);
+    }
+    void OnCall(const Emulator& emu, int address, int target) {
+        first.OnCall(emu, address, target);
+        second.OnCall(emu, address, target);
+    }
+    void OnRet(const Emulator& emu, int address, int target) {
+        first.OnRet(emu, address, target);
+        second.OnRet(emu, address, target);
+    }
+    void OnBranch(const Emulator& emu, int address, bool taken) {
+        first.OnBranch(emu, address, taken);
+        second.OnBranch(emu, address, taken);
+    }
+    void OnIO(const Emulator& emu, int address, const Instruction& inst, int32_t value) {
+        first.OnIO(emu, address, inst, value);
+        second.OnIO(emu, address, inst, value);
+    }
+    void OnSignal(const Emulator& emu, int signal) {
+        first.OnSignal(emu, signal);
+        second.OnSignal(emu, signal);
+    }
+};
+
+}
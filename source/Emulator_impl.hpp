@@ -0,0 +1,111 @@
+#include <climits>
+#include "friday_asm_lang.hpp"
+#include "Verifier.hpp"
+#include "utility/BytesHelper.hpp"
+
+// class Emulator //
+
+inline void FridayArch::Emulator::ChargeFuel() {
+    if (!fuel_metering) {
+        return;
+    }
+    // ip of verified code is below program_size, which is the size of run_lengths
+    int32_t cost = run_lengths != nullptr && static_cast<uint32_t>(ip) < static_cast<uint32_t>(program_size)
+                   && run_lengths[ip] > 0 ? run_lengths[ip] : RunLength(ip);
+    if (fuel < cost && !RefillFuel(cost)) {
+        if (signal == NO_SIGNAL) {
+            signal = SIGNAL_OUT_OF_FUEL;
+        }
+        return;
+    }
+    fuel -= cost;
+}
+
+template <typename Observer>
+void FridayArch::Emulator::Run(Observer& observer) {
+    while (!RunSlice(INT_MAX, observer)) {}
+}
+
+template <typename Observer>
+bool FridayArch::Emulator::RunSlice(int max_steps, Observer& observer) {
+    // The debugger may change ip and registers between slices, so its program is checked at run time
+    if (verification == nullptr || !verification->ok || under_debugger || force_runtime_checks) {
+        return RunSliceWithChecks<CHECK_CODE | CHECK_STACK>(max_steps, observer);
+    }
+    if (verification->stack_bound < 0) {
+        return RunSliceWithChecks<CHECK_STACK>(max_steps, observer);
+    }
+    return RunSliceWithChecks<CHECK_NONE>(max_steps, observer);
+}
+
+template <int CHECKS, typename Observer>
+bool FridayArch::Emulator::RunSliceWithChecks(int max_steps, Observer& observer) {
+    for (int step = 0; step < max_steps && signal == NO_SIGNAL; ++step) {
+        if constexpr ((CHECKS & CHECK_CODE) != 0) {
+            if (static_cast<uint32_t>(ip) >= static_cast<uint32_t>(memory_size)) {
+                signal = SIGNAL_SIGSEGV;
+                break;
+            }
+        }
+        Instruction* inst = GetInstructionByBytecode(mem[ip]);
+        if constexpr ((CHECKS & CHECK_CODE) != 0) {
+            int bad_register = -1;
+            if (inst == nullptr || !CheckRegisterArguments(*inst, mem + ip, static_cast<int>(regs.size()), bad_register)) {
+                signal = SIGNAL_SIGILL;
+                break;
+            }
+        }
+        if constexpr ((CHECKS & CHECK_STACK) != 0) {
+            if (inst->stack_pops > stack_base - sp) {
+                signal = SIGNAL_SIGSEGV;
+                break;
+            }
+        }
+
+        int address = ip;
+        if (inst->io == IO_OUTPUT) {
+            observer.OnIO(*this, address, *inst, BytesHelper::BytesAs<int32_t>(mem, sp));
+        }
+
+        ap = ip + sizeof(friday_inst_t);
+        ip += inst->inst_full_size;
+        inst->callback(this);
+        if constexpr ((CHECKS & CHECK_STACK) != 0) {
+            if (sp < stack_limit || sp > stack_base) {
+                signal = SIGNAL_SIGSEGV;
+            }
+        }
+
+        observer.OnInstruction(*this, address, *inst);
+        switch (inst->flow) {
+            case FLOW_CALL:
+                observer.OnCall(*this, address, ip);
+                break;
+            case FLOW_RET:
+                observer.OnRet(*this, address, ip);
+                break;
+            case FLOW_BRANCH:
+                observer.OnBranch(*this, address, ip != address + static_cast<int>(inst->inst_full_size));
+                break;
+            default:
+                break;
+        }
+        if (inst->io == IO_INPUT && signal != SIGNAL_WAITING_INPUT) {
+            observer.OnIO(*this, address, *inst, BytesHelper::BytesAs<int32_t>(mem, sp));
+        }
+
+        if constexpr ((CHECKS & CHECK_CODE) == 0) {
+            // The return address comes from the stack, and the program may have written anything there
+            if (inst->flow == FLOW_RET && signal == NO_SIGNAL && !verification->IsInstructionStart(ip)) {
+                force_runtime_checks = true;
+                return RunSlice(max_steps - step - 1, observer);
+            }
+        }
+    }
+
+    if (signal == NO_SIGNAL) {
+        return false;
+    }
+    observer.OnSignal(*this, signal);
+    return HandleSignal();
+}
@@ -3,6 +3,7 @@
 #include <cstring>
 #include <cassert>
 #include "utility/BytesHelper.hpp"
+#include <limits>
 
 using namespace FridayArch;
 
@@ -22,38 +23,133 @@ void FridayAsmWriter::WriteHeader() {
     WriteToBuffer(DEFAULT_REG_COUNT, HEADER_REG_COUNT_OFFSET);
 }
 
+template <typename T>
+static bool FitsIn(int32_t value) {
+    return std::numeric_limits<T>::min() <= value && value <= std::numeric_limits<T>::max();
+}
+
 bool FridayAsmWriter::WriteInstruction(const std::vector<std::string_view> &args, bool link) {
     assert(!args.empty());
 
-    std::vector<InstructionArgument> types(args.size() - 1);
-
-    // Reserve memory for instruction command
-    size_t inst_offset = bytecode.size();
-    bytecode.insert(bytecode.end(), sizeof(friday_inst_t), 0);
-
-    for (int i = 1; i < args.size(); ++i) {
-        auto type = types[i - 1] = ParseAndCompileArgument(args[i], link);
+    std::vector<ParsedArgument> parsed(args.size() - 1);
+    bool is_jump = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        auto type = ParseArgument(args[i], link, parsed[i - 1]);
         if (type == _BAD_ARG) {
             return false;
         }
+        is_jump |= type == LABEL;
+    }
+
+    size_t jump_index = next_jump_index;
+    bool short_jump_allowed = false;
+    if (is_jump) {
+        ++next_jump_index;
+        if (long_jumps.size() < next_jump_index) {
+            long_jumps.resize(next_jump_index, false);
+        }
+        short_jump_allowed = !long_jumps[jump_index];
     }
 
-    Instruction* inst = FindInstructionBySignature(args[0], types.size(), types.data());
+    const Instruction* inst = SelectInstruction(args[0], parsed, short_jump_allowed);
     if (inst == nullptr) {
-        loc->PrintCompileMessage("error: undefined instruction");
-        printf("\t%.*s  arg_types[", static_cast<int>(args[0].size()), args[0].data());
-        for (auto type : types) {
-            printf("%s, ", GetInstructionArgumentName(type));
+        std::string arg_types;
+        for (auto& arg : parsed) {
+            arg_types = arg_types + GetInstructionArgumentName(arg.type) + ", ";
         }
-        printf("]\n");
+        loc->PrintCompileMessage("error: undefined instruction\n\t%.*s  arg_types[%s]",
+                                 static_cast<int>(args[0].size()), args[0].data(), arg_types.c_str());
         return false;
     }
 
-    WriteToBuffer(inst->inst, inst_offset);
+    size_t next_offset = bytecode.size() + inst->inst_full_size;
+    WriteToBuffer(inst->inst);
+    for (int i = 0; i < inst->args_count; ++i) {
+        if (inst->args[i] == LABEL_REL_8) {
+            if (link && !FitsIn<friday_short_offset_t>(parsed[i].value - static_cast<int32_t>(next_offset))) {
+                loc->PrintCompileMessage("internal error: label '%.*s' is too far for a short jump",
+                                         static_cast<int>(parsed[i].label.size()), parsed[i].label.data());
+                return false;
+            }
+            short_jumps.push_back({jump_index, static_cast<friday_address_t>(next_offset), parsed[i].label});
+        }
+        EncodeArgument(inst->args[i], parsed[i], next_offset);
+    }
     return true;
 }
 
-FridayArch::InstructionArgument FridayAsmWriter::ParseAndCompileArgument(const std::string_view &arg, bool link) {
+bool FridayAsmWriter::CanEncodeArgument(const Instruction &inst, InstructionArgument encoding,
+                                        const ParsedArgument &arg, bool short_jump_allowed) const {
+    switch (encoding) {
+        case CONSTANT:
+        case REGISTER:
+        case LABEL:
+            return arg.type == encoding;
+        case CONSTANT_8:
+            return arg.type == CONSTANT && FitsIn<int8_t>(arg.value);
+        case CONSTANT_16:
+            return arg.type == CONSTANT && FitsIn<int16_t>(arg.value);
+        case PACKED_REGISTER:
+            return arg.type == REGISTER && arg.value == GetPackedRegister(inst.inst);
+        case LABEL_REL_8:
+            // Before linking the address is unknown, the length was decided by the previous passes
+            return arg.type == LABEL && short_jump_allowed;
+        case _BAD_ARG:
+            return false;
+    }
+    return false;
+}
+
+const Instruction *FridayAsmWriter::SelectInstruction(const std::string_view &name,
+                                                      const std::vector<ParsedArgument> &args,
+                                                      bool short_jump_allowed) const {
+    const Instruction* best = nullptr;
+    for (auto& inst : GetInstructionSet()) {
+        if (name != inst.name || inst.args_count != static_cast<int>(args.size())) {
+            continue;
+        }
+
+        bool fits = true;
+        for (int i = 0; i < inst.args_count && fits; ++i) {
+            fits = CanEncodeArgument(inst, inst.args[i], args[i], short_jump_allowed);
+        }
+        if (fits && (best == nullptr || inst.inst_full_size < best->inst_full_size)) {
+            best = &inst;
+        }
+    }
+    return best;
+}
+
+void FridayAsmWriter::EncodeArgument(InstructionArgument encoding, const ParsedArgument &arg,
+                                     friday_address_t next_offset) {
+    switch (encoding) {
+        case CONSTANT:
+            WriteToBuffer(static_cast<friday_constant_t>(arg.value));
+            break;
+        case REGISTER:
+            WriteToBuffer(static_cast<friday_reg_t>(arg.value));
+            break;
+        case LABEL:
+            WriteToBuffer(static_cast<friday_address_t>(arg.value));
+            break;
+        case CONSTANT_8:
+            WriteToBuffer(static_cast<int8_t>(arg.value));
+            break;
+        case CONSTANT_16:
+            WriteToBuffer(static_cast<int16_t>(arg.value));
+            break;
+        case PACKED_REGISTER:
+            break;
+        case LABEL_REL_8:
+            WriteToBuffer(static_cast<friday_short_offset_t>(arg.value - next_offset));
+            break;
+        case _BAD_ARG:
+            assert(false);
+    }
+}
+
+FridayArch::InstructionArgument FridayAsmWriter::ParseArgument(const std::string_view &arg, bool link,
+                                                               ParsedArgument &result) {
     char* bad_ptr = nullptr;
     std::string arg_(arg);
 
@@ -61,16 +157,16 @@ FridayArch::InstructionArgument FridayAsmWriter::ParseAndCompileArgument(const s
     int value_int = strtol(arg_.c_str(), &bad_ptr, 0);
     if (*bad_ptr == '\0') {
         // It is int
-        WriteToBuffer(*reinterpret_cast<friday_constant_t*>(&value_int));
-        return CONSTANT;
+        result.value = value_int;
+        return result.type = CONSTANT;
     }
 
     // Is float?
     float value_float = strtof(arg_.c_str(), &bad_ptr);
     if (*bad_ptr == '\0') {
         // It is float
-        WriteToBuffer(*reinterpret_cast<friday_constant_t*>(&value_float));
-        return CONSTANT;
+        result.value = BytesHelper::BytesAs<int32_t>(BytesHelper::AsBytes(value_float));
+        return result.type = CONSTANT;
     }
 
     // Is register?
@@ -84,8 +180,8 @@ FridayArch::InstructionArgument FridayAsmWriter::ParseAndCompileArgument(const s
                                     arg_.c_str(), cur_max_regs);
                 return _BAD_ARG;
             }
-            WriteToBuffer(static_cast<friday_reg_t>(reg_index));
-            return REGISTER;
+            result.value = reg_index;
+            return result.type = REGISTER;
         }
     }
 
@@ -103,8 +199,9 @@ FridayArch::InstructionArgument FridayAsmWriter::ParseAndCompileArgument(const s
             return _BAD_ARG;
         }
     }
-    WriteToBuffer(static_cast<friday_address_t>(addr));
-    return LABEL;
+    result.value = addr;
+    result.label = arg;
+    return result.type = LABEL;
 }
 
 void FridayAsmWriter::WriteToFile(const char *filename) const {
@@ -115,6 +212,10 @@ void FridayAsmWriter::WriteToFile(const char *filename) const {
     }
 }
 
+const std::vector<char>& FridayAsmWriter::GetBytecode() const {
+    return bytecode;
+}
+
 FridayArch::friday_address_t FridayAsmWriter::GetCurrentCodeOffset() const {
     auto res = bytecode.size();
     if (MAX_ADDRESS_VALUE < res) {
@@ -123,8 +224,18 @@ FridayArch::friday_address_t FridayAsmWriter::GetCurrentCodeOffset() const {
     return res;
 }
 
-void FridayAsmWriter::RegisterLabelAtCurrentOffset(const std::string_view &label) {
-    labels.Insert(std::string(label), GetCurrentCodeOffset());
+bool FridayAsmWriter::RegisterLabelAtCurrentOffset(const std::string_view &label) {
+    std::string key(label);
+    if (first_pass) {
+        if (!labels.Insert(key, GetCurrentCodeOffset())) {
+            loc->PrintCompileMessage("error: label '%s' is already defined", key.c_str());
+            return false;
+        }
+        label_names.push_back(key);
+    } else {
+        *labels.Find(key) = GetCurrentCodeOffset();
+    }
+    return true;
 }
 
 FridayArch::friday_address_t FridayAsmWriter::GetLabelAddress(const std::string_view &label) {
@@ -135,6 +246,14 @@ FridayArch::friday_address_t FridayAsmWriter::GetLabelAddress(const std::string_
     return *res;
 }
 
+SymbolMap FridayAsmWriter::GetSymbolMap() {
+    SymbolMap result;
+    for (auto& name : label_names) {
+        result.Add(*labels.Find(name), name);
+    }
+    return result;
+}
+
 void FridayAsmWriter::RemoveCodeFrom(FridayArch::friday_address_t from_address) {
     bytecode.erase(bytecode.begin() + from_address, bytecode.end());
 }
@@ -151,3 +270,60 @@ void FridayAsmWriter::SetCustomRegistersCount(friday_reg_t count) {
 bool FridayAsmWriter::IsCustomRegisterValue() const {
     return custom_register_count;
 }
+
+void FridayAsmWriter::BeginFile() {
+    long_jumps.clear();
+    first_pass = true;
+}
+
+void FridayAsmWriter::BeginPass(FridayArch::friday_address_t from_address) {
+    RemoveCodeFrom(from_address);
+    short_jumps.clear();
+    next_jump_index = 0;
+}
+
+bool FridayAsmWriter::WidenFarShortJumps() {
+    first_pass = false;
+
+    bool changed = false;
+    for (auto& jump : short_jumps) {
+        friday_address_t target = GetLabelAddress(jump.label);
+        if (target == static_cast<friday_address_t>(-1) ||
+            !FitsIn<friday_short_offset_t>(static_cast<int32_t>(target) - jump.next_offset)) {
+            // Label is too far or not defined in this file (maybe it's an error, linking will report it)
+            long_jumps[jump.index] = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+size_t FridayAsmWriter::GetLabelCount() const {
+    return label_names.size();
+}
+
+void FridayAsmWriter::ExtractObject(friday_address_t start, size_t first_label, AsmObject &object) {
+    object.start = start;
+    object.code.assign(bytecode.begin() + start, bytecode.end());
+    object.labels.clear();
+    for (size_t i = first_label; i < label_names.size(); ++i) {
+        object.labels.emplace_back(label_names[i], *labels.Find(label_names[i]));
+    }
+    object.register_count = custom_register_count ? GetCurrentRegisterCount() : -1;
+}
+
+bool FridayAsmWriter::AppendObject(const AsmObject &object) {
+    assert(object.start == bytecode.size());
+    bytecode.insert(bytecode.end(), object.code.begin(), object.code.end());
+    for (auto& [name, address] : object.labels) {
+        if (!labels.Insert(name, address)) {
+            return false;
+        }
+        label_names.push_back(name);
+    }
+    if (object.register_count >= 0) {
+        // The count already includes .registers of the files before, which are the same as when it was compiled
+        SetCustomRegistersCount(static_cast<friday_reg_t>(object.register_count));
+    }
+    return true;
+}
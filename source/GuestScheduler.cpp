@@ -0,0 +1,345 @@
+#include "GuestScheduler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include "EmulatorObserver.hpp"
+#include "Profile.hpp"
+#include "Verifier.hpp"
+#include "utility/BytesHelper.hpp"
+
+using namespace FridayArch;
+
+struct GuestScheduler::GuestThread {
+    std::unique_ptr<Emulator> own_emulator;  // nullptr у главного потока, его Emulator принадлежит вызывающему
+    Emulator* emu = nullptr;
+    int stack_slot = -1;
+    int32_t stack_top = 0;
+    bool finished = false;
+    int32_t result = 0;
+    int32_t join_target = -1;       // Чей join исполняет поток, заблокированный с SIGNAL_BLOCKED
+    GuestThread* waiter = nullptr;  // Поток, ждущий окончания этого
+    std::string output;             // Накопленный вывод при ordered_output
+};
+
+struct GuestScheduler::Worker {
+    std::mutex lock;
+    std::deque<GuestThread*> tasks;
+    std::unique_ptr<Profile> profile;
+};
+
+static thread_local int current_worker = 0;
+
+GuestScheduler::GuestScheduler(Emulator &main_thread, int host_threads, bool ordered_output) :
+    main_thread(main_thread),
+    ordered_output(ordered_output),
+    thread_stack_size(main_thread.verification != nullptr && main_thread.verification->ok &&
+                      main_thread.verification->stack_bound >= 0 ? main_thread.verification->stack_bound
+                                                                 : THREAD_STACK_SIZE)
+{
+    auto main = std::make_unique<GuestThread>();
+    main->emu = &main_thread;
+    main_thread.scheduler = this;
+    main_thread.thread_id = 0;
+    threads.push_back(std::move(main));
+
+    // Threads take the budget from the tank in portions, the main one too
+    if (main_thread.fuel_metering) {
+        fuel_tank = main_thread.fuel;
+        main_thread.fuel = 0;
+        main_thread.fuel_tank = &fuel_tank;
+    }
+
+    for (int slot = MAX_THREADS - 1; slot >= 0; --slot) {
+        free_stacks.push_back(slot);
+    }
+    for (int i = 0; i < std::max(host_threads, 1); ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+GuestScheduler::~GuestScheduler() {
+    Stop();
+    for (auto& thread : host_threads) {
+        thread.join();
+    }
+    main_thread.scheduler = nullptr;
+    if (main_thread.fuel_tank == &fuel_tank) {
+        main_thread.fuel += fuel_tank;
+        main_thread.fuel_tank = nullptr;
+    }
+}
+
+void GuestScheduler::Run(bool debug_mode, Profile *profile) {
+    this->debug_mode = debug_mode;
+    this->profile = profile;
+    if (profile != nullptr) {
+        for (auto& worker : workers) {
+            worker->profile = std::make_unique<Profile>(profile->executions.size());
+        }
+    }
+
+    if (debug_mode) {
+        main_thread.PrintDebugInfo();
+    }
+    Enqueue(threads[0].get());
+    WorkerLoop(0);
+
+    std::vector<std::thread> started;
+    {
+        std::lock_guard<std::mutex> guard(threads_lock);
+        started.swap(host_threads);
+    }
+    for (auto& thread : started) {
+        thread.join();
+    }
+
+    if (profile != nullptr) {
+        for (auto& worker : workers) {
+            profile->Merge(*worker->profile);
+        }
+    }
+    if (ordered_output) {
+        for (size_t id = 1; id < threads.size(); ++id) {
+            if (threads[id] != nullptr) {
+                main_thread.WriteOutput(threads[id]->output.data(), threads[id]->output.size());
+            }
+        }
+    }
+}
+
+int32_t GuestScheduler::Spawn(int32_t address, int32_t arg) {
+    GuestThread* spawned;
+    {
+        std::lock_guard<std::mutex> guard(threads_lock);
+        if (free_stacks.empty()) {
+            return -1;
+        }
+        StartWorkers();
+
+        auto thread = std::make_unique<GuestThread>();
+        thread->own_emulator = std::make_unique<Emulator>(main_thread.mem, main_thread.memory_size);
+        thread->emu = thread->own_emulator.get();
+        thread->stack_slot = free_stacks.back();
+        free_stacks.pop_back();
+        thread->stack_top = main_thread.stack_limit - thread->stack_slot * thread_stack_size;
+
+        Emulator& emu = *thread->emu;
+        emu.regs.assign(main_thread.regs.size(), 0);
+        emu.ip = address;
+        emu.sp = emu.stack_base = thread->stack_top;
+        emu.stack_limit = thread->stack_top - thread_stack_size;
+        emu.push(BytesHelper::AsBytes(arg), sizeof(int32_t));
+        emu.program_size = main_thread.program_size;
+        emu.verification = main_thread.verification;
+        emu.force_runtime_checks = main_thread.force_runtime_checks;
+        emu.signal = Emulator::NO_SIGNAL;
+        emu.scheduler = this;
+        emu.thread_id = static_cast<int>(threads.size());
+        emu.output_buffer = ordered_output ? &thread->output : nullptr;
+        emu.output_stream = main_thread.output_stream;
+        emu.input = main_thread.input;
+        emu.fuel_metering = main_thread.fuel_metering;
+        emu.fuel_tank = main_thread.fuel_tank;
+        emu.run_lengths = main_thread.run_lengths;
+        emu.ChargeFuel();  // The thread starts a new run
+
+        spawned = thread.get();
+        threads.push_back(std::move(thread));
+    }
+    Enqueue(spawned);
+    return spawned->emu->thread_id;
+}
+
+bool GuestScheduler::Join(Emulator &emu, int32_t id, int32_t &result) {
+    std::lock_guard<std::mutex> guard(threads_lock);
+    if (id <= 0 || id == emu.thread_id || static_cast<size_t>(id) >= threads.size() || threads[id] == nullptr) {
+        emu.signal = Emulator::SIGNAL_SIGILL;
+        return false;
+    }
+
+    GuestThread& target = *threads[id];
+    if (!target.finished) {
+        threads[emu.thread_id]->join_target = id;
+        emu.signal = Emulator::SIGNAL_BLOCKED;
+        return false;
+    }
+
+    result = target.result;
+    if (ordered_output) {
+        emu.WriteOutput(target.output.data(), target.output.size());
+    }
+    threads[id].reset();
+    return true;
+}
+
+// Вызывается под threads_lock
+void GuestScheduler::StartWorkers() {
+    if (!host_threads.empty() || workers.size() == 1 || stopping) {
+        return;
+    }
+    started_workers = static_cast<int>(workers.size());
+    for (size_t i = 1; i < workers.size(); ++i) {
+        host_threads.emplace_back(&GuestScheduler::WorkerLoop, this, static_cast<int>(i));
+    }
+}
+
+void GuestScheduler::Enqueue(GuestThread *thread, bool to_front) {
+    Worker& worker = *workers[current_worker];
+    {
+        std::lock_guard<std::mutex> guard(worker.lock);
+        if (to_front) {
+            worker.tasks.push_front(thread);
+        } else {
+            worker.tasks.push_back(thread);
+        }
+    }
+    ++queued;
+    // Захват idle_lock упорядочивает увеличение queued с проверкой условия в WorkerLoop: пробуждение не теряется
+    { std::lock_guard<std::mutex> guard(idle_lock); }
+    idle_cv.notify_one();
+}
+
+GuestScheduler::GuestThread *GuestScheduler::TakeTask(int worker_index) {
+    {
+        Worker& own = *workers[worker_index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            GuestThread* thread = own.tasks.back();
+            own.tasks.pop_back();
+            --queued;
+            return thread;
+        }
+    }
+
+    int count = started_workers;
+    for (int i = 1; i < count; ++i) {
+        Worker& victim = *workers[(worker_index + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            GuestThread* thread = victim.tasks.front();
+            victim.tasks.pop_front();
+            --queued;
+            return thread;
+        }
+    }
+    return nullptr;
+}
+
+void GuestScheduler::WorkerLoop(int worker_index) {
+    current_worker = worker_index;
+    Profile* worker_profile = workers[worker_index]->profile.get();
+    if (worker_profile == nullptr && !debug_mode) {
+        NullObserver observer;
+        ScheduleLoop(worker_index, observer);
+    } else if (worker_profile == nullptr) {
+        DebugObserver observer;
+        ScheduleLoop(worker_index, observer);
+    } else if (!debug_mode) {
+        ProfileObserver observer(*worker_profile);
+        ScheduleLoop(worker_index, observer);
+    } else {
+        DebugObserver debug_observer;
+        ProfileObserver profile_observer(*worker_profile);
+        ObserverPair<DebugObserver, ProfileObserver> observer(debug_observer, profile_observer);
+        ScheduleLoop(worker_index, observer);
+    }
+}
+
+template <typename Observer>
+void GuestScheduler::ScheduleLoop(int worker_index, Observer& observer) {
+    while (!stopping) {
+        GuestThread* thread = TakeTask(worker_index);
+        if (thread != nullptr) {
+            Execute(thread, observer);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(idle_lock);
+        if (stopping || queued > 0) {
+            continue;
+        }
+        if (++idle_workers == started_workers) {
+            // Никто не исполняется и никто не ждет очереди: все гостевые потоки ждут друг друга в join
+            if (main_thread.output_stream != nullptr) {
+                fprintf(main_thread.output_stream, "Emulator error: all guest threads are blocked in join\n");
+            }
+            stopping = true;
+            idle_cv.notify_all();
+        }
+        idle_cv.wait(guard, [this] { return stopping || queued > 0; });
+        --idle_workers;
+    }
+}
+
+template <typename Observer>
+void GuestScheduler::Execute(GuestThread *thread, Observer& observer) {
+    Emulator& emu = *thread->emu;
+    while (true) {
+        bool stopped = emu.RunSlice(SLICE_STEPS, observer);
+        if (stopping) {
+            return;
+        }
+        if (!stopped) {
+            if (queued > 0) {
+                Enqueue(thread, true);
+                return;
+            }
+            continue;
+        }
+
+        if (emu.signal == Emulator::SIGNAL_BLOCKED) {
+            std::lock_guard<std::mutex> guard(threads_lock);
+            auto& target = threads[thread->join_target];
+            if (target != nullptr && target->finished) {
+                // Поток закончился, пока этот выходил из RunSlice: join можно повторить сразу
+                emu.signal = Emulator::NO_SIGNAL;
+                continue;
+            }
+            if (target != nullptr && target->waiter == nullptr) {
+                target->waiter = thread;
+                return;
+            }
+            // Другой поток уже ждет этот
+            emu.signal = Emulator::SIGNAL_SIGILL;
+            emu.RunSlice(0, observer);  // Сообщает о сигнале и печатает его
+            Stop();
+            return;
+        }
+
+        if (emu.signal == Emulator::SIGNAL_EXIT && thread->emu != &main_thread) {
+            FinishThread(thread);
+        } else {
+            // Конец главного потока или фатальный сигнал в любом, сообщение уже напечатано
+            Stop();
+        }
+        return;
+    }
+}
+
+void GuestScheduler::FinishThread(GuestThread *thread) {
+    Emulator& emu = *thread->emu;
+    GuestThread* waiter;
+    {
+        std::lock_guard<std::mutex> guard(threads_lock);
+        thread->result = emu.sp < thread->stack_top ? BytesHelper::BytesAs<int32_t>(emu.mem + emu.sp) : 0;
+        thread->finished = true;
+        if (emu.fuel_tank != nullptr) {
+            *emu.fuel_tank += emu.fuel;  // The rest of the portion is left for other threads
+            emu.fuel = 0;
+        }
+        free_stacks.push_back(thread->stack_slot);
+        waiter = thread->waiter;
+        thread->waiter = nullptr;
+    }
+    if (waiter != nullptr) {
+        waiter->emu->signal = Emulator::NO_SIGNAL;
+        Enqueue(waiter);
+    }
+}
+
+void GuestScheduler::Stop() {
+    std::lock_guard<std::mutex> guard(idle_lock);
+    stopping = true;
+    idle_cv.notify_all();
+}
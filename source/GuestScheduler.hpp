@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Emulator.hpp"
+
+namespace FridayArch {
+
+class Profile;
+
+// Гостевые потоки программы Friday (инструкции spawn, join, xadd). Каждый поток -- отдельный Emulator со своими
+// регистрами, ip и стеком, вырезанным из общей памяти mem главного потока.
+// Потоки исполняются пулом потоков хоста. У каждого потока хоста своя очередь: новые и свои потоки он берет с
+// конца очереди, а когда она пуста, ворует из начала чужих. Поток хоста исполняет гостевой поток порциями по
+// SLICE_STEPS инструкций и между порциями уступает место другим, если они ждут
+class GuestScheduler {
+public:
+    // Стеки: главный поток -- верхние байты mem (см. Emulator::stack_limit), под ним стеки остальных потоков по
+    // THREAD_STACK_SIZE байт или по stack_bound, если проверка программы его вычислила. Выход за стек -- SIGSEGV
+    const static int THREAD_STACK_SIZE = 256 * 1024;
+    const static int MAX_THREADS = 256;  // Сколько потоков, кроме главного, может работать одновременно
+    const static int SLICE_STEPS = 16 * 1024;
+
+    // host_threads -- сколько потоков хоста использовать (дополнительные запускаются при первом spawn).
+    // ordered_output -- вывод каждого гостевого потока копится и печатается, когда его поток присоединяют
+    // через join (а у неприсоединенных -- в конце, по возрастанию номера). Тогда порядок вывода не зависит от
+    // планирования, иначе out печатает сразу
+    GuestScheduler(Emulator& main_thread, int host_threads, bool ordered_output);
+    ~GuestScheduler();
+
+    GuestScheduler(const GuestScheduler&) = delete;
+    GuestScheduler& operator=(const GuestScheduler&) = delete;
+
+    // Исполняет программу, пока не закончится главный поток или какой-либо поток не получит фатальный сигнал.
+    // Если profile не nullptr, в него записываются инструкции всех потоков
+    void Run(bool debug_mode, Profile* profile);
+
+    // Запускает поток с адреса address, положив arg ему на стек. Возвращает номер потока или -1, если
+    // одновременно работает уже MAX_THREADS потоков
+    int32_t Spawn(int32_t address, int32_t arg);
+    // Если поток id закончился, записывает в result значение с вершины его стека и возвращает true.
+    // Иначе возвращает false и выставляет у emu SIGNAL_BLOCKED (поток будет продолжен после окончания id)
+    // или SIGNAL_SIGILL, если id не является номером работающего или неприсоединенного потока
+    bool Join(Emulator& emu, int32_t id, int32_t& result);
+    // Останавливает программу. Можно вызывать из любого потока: потоки хоста бросают гостевые потоки после текущей
+    // порции, и Run возвращается
+    void Stop();
+
+private:
+    struct GuestThread;
+    struct Worker;
+
+    Emulator& main_thread;
+    const bool ordered_output;
+    const int32_t thread_stack_size;
+    // Бюджет инструкций, общий для всех потоков, если он включен у главного (см. Emulator::AddFuel)
+    std::atomic<int64_t> fuel_tank{0};
+    bool debug_mode = false;
+    Profile* profile = nullptr;
+
+    // Таблица потоков, индекс -- номер потока. Защищена threads_lock
+    std::mutex threads_lock;
+    std::vector<std::unique_ptr<GuestThread>> threads;
+    std::vector<int> free_stacks;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> host_threads;  // Потоки хоста для workers[1..], workers[0] -- поток, вызвавший Run
+    std::atomic<int> started_workers{1};
+    std::atomic<int> queued{0};  // Сколько гостевых потоков ждет в очередях
+    std::atomic<bool> stopping{false};
+    std::mutex idle_lock;
+    std::condition_variable idle_cv;
+    int idle_workers = 0;
+
+    void StartWorkers();
+    // Выбирает наблюдателя по debug_mode и profile и исполняет ScheduleLoop с ним
+    void WorkerLoop(int worker_index);
+    template <typename Observer>
+    void ScheduleLoop(int worker_index, Observer& observer);
+    void Enqueue(GuestThread* thread, bool to_front = false);
+    GuestThread* TakeTask(int worker_index);
+    // Исполняет поток до блокировки, окончания или пока другие потоки ждут очереди
+    template <typename Observer>
+    void Execute(GuestThread* thread, Observer& observer);
+    void FinishThread(GuestThread* thread);
+};
+
+}
@@ -0,0 +1,270 @@
+#include "InputSource.hpp"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace FridayArch;
+
+PrefetchedInput::PrefetchedInput(int fd) :
+    fd(fd),
+    queue(QUEUE_CAPACITY)
+{
+    if (pipe(stop_pipe) != 0) {
+        throw std::system_error(errno, std::generic_category(), "pipe");
+    }
+}
+
+PrefetchedInput::~PrefetchedInput() {
+    queue.Close();
+    if (reader.joinable()) {
+        char stop = 0;
+        while (write(stop_pipe[1], &stop, 1) < 0 && errno == EINTR) {}
+        reader.join();
+    }
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+}
+
+bool PrefetchedInput::Read(int32_t &value) {
+    Token token{};
+    bool result = Next(token);
+    value = token.as_int;
+    return result;
+}
+
+bool PrefetchedInput::Read(float &value) {
+    Token token{};
+    bool result = Next(token);
+    value = token.as_float;
+    return result;
+}
+
+void PrefetchedInput::Close() {
+    queue.Close();
+}
+
+bool PrefetchedInput::Next(Token &token) {
+    std::lock_guard<std::mutex> guard(consumer_lock);
+    if (!reader.joinable()) {
+        reader = std::thread(&PrefetchedInput::ReaderLoop, this);
+    }
+    return queue.Pop(token);
+}
+
+template <typename Tokens>
+static void ParseToken(const char *begin, const char *end, Tokens &tokens) {
+    InputToken token{0, 0.0f};
+    // Как и scanf, число может начинаться с '+', а разбирается самый длинный подходящий префикс слова
+    const char* number = (*begin == '+' && end - begin > 1) ? begin + 1 : begin;
+    std::from_chars(number, end, token.as_int);
+    std::from_chars(number, end, token.as_float);
+    tokens.push_back(token);
+}
+
+static inline bool IsSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+void PrefetchedInput::ReaderLoop() {
+    std::vector<char> chunk(CHUNK_SIZE);
+    std::vector<Token> tokens;
+    std::string partial;  // Начало слова, которое продолжится в следующем куске
+
+    while (true) {
+        pollfd fds[2] = {{fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+
+        ssize_t size = read(fd, chunk.data(), chunk.size());
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size <= 0) {
+            break;
+        }
+
+        const char* p = chunk.data();
+        const char* end = p + size;
+        while (p < end) {
+            if (IsSpace(*p)) {
+                if (!partial.empty()) {
+                    ParseToken(partial.data(), partial.data() + partial.size(), tokens);
+                    partial.clear();
+                }
+                ++p;
+                continue;
+            }
+
+            const char* word = p;
+            while (p < end && !IsSpace(*p)) {
+                ++p;
+            }
+            if (p == end) {
+                partial.append(word, p);
+            } else if (!partial.empty()) {
+                partial.append(word, p);
+                ParseToken(partial.data(), partial.data() + partial.size(), tokens);
+                partial.clear();
+            } else {
+                ParseToken(word, p, tokens);
+            }
+        }
+
+        if (!queue.Push(tokens.data(), tokens.size())) {
+            return;
+        }
+        tokens.clear();
+    }
+
+    if (!partial.empty()) {
+        ParseToken(partial.data(), partial.data() + partial.size(), tokens);
+    }
+    queue.Push(tokens.data(), tokens.size());
+    queue.Close();
+}
+
+bool QueuedInput::Read(int32_t &value) {
+    return TryRead(value) == READ_OK;
+}
+
+bool QueuedInput::Read(float &value) {
+    return TryRead(value) == READ_OK;
+}
+
+InputSource::ReadStatus QueuedInput::TryRead(int32_t &value) {
+    InputToken token{};
+    ReadStatus status;
+    Next(token, status);
+    value = token.as_int;
+    return status;
+}
+
+InputSource::ReadStatus QueuedInput::TryRead(float &value) {
+    InputToken token{};
+    ReadStatus status;
+    Next(token, status);
+    value = token.as_float;
+    return status;
+}
+
+bool QueuedInput::Next(InputToken &token, ReadStatus &status) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (tokens.empty()) {
+        status = closed ? READ_END : READ_PENDING;
+        return false;
+    }
+    token = tokens.front();
+    tokens.pop_front();
+    status = READ_OK;
+    return true;
+}
+
+void QueuedInput::Push(std::string_view text) {
+    std::lock_guard<std::mutex> guard(lock);
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        if (IsSpace(*p)) {
+            ++p;
+            continue;
+        }
+        const char* word = p;
+        while (p < end && !IsSpace(*p)) {
+            ++p;
+        }
+        ParseToken(word, p, tokens);
+    }
+}
+
+void QueuedInput::Close() {
+    std::lock_guard<std::mutex> guard(lock);
+    closed = true;
+}
+
+bool QueuedInput::Ready() {
+    std::lock_guard<std::mutex> guard(lock);
+    return !tokens.empty() || closed;
+}
+
+RecordingInput::RecordingInput(InputSource &source, const char *log_filename) :
+    source(source),
+    log(fopen(log_filename, "wb"))
+{
+    if (log == nullptr) {
+        throw std::system_error(errno, std::generic_category(), "fopen");
+    }
+    fwrite(INPUT_LOG_MAGIC, 1, sizeof(INPUT_LOG_MAGIC), log);
+}
+
+RecordingInput::~RecordingInput() {
+    if (log != nullptr) {
+        fclose(log);
+    }
+}
+
+bool RecordingInput::Read(int32_t &value) {
+    return ReadAndRecord(value);
+}
+
+bool RecordingInput::Read(float &value) {
+    return ReadAndRecord(value);
+}
+
+template <typename T>
+bool RecordingInput::ReadAndRecord(T &value) {
+    static_assert(sizeof(T) == 4, "input log stores 4 bytes per value");
+    std::lock_guard<std::mutex> guard(lock);
+    if (!source.Read(value)) {
+        return false;  // Конец ввода не записывается: при воспроизведении журнал тоже закончится
+    }
+    fwrite(&value, sizeof(T), 1, log);
+    return true;
+}
+
+void RecordingInput::Finish() {
+    std::lock_guard<std::mutex> guard(lock);
+    int result = fclose(log);
+    log = nullptr;
+    if (result != 0) {
+        throw std::system_error(errno, std::generic_category(), "fclose");
+    }
+}
+
+ReplayInput::ReplayInput(const char *log_filename) :
+    log(log_filename)
+{
+    if (log.size() < sizeof(INPUT_LOG_MAGIC) ||
+            memcmp(log.data(), INPUT_LOG_MAGIC, sizeof(INPUT_LOG_MAGIC)) != 0) {
+        throw std::runtime_error("not a friday input log");
+    }
+    values_count = (log.size() - sizeof(INPUT_LOG_MAGIC)) / 4;
+}
+
+bool ReplayInput::Read(int32_t &value) {
+    return ReadNext(value);
+}
+
+bool ReplayInput::Read(float &value) {
+    return ReadNext(value);
+}
+
+template <typename T>
+bool ReplayInput::ReadNext(T &value) {
+    size_t index = next.fetch_add(1, std::memory_order_relaxed);
+    if (index >= values_count) {
+        return false;
+    }
+    memcpy(&value, log.data() + sizeof(INPUT_LOG_MAGIC) + index * 4, sizeof(T));
+    return true;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "utility/SpscQueue.hpp"
+#include "utility/FileHelper.hpp"
+
+namespace FridayArch {
+
+// Источник значений для инструкций in и in_f. Read возвращает false, если ввод закончился.
+// Реализации должны допускать вызовы из нескольких гостевых потоков одновременно
+class InputSource {
+public:
+    enum ReadStatus {
+        READ_OK,
+        READ_END,     // Ввод закончился, value -- 0
+        READ_PENDING  // Значения еще нет, но ввод не закончился: in ждет его, не занимая поток хоста
+    };
+
+    virtual ~InputSource() = default;
+
+    virtual bool Read(int32_t& value) = 0;
+    virtual bool Read(float& value) = 0;
+    // То же, что Read, но не ждет ввода. Источники, которые ждут ввод сами, возвращают только READ_OK и READ_END
+    virtual ReadStatus TryRead(int32_t& value) { return Read(value) ? READ_OK : READ_END; }
+    virtual ReadStatus TryRead(float& value) { return Read(value) ? READ_OK : READ_END; }
+};
+
+// Слово ввода, разобранное и как целое, и как дробное число
+struct InputToken {
+    int32_t as_int;
+    float as_float;
+};
+
+// Читает ввод из файлового дескриптора в отдельном потоке большими кусками и заранее разбирает каждое слово и
+// как целое, и как дробное число, так что in и in_f лишь забирают готовое значение из очереди.
+// Поток чтения запускается при первом Read, поэтому программы без ввода не читают stdin.
+// Слово, не являющееся числом, читается как 0
+class PrefetchedInput : public InputSource {
+public:
+    const static size_t CHUNK_SIZE = 1024 * 1024;
+    const static size_t QUEUE_CAPACITY = 64 * 1024;
+
+    // fd не закрывается
+    explicit PrefetchedInput(int fd);
+    ~PrefetchedInput() override;
+
+    PrefetchedInput(const PrefetchedInput&) = delete;
+    PrefetchedInput& operator=(const PrefetchedInput&) = delete;
+
+    bool Read(int32_t& value) override;
+    bool Read(float& value) override;
+    // Можно вызывать из любого потока: ввод заканчивается, и ждущий его Read возвращает false
+    void Close();
+
+private:
+    using Token = InputToken;
+
+    const int fd;
+    int stop_pipe[2] = {-1, -1};  // Запись в него прерывает ожидание ввода в потоке чтения
+    SpscQueue<Token> queue;
+    std::mutex consumer_lock;  // Потребитель у очереди один, а гостевых потоков может быть несколько
+    std::thread reader;
+
+    bool Next(Token& token);
+    void ReaderLoop();
+};
+
+// Ввод, который передают частями из другого потока (ContextScheduler::Feed). Слова разбираются так же, как у
+// PrefetchedInput. Пока значений нет, а ввод не закрыт, TryRead возвращает READ_PENDING, а Read -- false
+class QueuedInput : public InputSource {
+public:
+    bool Read(int32_t& value) override;
+    bool Read(float& value) override;
+    ReadStatus TryRead(int32_t& value) override;
+    ReadStatus TryRead(float& value) override;
+
+    // Добавляет слова text. Слово не продолжается в следующем вызове
+    void Push(std::string_view text);
+    // После Close, когда значения кончатся, чтение возвращает READ_END
+    void Close();
+    // Есть ли значение или конец ввода, то есть вернет ли TryRead что-то, кроме READ_PENDING
+    bool Ready();
+
+private:
+    std::mutex lock;
+    std::deque<InputToken> tokens;
+    bool closed = false;
+
+    bool Next(InputToken& token, ReadStatus& status);
+};
+
+// Журнал ввода: заголовок INPUT_LOG_MAGIC, затем по 4 байта на каждое прочитанное значение -- ровно те биты,
+// которые in или in_f положили на стек
+const char INPUT_LOG_MAGIC[8] = {'F', 'R', 'I', 'N', 'P', 'U', 'T', '1'};
+
+// Передает значения из source и записывает каждое прочитанное значение в журнал
+class RecordingInput : public InputSource {
+public:
+    // Бросает std::system_error, если журнал не удалось создать
+    RecordingInput(InputSource& source, const char* log_filename);
+    ~RecordingInput() override;
+
+    RecordingInput(const RecordingInput&) = delete;
+    RecordingInput& operator=(const RecordingInput&) = delete;
+
+    bool Read(int32_t& value) override;
+    bool Read(float& value) override;
+
+    // Дописывает журнал на диск. Бросает std::system_error в случае ошибки записи
+    void Finish();
+
+private:
+    InputSource& source;
+    FILE* log;
+    std::mutex lock;  // Порядок записей в журнале совпадает с порядком чтения
+
+    template <typename T>
+    bool ReadAndRecord(T& value);
+};
+
+// Возвращает значения из журнала, записанного RecordingInput, без разбора текста: журнал отображается в память,
+// а каждое чтение -- копирование 4 байт. Значения выдаются в том порядке, в каком были записаны, и
+// предназначены для той же программы: in_f получает биты, записанные in, как есть
+class ReplayInput : public InputSource {
+public:
+    // Бросает std::system_error, если журнал не удалось открыть, и std::runtime_error, если это не журнал ввода
+    explicit ReplayInput(const char* log_filename);
+
+    bool Read(int32_t& value) override;
+    bool Read(float& value) override;
+
+private:
+    FileHelper::MappedFile log;
+    size_t values_count;
+    std::atomic<size_t> next{0};
+
+    template <typename T>
+    bool ReadNext(T& value);
+};
+
+}
@@ -0,0 +1,210 @@
+#include "Intrinsics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "Emulator.hpp"
+#include "VectorKernels.hpp"
+#include "utility/BytesHelper.hpp"
+#ifndef NDEBUG
+    #include <cassert>
+#endif
+
+namespace FridayArch {
+
+// Индекс -- номер функции. Функция, а не глобальная переменная, чтобы регистрация из других единиц трансляции
+// не зависела от порядка инициализации
+static std::vector<Intrinsic>& GetRegistry() {
+    static std::vector<Intrinsic> registry;
+    return registry;
+}
+
+char RegisterIntrinsic(const char *name, int number, void (*callback)(Emulator*)) {
+    auto& registry = GetRegistry();
+#ifndef NDEBUG
+    assert(number >= 0 && number <= MAX_INTRINSIC_NUMBER);
+    assert(static_cast<size_t>(number) >= registry.size() || registry[number].callback == nullptr);
+#endif
+    if (static_cast<size_t>(number) >= registry.size()) {
+        registry.resize(number + 1, Intrinsic{nullptr, -1, nullptr});
+    }
+    registry[number] = Intrinsic{name, number, callback};
+    return '\0';
+}
+
+const Intrinsic *GetIntrinsic(int number) {
+    auto& registry = GetRegistry();
+    if (number < 0 || static_cast<size_t>(number) >= registry.size() || registry[number].callback == nullptr) {
+        return nullptr;
+    }
+    return &registry[number];
+}
+
+std::vector<Intrinsic> GetIntrinsics() {
+    std::vector<Intrinsic> result;
+    for (auto& intrinsic : GetRegistry()) {
+        if (intrinsic.callback != nullptr) {
+            result.push_back(intrinsic);
+        }
+    }
+    return result;
+}
+
+}
+
+
+//**  BUILTIN INTRINSICS  **//
+//#################################################################################################
+using namespace FridayArch;
+using namespace BytesHelper;
+
+// Array of count values of T at address. Checks the whole range once; misaligned or out of memory array raises
+// SIGSEGV and returns nullptr. Array of non-const T is going to be written, so it must not overlap verified code
+template <typename T>
+static T* GetArray(Emulator* emu, int32_t address, int32_t count) {
+    if (count < 0 || static_cast<int64_t>(count) * sizeof(T) > Emulator::MEMORY_SIZE ||
+            address % static_cast<int32_t>(alignof(T)) != 0) {
+        emu->signal = Emulator::SIGNAL_SIGSEGV;
+        return nullptr;
+    }
+    auto length = static_cast<uint32_t>(count) * sizeof(T);
+    if constexpr (std::is_const_v<T>) {
+        return reinterpret_cast<T*>(emu->get_memory_range(address, length));
+    } else {
+        return reinterpret_cast<T*>(emu->get_writable_range(address, length));
+    }
+}
+
+static inline void PushFloat(Emulator* emu, float value) {
+    emu->push(AsBytes(value), sizeof(float));
+}
+static inline void PushInt(Emulator* emu, int32_t value) {
+    emu->push(AsBytes(value), sizeof(int32_t));
+}
+
+// Applies operation to every lane of the vector on the top of the stack. One dispatch per VECTOR_LANES values
+template <typename T>
+static inline void MapVector(Emulator* emu, T operation) {
+    char* lanes = emu->get_stack_ptr();
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+        float value = ReadFromBytes<float>(lanes, i * sizeof(float));
+        WriteBytes(lanes, operation(value), i * sizeof(float));
+    }
+}
+
+// Not cryptographic: 8 bytes per step with 64-bit multiply-xorshift mixing, folded to 32 bits
+static uint32_t HashBytes(const char* data, uint32_t length) {
+    const uint64_t factor = 0xff51afd7ed558ccdULL;
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ length;
+    uint32_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t block;
+        memcpy(&block, data + i, sizeof(block));
+        block *= factor;
+        block ^= block >> 32;
+        hash = (hash ^ block) * 0xc4ceb9fe1a85ec53ULL;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, length - i);
+    hash = (hash ^ (tail * factor)) * 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    hash *= factor;
+    hash ^= hash >> 33;
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+// Scalar math: pop x (and y for pow) && push result
+FRIDAY_INTRINSIC(sinf, 0)   { PushFloat(emu, std::sin(emu->pop_float())); }
+FRIDAY_INTRINSIC(cosf, 1)   { PushFloat(emu, std::cos(emu->pop_float())); }
+FRIDAY_INTRINSIC(expf, 2)   { PushFloat(emu, std::exp(emu->pop_float())); }
+FRIDAY_INTRINSIC(logf, 3)   { PushFloat(emu, std::log(emu->pop_float())); }
+FRIDAY_INTRINSIC(powf, 4)   { float y = emu->pop_float(); PushFloat(emu, std::pow(emu->pop_float(), y)); }
+
+// Vector math: same on every lane of vector on the stack (see vector instructions)
+FRIDAY_INTRINSIC(vsinf, 8)  { MapVector(emu, [] (float x) { return std::sin(x); }); }
+FRIDAY_INTRINSIC(vcosf, 9)  { MapVector(emu, [] (float x) { return std::cos(x); }); }
+FRIDAY_INTRINSIC(vexpf, 10) { MapVector(emu, [] (float x) { return std::exp(x); }); }
+FRIDAY_INTRINSIC(vlogf, 11) { MapVector(emu, [] (float x) { return std::log(x); }); }
+// vpowf = pop vector b, vector a && push a ^ b
+FRIDAY_INTRINSIC(vpowf, 12) {
+    const char* b = emu->pop(VECTOR_SIZE);
+    char* a = emu->get_stack_ptr();
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+        float result = std::pow(ReadFromBytes<float>(a, i * sizeof(float)), ReadFromBytes<float>(b, i * sizeof(float)));
+        WriteBytes(a, result, i * sizeof(float));
+    }
+}
+
+// sort = pop count, pop address && sort count ints at address ascending
+FRIDAY_INTRINSIC(sort, 16) {
+    int32_t count = emu->pop_int();
+    int32_t* values = GetArray<int32_t>(emu, emu->pop_int(), count);
+    if (values != nullptr) {
+        std::sort(values, values + count);
+    }
+}
+// sortf = same for floats, NaNs go last
+FRIDAY_INTRINSIC(sortf, 17) {
+    int32_t count = emu->pop_int();
+    float* values = GetArray<float>(emu, emu->pop_int(), count);
+    if (values != nullptr) {
+        std::sort(values, values + count, [] (float a, float b) {
+            return a < b || (std::isnan(b) && !std::isnan(a));
+        });
+    }
+}
+
+// hash = pop count, pop address && push 32-bit hash of count bytes at address
+FRIDAY_INTRINSIC(hash, 20) {
+    int32_t count = emu->pop_int();
+    const char* bytes = GetArray<const char>(emu, emu->pop_int(), count);
+    if (bytes != nullptr) {
+        PushInt(emu, static_cast<int32_t>(HashBytes(bytes, count)));
+    }
+}
+
+// memchr = pop count, pop byte, pop address && push index of the first byte equal to byte or -1
+FRIDAY_INTRINSIC(memchr, 24) {
+    int32_t count = emu->pop_int();
+    auto byte = static_cast<unsigned char>(emu->pop_int());
+    const char* bytes = GetArray<const char>(emu, emu->pop_int(), count);
+    if (bytes != nullptr) {
+        auto found = static_cast<const char*>(std::memchr(bytes, byte, count));
+        PushInt(emu, found != nullptr ? static_cast<int32_t>(found - bytes) : -1);
+    }
+}
+// fill = pop count, pop value, pop address && write value to count ints at address
+FRIDAY_INTRINSIC(fill, 25) {
+    int32_t count = emu->pop_int();
+    int32_t value = emu->pop_int();
+    int32_t* values = GetArray<int32_t>(emu, emu->pop_int(), count);
+    if (values != nullptr) {
+        std::fill(values, values + count, value);
+    }
+}
+// sum = pop count, pop address && push sum of count ints at address (wrapping)
+FRIDAY_INTRINSIC(sum, 26) {
+    int32_t count = emu->pop_int();
+    const int32_t* values = GetArray<const int32_t>(emu, emu->pop_int(), count);
+    if (values != nullptr) {
+        uint32_t result = 0;
+        for (int32_t i = 0; i < count; ++i) {
+            result += static_cast<uint32_t>(values[i]);
+        }
+        PushInt(emu, static_cast<int32_t>(result));
+    }
+}
+// sumf = pop count, pop address && push sum of count floats at address, added in order
+FRIDAY_INTRINSIC(sumf, 27) {
+    int32_t count = emu->pop_int();
+    const float* values = GetArray<const float>(emu, emu->pop_int(), count);
+    if (values != nullptr) {
+        float result = 0.0f;
+        for (int32_t i = 0; i < count; ++i) {
+            result += values[i];
+        }
+        PushFloat(emu, result);
+    }
+}
+//#################################################################################################
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+namespace FridayArch {
+
+class Emulator;
+
+// Встроенная функция хоста, которую программа вызывает инструкцией syscall <number>.
+// Аргументы функция снимает со стека (последний аргумент лежит на вершине), результаты кладет на стек
+struct Intrinsic {
+    const char* name;
+    int number;
+    void (*callback)(Emulator*);
+};
+
+const int MAX_INTRINSIC_NUMBER = 1023;
+
+// Регистрирует функцию под номером number (от 0 до MAX_INTRINSIC_NUMBER). Удобнее использовать FRIDAY_INTRINSIC
+char RegisterIntrinsic(const char* name, int number, void (*callback)(Emulator*));
+// Возвращает функцию с данным номером или nullptr
+const Intrinsic* GetIntrinsic(int number);
+// Возвращает все зарегистрированные функции по возрастанию номера
+std::vector<Intrinsic> GetIntrinsics();
+
+}
+
+// Объявляет и регистрирует встроенную функцию так же, как FRIDAY_INST объявляет инструкцию:
+//     FRIDAY_INTRINSIC(my_func, 100) { emu->push(...); }
+// Функции, объявленные вне friday-shared, регистрируются, если их единица трансляции попала в программу
+#define FRIDAY_INTRINSIC_CLASS_NAME(name) __Intrinsic_##name
+#define FRIDAY_INTRINSIC(name, number)                                                                       \
+class FRIDAY_INTRINSIC_CLASS_NAME(name) {                                                                    \
+    FRIDAY_INTRINSIC_CLASS_NAME(name)() = default; /* Private constructor */                                 \
+public:                                                                                                      \
+    static void Execute(FridayArch::Emulator*);                                                              \
+    static char __register_intrinsic __attribute__ ((unused));                                               \
+};                                                                                                           \
+char FRIDAY_INTRINSIC_CLASS_NAME(name)::__register_intrinsic = FridayArch::RegisterIntrinsic(                \
+        #name, number, FRIDAY_INTRINSIC_CLASS_NAME(name)::Execute);                                          \
+void FRIDAY_INTRINSIC_CLASS_NAME(name)::Execute(FridayArch::Emulator* emu) /* now define callback */
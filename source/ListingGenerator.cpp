@@ -1,61 +1,201 @@
 #include "ListingGenerator.hpp"
 #include "friday_asm_lang.hpp"
 #include "utility/BytesHelper.hpp"
+#include "Profile.hpp"
+#include "SymbolMap.hpp"
 
 using namespace FridayArch;
 using namespace BytesHelper;
 
-ListingGenerator::ListingGenerator(FILE *outstream) :
-        outstream(outstream)
-{}
+static const size_t FLUSH_THRESHOLD = 1 << 20;
+static const char HEX_DIGITS[] = "0123456789abcdef";
 
-void PrintRawBytesAndAlign(FILE* outstream, const char* bytes, int length) {
+static const int COUNT_WIDTH = 12;
+static const int ANNOTATION_WIDTH = COUNT_WIDTH + 11;  // "<count> xxx.xx% * "
+
+ListingGenerator::ListingGenerator(FILE *outstream, int offset, const ListingAnnotations* annotations) :
+        outstream(outstream),
+        offset(offset),
+        annotations(annotations)
+{
+    buffer.reserve(FLUSH_THRESHOLD + 256);
+}
+
+ListingGenerator::~ListingGenerator() {
+    Flush();
+}
+
+void ListingGenerator::Append(std::string_view text) {
+    buffer.append(text);
+}
+
+void ListingGenerator::AppendChar(char c) {
+    buffer.push_back(c);
+}
+
+void ListingGenerator::AppendHex(unsigned int value, int min_digits) {
+    char text[8];
+    int pos = sizeof(text);
+    do {
+        text[--pos] = HEX_DIGITS[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    while (pos > static_cast<int>(sizeof(text)) - min_digits) {
+        text[--pos] = '0';
+    }
+    buffer.append(text + pos, sizeof(text) - pos);
+}
+
+void ListingGenerator::AppendInt(int value) {
+    char text[12];
+    int pos = sizeof(text);
+    // Work with unsigned to handle INT_MIN
+    unsigned int abs_value = value < 0 ? 0u - static_cast<unsigned int>(value) : value;
+    do {
+        text[--pos] = static_cast<char>('0' + abs_value % 10);
+        abs_value /= 10;
+    } while (abs_value != 0);
+    if (value < 0) {
+        text[--pos] = '-';
+    }
+    buffer.append(text + pos, sizeof(text) - pos);
+}
+
+void ListingGenerator::AppendUInt(uint64_t value, int width) {
+    char text[24];
+    int pos = sizeof(text);
+    do {
+        text[--pos] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    int length = static_cast<int>(sizeof(text)) - pos;
+    if (length < width) {
+        buffer.append(width - length, ' ');
+    }
+    buffer.append(text + pos, length);
+}
+
+void ListingGenerator::AppendAnnotations(int address) {
+    if (annotations == nullptr) {
+        return;
+    }
+
+    if (annotations->symbols != nullptr) {
+        auto* symbol = annotations->symbols->FindByAddress(address);
+        if (symbol != nullptr) {
+            AppendChar('\n');
+            if (annotations->profile != nullptr) {
+                buffer.append(ANNOTATION_WIDTH, ' ');
+            }
+            AppendHex(address, 4);
+            Append(" <");
+            Append(symbol->name);
+            Append(">:\n");
+        }
+    }
+
+    if (annotations->profile != nullptr) {
+        uint64_t count = annotations->profile->GetExecutions(address);
+        uint64_t total = annotations->total_executions;
+        auto hundredths = static_cast<uint64_t>(total == 0 ? 0 : 10000.0 * count / total + 0.5);
+        AppendUInt(count, COUNT_WIDTH);
+        AppendUInt(hundredths / 100, 4);
+        AppendChar('.');
+        AppendUInt(hundredths / 10 % 10, 1);
+        AppendUInt(hundredths % 10, 1);
+        Append("% ");
+        bool hot = static_cast<size_t>(address) < annotations->hot.size() && annotations->hot[address];
+        AppendChar(hot ? '*' : ' ');
+        AppendChar(' ');
+    }
+}
+
+void ListingGenerator::AppendRawBytesAndAlign(const char* bytes, int length) {
     for (int i = 0; i < length; ++i) {
         if (i % 2 == 0 && i > 0) {
-            fprintf(outstream, " ");
+            AppendChar(' ');
         }
-        fprintf(outstream, "%02hhx", bytes[i]);
+        AppendHex(static_cast<unsigned char>(bytes[i]), 2);
     }
 
     int chars_printed = 2 * length + (length - 1) / 2;  // Количество уже выведенных символов
-    for (; chars_printed < 19; ++chars_printed) {  // 19 = столько символов выводится, когда печатается заголовок (8 байт)
-        fprintf(outstream, " ");
+    if (chars_printed < 19) {  // 19 = столько символов выводится, когда печатается заголовок (8 байт)
+        buffer.append(19 - chars_printed, ' ');
+    }
+}
+
+void ListingGenerator::FlushIfFull() {
+    if (outstream != nullptr && buffer.size() >= FLUSH_THRESHOLD) {
+        Flush();
     }
 }
 
 int ListingGenerator::PrintInstruction(const char *code, int code_length) {
     Instruction* inst = GetInstructionByBytecode(*code);
-    if (inst->inst_full_size > code_length) {
+    if (inst == nullptr || static_cast<int>(inst->inst_full_size) > code_length) {
         return -1;
     }
 
-    fprintf(outstream, "%04x\t", offset);
-    PrintRawBytesAndAlign(outstream, code, inst->inst_full_size);
-    fprintf(outstream, "\t%s", inst->name);
+    AppendAnnotations(offset);
+    AppendHex(offset, 4);
+    AppendChar('\t');
+    AppendRawBytesAndAlign(code, inst->inst_full_size);
+    AppendChar('\t');
+    Append(inst->name);
+    int next_offset = offset + inst->inst_full_size;
     code += sizeof(friday_inst_t);
 
     for (int i = 0; i < inst->args_count; ++i) {
         if (i != 0) {
-            fprintf(outstream, ",");
+            AppendChar(',');
         }
 
         switch (inst->args[i]) {
-            case CONSTANT:
+            case CONSTANT: {
                 static_assert(sizeof(int32_t) == sizeof(friday_constant_t));
-                fprintf(outstream, " {int: %d, float: %f}", ReadFromBytes<int32_t>(code),
-                        ReadFromBytes<float>(code));
+                char float_text[64];
+                int float_length = snprintf(float_text, sizeof(float_text), "%f", ReadFromBytes<float>(code));
+                Append(" {int: ");
+                AppendInt(ReadFromBytes<int32_t>(code));
+                Append(", float: ");
+                Append(std::string_view(float_text, float_length));
+                AppendChar('}');
                 break;
+            }
             case REGISTER:
-                fprintf(outstream, " r%d", ReadFromBytes<friday_reg_t>(code));
+                Append(" r");
+                AppendInt(ReadFromBytes<friday_reg_t>(code));
                 break;
             case LABEL:
-                fprintf(outstream, " <file_start+%04x>", ReadFromBytes<friday_address_t>(code));
+                Append(" <file_start+");
+                AppendHex(ReadFromBytes<friday_address_t>(code), 4);
+                AppendChar('>');
+                break;
+            case CONSTANT_8:
+                Append(" {int: ");
+                AppendInt(ReadFromBytes<int8_t>(code));
+                AppendChar('}');
+                break;
+            case CONSTANT_16:
+                Append(" {int: ");
+                AppendInt(ReadFromBytes<int16_t>(code));
+                AppendChar('}');
+                break;
+            case PACKED_REGISTER:
+                Append(" r");
+                AppendInt(GetPackedRegister(inst->inst));
+                break;
+            case LABEL_REL_8:
+                Append(" <file_start+");
+                AppendHex(next_offset + ReadFromBytes<friday_short_offset_t>(code), 4);
+                AppendChar('>');
                 break;
             case _BAD_ARG: return -1;
         }
         code += GetInstructionArgumentSize(inst->args[i]);
     }
-    fprintf(outstream, "\n");
+    AppendChar('\n');
+    FlushIfFull();
 
     offset += inst->inst_full_size;
     return inst->inst_full_size;
@@ -73,14 +213,38 @@ int ListingGenerator::PrintHeader(const char *code, int code_length) {
 
     auto version = ReadFromBytes<int16_t>(code + HEADER_ASM_VER_OFFSET);
     auto regs = ReadFromBytes<friday_reg_t>(code + HEADER_REG_COUNT_OFFSET);
-    fprintf(outstream, "0000\t");
-    PrintRawBytesAndAlign(outstream, code, HEADER_SIZE);
-    fprintf(outstream, "\t{FRIDAY EXECUTABLE} Target arch version = %d; number of registers = %d.\n", version, regs);
+    if (annotations != nullptr && annotations->profile != nullptr) {
+        buffer.append(ANNOTATION_WIDTH, ' ');
+    }
+    Append("0000\t");
+    AppendRawBytesAndAlign(code, HEADER_SIZE);
+    Append("\t{FRIDAY EXECUTABLE} Target arch version = ");
+    AppendInt(version);
+    Append("; number of registers = ");
+    AppendInt(regs);
+    Append(".\n");
 
     offset = HEADER_SIZE;
     return HEADER_SIZE;
 }
 
+void ListingGenerator::PrintReadError() {
+    Append("<file_start+");
+    AppendHex(offset, 4);
+    Append("> error reading instruction or header. Abort\n");
+}
+
 int ListingGenerator::GetOffset() const {
     return offset;
 }
+
+void ListingGenerator::Flush() {
+    if (outstream != nullptr && !buffer.empty()) {
+        fwrite(buffer.data(), 1, buffer.size(), outstream);
+        buffer.clear();
+    }
+}
+
+const std::string &ListingGenerator::GetBuffer() const {
+    return buffer;
+}
@@ -1,13 +1,51 @@
 #pragma once
 
 #include <cstdio>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace FridayArch {
+class Profile;
+class SymbolMap;
+}
+
+// Чем ListingGenerator дополнительно подписывает строки листинга
+struct ListingAnnotations {
+    // Перед каждой инструкцией печатается, сколько раз она исполнилась и какую долю от total_executions это составляет
+    const FridayArch::Profile* profile = nullptr;
+    uint64_t total_executions = 0;
+    // Метки печатаются перед инструкцией со своим адресом
+    const FridayArch::SymbolMap* symbols = nullptr;
+    // Адреса инструкций из самых горячих блоков, такие строки помечаются '*'
+    std::vector<bool> hot;
+};
 
 class ListingGenerator {
     FILE* outstream;
     int offset = 0;
+    std::string buffer;  // Текст листинга копится здесь и сбрасывается в outstream большими кусками
+    const ListingAnnotations* annotations;
+
+    void Append(std::string_view text);
+    void AppendChar(char c);
+    // Как printf("%0*x"): не меньше min_digits цифр, но все значащие
+    void AppendHex(unsigned int value, int min_digits);
+    void AppendInt(int value);
+    void AppendUInt(uint64_t value, int width);
+    void AppendAnnotations(int address);
+    void AppendRawBytesAndAlign(const char* bytes, int length);
+    void FlushIfFull();
 
 public:
-    explicit ListingGenerator(FILE* outstream);
+    // Если outstream == nullptr, листинг не выводится, а целиком остается в буфере (см. GetBuffer).
+    // offset -- смещение относительно начала файла, с которого начнется печать
+    explicit ListingGenerator(FILE* outstream, int offset = 0, const ListingAnnotations* annotations = nullptr);
+    ~ListingGenerator();
+
+    ListingGenerator(const ListingGenerator&) = delete;
+    ListingGenerator& operator=(const ListingGenerator&) = delete;
 
     // Все функции Print... возвращают количество прочитанных байт, или -1 в случае ошибки
 
@@ -15,9 +53,14 @@ public:
     int PrintHeader(const char* code, int code_length);
     int PrintInstruction(const char* code, int code_length);
 
+    // Печатает сообщение о том, что по текущему смещению не удалось прочитать инструкцию или заголовок
+    void PrintReadError();
+
     // Возвращает текущее смещение относительно начала файла,
     // то есть суммарное количество прочитанных байт
     int GetOffset() const;
-};
-
 
+    // Сбрасывает накопленный текст в outstream
+    void Flush();
+    const std::string& GetBuffer() const;
+};
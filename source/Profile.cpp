@@ -0,0 +1,94 @@
+#include "Profile.hpp"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include "Emulator.hpp"
+
+using namespace FridayArch;
+
+static const char* PROFILE_HEADER = "# friday profile: <address> <executions> <taken>\n";
+
+Profile::Profile(size_t code_size) :
+    executions(code_size, 0),
+    taken(code_size, 0)
+{}
+
+void Profile::Resize(size_t size) {
+    executions.resize(size, 0);
+    taken.resize(size, 0);
+}
+
+uint64_t Profile::GetExecutions(int address) const {
+    return static_cast<size_t>(address) < executions.size() ? executions[address] : 0;
+}
+
+uint64_t Profile::GetTaken(int address) const {
+    return static_cast<size_t>(address) < taken.size() ? taken[address] : 0;
+}
+
+uint64_t Profile::GetTotalExecutions() const {
+    uint64_t total = 0;
+    for (auto count : executions) {
+        total += count;
+    }
+    return total;
+}
+
+void Profile::Save(const char *filename) const {
+    FILE* file = fopen(filename, "w");
+    if (file == nullptr) {
+        throw std::system_error(errno, std::generic_category(), "fopen");
+    }
+    fputs(PROFILE_HEADER, file);
+    for (size_t address = 0; address < executions.size(); ++address) {
+        if (executions[address] != 0) {
+            fprintf(file, "%04zx %" PRIu64 " %" PRIu64 "\n", address, executions[address], taken[address]);
+        }
+    }
+    if (fclose(file) != 0) {
+        throw std::system_error(errno, std::generic_category(), "fclose");
+    }
+}
+
+void Profile::Merge(const Profile &other) {
+    if (other.executions.size() > executions.size()) {
+        Resize(other.executions.size());
+    }
+    for (size_t i = 0; i < other.executions.size(); ++i) {
+        executions[i] += other.executions[i];
+        taken[i] += other.taken[i];
+    }
+}
+
+void Profile::Load(const char *filename) {
+    FILE* file = fopen(filename, "r");
+    if (file == nullptr) {
+        throw std::system_error(errno, std::generic_category(), "fopen");
+    }
+
+    executions.clear();
+    taken.clear();
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        unsigned int address = 0;
+        uint64_t count = 0, jumped = 0;
+        // An address outside of emulator memory cannot come from a run, and would make the profile huge
+        if (sscanf(line, "%x %" SCNu64 " %" SCNu64, &address, &count, &jumped) != 3 ||
+                address >= static_cast<unsigned int>(Emulator::MEMORY_SIZE)) {
+            fclose(file);
+            throw std::runtime_error("bad profile line: " + std::string(line));
+        }
+        if (address >= executions.size()) {
+            Resize(static_cast<size_t>(address) + 1);
+        }
+        executions[address] += count;
+        taken[address] += jumped;
+    }
+    fclose(file);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace FridayArch {
+
+// Профиль исполнения программы. Для каждого адреса хранится, сколько раз исполнялась инструкция по этому адресу,
+// и сколько раз после нее управление ушло не на следующую инструкцию (переход совершен).
+// В файле профиль хранится текстом: по строке "<адрес hex> <исполнений> <переходов>" на каждую исполненную инструкцию
+class Profile {
+public:
+    std::vector<uint64_t> executions;
+    std::vector<uint64_t> taken;
+
+    explicit Profile(size_t code_size = 0);
+
+    inline void Record(int address, bool jumped) {
+        if (static_cast<size_t>(address) >= executions.size()) {
+            Resize(address + 1);
+        }
+        ++executions[address];
+        taken[address] += jumped;
+    }
+
+    uint64_t GetExecutions(int address) const;
+    uint64_t GetTaken(int address) const;
+    uint64_t GetTotalExecutions() const;
+    // Прибавляет счетчики другого профиля той же программы (например, собранного другим потоком)
+    void Merge(const Profile& other);
+
+    // Бросают std::system_error или std::runtime_error в случае ошибки
+    void Save(const char* filename) const;
+    void Load(const char* filename);
+
+private:
+    void Resize(size_t size);
+};
+
+}
@@ -0,0 +1,69 @@
+#include "SymbolMap.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <system_error>
+
+using namespace FridayArch;
+
+void SymbolMap::Add(friday_address_t address, std::string name) {
+    auto pos = std::upper_bound(symbols.begin(), symbols.end(), address,
+                                [] (friday_address_t addr, const Symbol& symbol) { return addr < symbol.address; });
+    symbols.insert(pos, {address, std::move(name)});
+}
+
+const std::vector<SymbolMap::Symbol> &SymbolMap::GetSymbols() const {
+    return symbols;
+}
+
+const SymbolMap::Symbol *SymbolMap::FindByAddress(friday_address_t address) const {
+    auto pos = std::lower_bound(symbols.begin(), symbols.end(), address,
+                                [] (const Symbol& symbol, friday_address_t addr) { return symbol.address < addr; });
+    if (pos == symbols.end() || pos->address != address) {
+        return nullptr;
+    }
+    return &*pos;
+}
+
+const SymbolMap::Symbol *SymbolMap::FindByName(const std::string &name) const {
+    for (auto& symbol : symbols) {
+        if (symbol.name == name) {
+            return &symbol;
+        }
+    }
+    return nullptr;
+}
+
+void SymbolMap::Save(const char *filename) const {
+    FILE* file = fopen(filename, "w");
+    if (file == nullptr) {
+        throw std::system_error(errno, std::generic_category(), "fopen");
+    }
+    for (auto& symbol : symbols) {
+        fprintf(file, "%04x %s\n", symbol.address, symbol.name.c_str());
+    }
+    if (fclose(file) != 0) {
+        throw std::system_error(errno, std::generic_category(), "fclose");
+    }
+}
+
+void SymbolMap::Load(const char *filename) {
+    FILE* file = fopen(filename, "r");
+    if (file == nullptr) {
+        throw std::system_error(errno, std::generic_category(), "fopen");
+    }
+
+    symbols.clear();
+    char line[512];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        unsigned int address = 0;
+        char name[512];
+        if (sscanf(line, "%x %511s", &address, name) != 2) {
+            fclose(file);
+            throw std::runtime_error("bad symbol map line: " + std::string(line));
+        }
+        Add(static_cast<friday_address_t>(address), name);
+    }
+    fclose(file);
+}
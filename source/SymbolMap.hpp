@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "friday_asm_lang.hpp"
+
+namespace FridayArch {
+
+// Таблица меток программы, которую ассемблер сохраняет рядом с .friday (friday-asm -m).
+// В файле хранится текстом: по строке "<адрес hex> <метка>", строки отсортированы по адресу
+class SymbolMap {
+public:
+    struct Symbol {
+        friday_address_t address;
+        std::string name;
+    };
+
+    void Add(friday_address_t address, std::string name);
+
+    // Возвращает метки, отсортированные по адресу
+    const std::vector<Symbol>& GetSymbols() const;
+    // Возвращает первую метку с данным адресом или nullptr
+    const Symbol* FindByAddress(friday_address_t address) const;
+    // Возвращает метку с данным именем или nullptr
+    const Symbol* FindByName(const std::string& name) const;
+
+    // Бросают std::system_error или std::runtime_error в случае ошибки
+    void Save(const char* filename) const;
+    void Load(const char* filename);
+
+private:
+    std::vector<Symbol> symbols;  // Отсортированы по адресу
+};
+
+}
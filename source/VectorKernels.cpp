@@ -0,0 +1,263 @@
+#include "VectorKernels.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define FRIDAY_X86_KERNELS
+    #include <immintrin.h>
+#endif
+
+using namespace FridayArch;
+
+//**  SCALAR KERNELS  **//
+//#################################################################################################
+namespace {
+
+template <typename T>
+inline void Load(const char* bytes, T (&lanes)[VECTOR_LANES]) {
+    std::memcpy(lanes, bytes, VECTOR_SIZE);
+}
+template <typename T>
+inline void Store(char* bytes, const T (&lanes)[VECTOR_LANES]) {
+    std::memcpy(bytes, lanes, VECTOR_SIZE);
+}
+
+template <typename T, typename R, typename Op>
+inline void ScalarBinary(const char* a, const char* b, char* out, Op operation) {
+    T x[VECTOR_LANES], y[VECTOR_LANES];
+    R result[VECTOR_LANES];
+    Load(a, x);
+    Load(b, y);
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+        result[i] = operation(x[i], y[i]);
+    }
+    Store(out, result);
+}
+
+// Int overflow wraps around like in SIMD registers, so compute in unsigned
+void ScalarAddI32(const char* a, const char* b, char* out) {
+    ScalarBinary<uint32_t, uint32_t>(a, b, out, [] (uint32_t x, uint32_t y) { return x + y; });
+}
+void ScalarSubI32(const char* a, const char* b, char* out) {
+    ScalarBinary<uint32_t, uint32_t>(a, b, out, [] (uint32_t x, uint32_t y) { return x - y; });
+}
+void ScalarMulI32(const char* a, const char* b, char* out) {
+    ScalarBinary<uint32_t, uint32_t>(a, b, out, [] (uint32_t x, uint32_t y) { return x * y; });
+}
+void ScalarCmpEqI32(const char* a, const char* b, char* out) {
+    ScalarBinary<int32_t, int32_t>(a, b, out, [] (int32_t x, int32_t y) { return x == y ? -1 : 0; });
+}
+void ScalarCmpGtI32(const char* a, const char* b, char* out) {
+    ScalarBinary<int32_t, int32_t>(a, b, out, [] (int32_t x, int32_t y) { return x > y ? -1 : 0; });
+}
+int ScalarHsumI32(const char* a) {
+    uint32_t x[VECTOR_LANES];
+    Load(a, x);
+    uint32_t sum = 0;
+    for (uint32_t lane : x) {
+        sum += lane;
+    }
+    return static_cast<int>(sum);
+}
+
+void ScalarAddF32(const char* a, const char* b, char* out) {
+    ScalarBinary<float, float>(a, b, out, [] (float x, float y) { return x + y; });
+}
+void ScalarSubF32(const char* a, const char* b, char* out) {
+    ScalarBinary<float, float>(a, b, out, [] (float x, float y) { return x - y; });
+}
+void ScalarMulF32(const char* a, const char* b, char* out) {
+    ScalarBinary<float, float>(a, b, out, [] (float x, float y) { return x * y; });
+}
+void ScalarCmpEqF32(const char* a, const char* b, char* out) {
+    ScalarBinary<float, int32_t>(a, b, out, [] (float x, float y) { return x == y ? -1 : 0; });
+}
+void ScalarCmpGtF32(const char* a, const char* b, char* out) {
+    ScalarBinary<float, int32_t>(a, b, out, [] (float x, float y) { return x > y ? -1 : 0; });
+}
+void ScalarFmaF32(const char* a, const char* b, const char* c, char* out) {
+    float x[VECTOR_LANES], y[VECTOR_LANES], z[VECTOR_LANES];
+    Load(a, x);
+    Load(b, y);
+    Load(c, z);
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+        x[i] = std::fma(x[i], y[i], z[i]);
+    }
+    Store(out, x);
+}
+void ScalarSqrtF32(const char* a, char* out) {
+    float x[VECTOR_LANES];
+    Load(a, x);
+    for (float& lane : x) {
+        lane = std::sqrt(lane);
+    }
+    Store(out, x);
+}
+// Same order of additions as the SIMD reduction: halves, then quarters, then pairs
+float ScalarHsumF32(const char* a) {
+    float x[VECTOR_LANES];
+    Load(a, x);
+    float q0 = x[0] + x[4], q1 = x[1] + x[5], q2 = x[2] + x[6], q3 = x[3] + x[7];
+    return (q0 + q2) + (q1 + q3);
+}
+
+const VectorKernels SCALAR_KERNELS = {
+    "scalar",
+    ScalarAddI32, ScalarSubI32, ScalarMulI32, ScalarCmpEqI32, ScalarCmpGtI32, ScalarHsumI32,
+    ScalarAddF32, ScalarSubF32, ScalarMulF32, ScalarFmaF32, ScalarCmpEqF32, ScalarCmpGtF32, ScalarSqrtF32,
+    ScalarHsumF32
+};
+
+}
+//#################################################################################################
+
+
+#ifdef FRIDAY_X86_KERNELS
+//**  SSE4.1 KERNELS: A VECTOR IS PROCESSED AS TWO 4-LANE HALVES  **//
+//#################################################################################################
+namespace {
+
+#define FRIDAY_SSE __attribute__((target("sse4.1")))
+
+// ptr -- type of pointer which load and store accept
+#define FRIDAY_SSE_BINARY(func_name, ptr, load, store, op)                                                   \
+FRIDAY_SSE void func_name(const char* a, const char* b, char* out) {                                         \
+    auto lo = op(load(reinterpret_cast<const ptr*>(a)), load(reinterpret_cast<const ptr*>(b)));              \
+    auto hi = op(load(reinterpret_cast<const ptr*>(a + 16)), load(reinterpret_cast<const ptr*>(b + 16)));    \
+    store(reinterpret_cast<ptr*>(out), lo);                                                                  \
+    store(reinterpret_cast<ptr*>(out + 16), hi);                                                             \
+}
+
+FRIDAY_SSE inline __m128 SseCmpEqPs(__m128 a, __m128 b) { return _mm_cmpeq_ps(a, b); }
+FRIDAY_SSE inline __m128 SseCmpGtPs(__m128 a, __m128 b) { return _mm_cmpgt_ps(a, b); }
+
+FRIDAY_SSE_BINARY(SseAddI32, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi32)
+FRIDAY_SSE_BINARY(SseSubI32, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_sub_epi32)
+FRIDAY_SSE_BINARY(SseMulI32, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_mullo_epi32)
+FRIDAY_SSE_BINARY(SseCmpEqI32, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_cmpeq_epi32)
+FRIDAY_SSE_BINARY(SseCmpGtI32, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_cmpgt_epi32)
+FRIDAY_SSE_BINARY(SseAddF32, float, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps)
+FRIDAY_SSE_BINARY(SseSubF32, float, _mm_loadu_ps, _mm_storeu_ps, _mm_sub_ps)
+FRIDAY_SSE_BINARY(SseMulF32, float, _mm_loadu_ps, _mm_storeu_ps, _mm_mul_ps)
+FRIDAY_SSE_BINARY(SseCmpEqF32, float, _mm_loadu_ps, _mm_storeu_ps, SseCmpEqPs)
+FRIDAY_SSE_BINARY(SseCmpGtF32, float, _mm_loadu_ps, _mm_storeu_ps, SseCmpGtPs)
+
+FRIDAY_SSE int SseHsumI32(const char* a) {
+    __m128i sum = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+FRIDAY_SSE void SseSqrtF32(const char* a, char* out) {
+    __m128 lo = _mm_sqrt_ps(_mm_loadu_ps(reinterpret_cast<const float*>(a)));
+    __m128 hi = _mm_sqrt_ps(_mm_loadu_ps(reinterpret_cast<const float*>(a + 16)));
+    _mm_storeu_ps(reinterpret_cast<float*>(out), lo);
+    _mm_storeu_ps(reinterpret_cast<float*>(out + 16), hi);
+}
+
+FRIDAY_SSE float SseHsumF32(const char* a) {
+    __m128 sum = _mm_add_ps(_mm_loadu_ps(reinterpret_cast<const float*>(a)),
+                            _mm_loadu_ps(reinterpret_cast<const float*>(a + 16)));  // q0 q1 q2 q3
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));                                  // q0+q2 q1+q3 ...
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(sum);
+}
+
+// SSE has no fused multiply-add, take the scalar one which is exact
+const VectorKernels SSE_KERNELS = {
+    "sse4.1",
+    SseAddI32, SseSubI32, SseMulI32, SseCmpEqI32, SseCmpGtI32, SseHsumI32,
+    SseAddF32, SseSubF32, SseMulF32, ScalarFmaF32, SseCmpEqF32, SseCmpGtF32, SseSqrtF32, SseHsumF32
+};
+
+}
+//#################################################################################################
+
+
+//**  AVX2 + FMA KERNELS: A VECTOR IS ONE 8-LANE REGISTER  **//
+//#################################################################################################
+namespace {
+
+#define FRIDAY_AVX2 __attribute__((target("avx2,fma")))
+
+#define FRIDAY_AVX2_BINARY(func_name, ptr, load, store, op)                                                  \
+FRIDAY_AVX2 void func_name(const char* a, const char* b, char* out) {                                        \
+    store(reinterpret_cast<ptr*>(out),                                                                       \
+          op(load(reinterpret_cast<const ptr*>(a)), load(reinterpret_cast<const ptr*>(b))));                 \
+}
+
+FRIDAY_AVX2 inline __m256 AvxCmpEqPs(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+FRIDAY_AVX2 inline __m256 AvxCmpGtPs(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+
+FRIDAY_AVX2_BINARY(AvxAddI32, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi32)
+FRIDAY_AVX2_BINARY(AvxSubI32, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_sub_epi32)
+FRIDAY_AVX2_BINARY(AvxMulI32, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_mullo_epi32)
+FRIDAY_AVX2_BINARY(AvxCmpEqI32, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_cmpeq_epi32)
+FRIDAY_AVX2_BINARY(AvxCmpGtI32, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_cmpgt_epi32)
+FRIDAY_AVX2_BINARY(AvxAddF32, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps)
+FRIDAY_AVX2_BINARY(AvxSubF32, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_sub_ps)
+FRIDAY_AVX2_BINARY(AvxMulF32, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_mul_ps)
+FRIDAY_AVX2_BINARY(AvxCmpEqF32, float, _mm256_loadu_ps, _mm256_storeu_ps, AvxCmpEqPs)
+FRIDAY_AVX2_BINARY(AvxCmpGtF32, float, _mm256_loadu_ps, _mm256_storeu_ps, AvxCmpGtPs)
+
+FRIDAY_AVX2 int AvxHsumI32(const char* a) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+FRIDAY_AVX2 void AvxFmaF32(const char* a, const char* b, const char* c, char* out) {
+    __m256 result = _mm256_fmadd_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(a)),
+                                    _mm256_loadu_ps(reinterpret_cast<const float*>(b)),
+                                    _mm256_loadu_ps(reinterpret_cast<const float*>(c)));
+    _mm256_storeu_ps(reinterpret_cast<float*>(out), result);
+}
+
+FRIDAY_AVX2 void AvxSqrtF32(const char* a, char* out) {
+    _mm256_storeu_ps(reinterpret_cast<float*>(out), _mm256_sqrt_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(a))));
+}
+
+FRIDAY_AVX2 float AvxHsumF32(const char* a) {
+    __m256 v = _mm256_loadu_ps(reinterpret_cast<const float*>(a));
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(sum);
+}
+
+const VectorKernels AVX2_KERNELS = {
+    "avx2",
+    AvxAddI32, AvxSubI32, AvxMulI32, AvxCmpEqI32, AvxCmpGtI32, AvxHsumI32,
+    AvxAddF32, AvxSubF32, AvxMulF32, AvxFmaF32, AvxCmpEqF32, AvxCmpGtF32, AvxSqrtF32, AvxHsumF32
+};
+
+}
+//#################################################################################################
+#endif
+
+static const VectorKernels& DetectVectorKernels() {
+#ifdef FRIDAY_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return AVX2_KERNELS;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SSE_KERNELS;
+    }
+#endif
+    return SCALAR_KERNELS;
+}
+
+const VectorKernels &FridayArch::GetVectorKernels() {
+    static const VectorKernels& kernels = DetectVectorKernels();
+    return kernels;
+}
+
+const VectorKernels &FridayArch::GetScalarVectorKernels() {
+    return SCALAR_KERNELS;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+namespace FridayArch {
+
+// Вектор -- VECTOR_LANES упакованных 32-битных значений (int32 или float), всего VECTOR_SIZE байт
+const int VECTOR_LANES = 8;
+const int VECTOR_SIZE = VECTOR_LANES * 4;
+
+// Реализации векторных операций для эмулятора. Указатели не обязаны быть выровнены, out может совпадать с a.
+// Все реализации дают побитово одинаковый результат (в том числе порядок сложения в горизонтальной сумме)
+struct VectorKernels {
+    const char* name;
+
+    void (*add_i32)(const char* a, const char* b, char* out);
+    void (*sub_i32)(const char* a, const char* b, char* out);
+    void (*mul_i32)(const char* a, const char* b, char* out);
+    void (*cmpeq_i32)(const char* a, const char* b, char* out);  // Дорожка = -1, если условие верно, иначе 0
+    void (*cmpgt_i32)(const char* a, const char* b, char* out);
+    int  (*hsum_i32)(const char* a);
+
+    void (*add_f32)(const char* a, const char* b, char* out);
+    void (*sub_f32)(const char* a, const char* b, char* out);
+    void (*mul_f32)(const char* a, const char* b, char* out);
+    void (*fma_f32)(const char* a, const char* b, const char* c, char* out);  // a * b + c без промежуточного округления
+    void (*cmpeq_f32)(const char* a, const char* b, char* out);
+    void (*cmpgt_f32)(const char* a, const char* b, char* out);
+    void (*sqrt_f32)(const char* a, char* out);
+    float (*hsum_f32)(const char* a);
+};
+
+// Возвращает лучшую реализацию для процессора, на котором запущена программа (AVX2+FMA, SSE4.1 или скалярную).
+// Выбор делается один раз, при первом вызове
+const VectorKernels& GetVectorKernels();
+
+// Скалярная реализация, доступна на любой платформе
+const VectorKernels& GetScalarVectorKernels();
+
+}
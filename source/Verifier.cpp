@@ -0,0 +1,176 @@
+#include "Verifier.hpp"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <utility>
+#include "CodeAnalysis.hpp"
+#include "friday_asm_lang.hpp"
+#include "utility/BytesHelper.hpp"
+
+using namespace FridayArch;
+
+namespace {
+
+enum ByteState : char {
+    NOT_REACHED,
+    INSTRUCTION_START,
+    INSIDE_INSTRUCTION
+};
+
+// Адрес, до которого дошло исполнение, и глубина стека перед ним
+struct PendingAddress {
+    int address;
+    int stack_depth;
+};
+
+}
+
+static void SetError(VerifiedProgram& result, int address, const char* format, ...) {
+    char text[128];
+    va_list argptr;
+    va_start(argptr, format);
+    vsnprintf(text, sizeof(text), format, argptr);
+    va_end(argptr);
+    result.ok = false;
+    result.error_address = address;
+    result.error = text;
+}
+
+bool FridayArch::CheckRegisterArguments(const Instruction& inst, const char* inst_code, int registers_count, int& bad_register) {
+    const char* arg = inst_code + sizeof(friday_inst_t);
+    for (int i = 0; i < inst.args_count; ++i) {
+        int reg = -1;
+        if (inst.args[i] == REGISTER) {
+            reg = BytesHelper::BytesAs<friday_reg_t>(arg);
+        } else if (inst.args[i] == PACKED_REGISTER) {
+            reg = GetPackedRegister(inst.inst);
+        }
+        if (reg >= registers_count) {
+            bad_register = reg;
+            return false;
+        }
+        arg += GetInstructionArgumentSize(inst.args[i]);
+    }
+    return true;
+}
+
+bool VerifiedProgram::IsInstructionStart(int32_t address) const {
+    return address >= 0 && address < static_cast<int32_t>(instruction_starts.size()) && instruction_starts[address];
+}
+
+VerifiedProgram FridayArch::VerifyProgram(const char *code, int code_size) {
+    VerifiedProgram result;
+    if (code_size <= HEADER_SIZE) {
+        SetError(result, HEADER_SIZE, "program has no code");
+        return result;
+    }
+    int registers_count = BytesHelper::BytesAs<friday_reg_t>(code, HEADER_REG_COUNT_OFFSET);
+
+    std::vector<ByteState> state(code_size, NOT_REACHED);
+    std::vector<int> depth(code_size, -1);
+    bool depth_known = true;
+    int max_depth = 0;
+
+    std::vector<PendingAddress> pending = {{HEADER_SIZE, 0}};
+    while (!pending.empty()) {
+        auto [address, stack_depth] = pending.back();
+        pending.pop_back();
+
+        if (state[address] == INSIDE_INSTRUCTION) {
+            SetError(result, address, "jump into the middle of an instruction");
+            return result;
+        }
+        if (state[address] == INSTRUCTION_START) {
+            // Different paths bring different stack depth, e.g. a loop which pushes every iteration
+            depth_known &= depth[address] == stack_depth;
+            continue;
+        }
+
+        const Instruction* inst = GetInstructionByBytecode(code[address]);
+        if (inst == nullptr) {
+            SetError(result, address, "unknown instruction 0x%02x", static_cast<uint8_t>(code[address]));
+            return result;
+        }
+        int next = address + static_cast<int>(inst->inst_full_size);
+        if (next > code_size) {
+            SetError(result, address, "instruction '%s' is cut by the end of the program", inst->name);
+            return result;
+        }
+        for (int i = address + 1; i < next; ++i) {
+            if (state[i] == INSTRUCTION_START) {
+                SetError(result, i, "jump into the middle of an instruction");
+                return result;
+            }
+            state[i] = INSIDE_INSTRUCTION;
+        }
+        state[address] = INSTRUCTION_START;
+        depth[address] = stack_depth;
+
+        int bad_register = -1;
+        if (!CheckRegisterArguments(*inst, code + address, registers_count, bad_register)) {
+            SetError(result, address, "register r%d is out of range, program has %d registers",
+                     bad_register, registers_count);
+            return result;
+        }
+
+        // Return address of ret is known only at run time, so is stack usage of calls and intrinsics
+        if (inst->stack_pops < 0 || inst->flow == FLOW_CALL || inst->flow == FLOW_RET) {
+            depth_known = false;
+        }
+        int next_depth = 0;
+        if (depth_known) {
+            if (stack_depth < inst->stack_pops) {
+                SetError(result, address, "stack may underflow: '%s' takes %d bytes, but stack has %d",
+                         inst->name, inst->stack_pops, stack_depth);
+                return result;
+            }
+            next_depth = stack_depth - inst->stack_pops + inst->stack_pushes;
+            max_depth = std::max({max_depth, stack_depth, next_depth});
+        }
+
+        // A short jump may point to -1 too, so don't rely on GetJumpTarget returning -1 for instructions without label
+        bool has_label = std::any_of(inst->args, inst->args + inst->args_count, [] (InstructionArgument arg) {
+            return arg == LABEL || arg == LABEL_REL_8;
+        });
+        int target = has_label ? GetJumpTarget(*inst, code + address, address) : -1;
+        if (has_label && (target < HEADER_SIZE || target >= code_size)) {
+            SetError(result, address, "label 0x%04x is outside of the program code", target);
+            return result;
+        }
+        bool falls_through = inst->flow != FLOW_JUMP && inst->flow != FLOW_RET && inst->flow != FLOW_EXIT;
+        if (falls_through && next >= code_size) {
+            SetError(result, address, "execution runs past the end of the program");
+            return result;
+        }
+
+        if (falls_through) {
+            pending.push_back({next, next_depth});
+        }
+        if (inst->flow == FLOW_SPAWN) {
+            // New thread starts with its argument on the stack
+            pending.push_back({target, static_cast<int>(sizeof(friday_constant_t))});
+        } else if (has_label) {
+            pending.push_back({target, next_depth});
+        }
+    }
+
+    result.ok = true;
+    result.stack_bound = depth_known ? max_depth : -1;
+    result.instruction_starts.resize(code_size);
+    for (int i = 0; i < code_size; ++i) {
+        result.instruction_starts[i] = state[i] == INSTRUCTION_START;
+    }
+
+    // A run continues through instructions which fall through to the next one, so it is counted from the end
+    result.run_lengths.assign(code_size, 0);
+    for (int address = code_size - 1; address >= HEADER_SIZE; --address) {
+        if (state[address] != INSTRUCTION_START) {
+            continue;
+        }
+        const Instruction* inst = GetInstructionByBytecode(code[address]);
+        int next = address + static_cast<int>(inst->inst_full_size);
+        bool continues = inst->flow == FLOW_NEXT && next < code_size && state[next] == INSTRUCTION_START;
+        result.run_lengths[address] = 1 + (continues ? result.run_lengths[next] : 0);
+    }
+    return result;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace FridayArch {
+
+struct Instruction;
+
+// Результат проверки программы, которую эмулятор выполняет при загрузке. Проверенную программу он исполняет без
+// проверок во время исполнения (см. Emulator::RunSlice)
+struct VerifiedProgram {
+    bool ok = false;
+    int error_address = -1;  // Адрес инструкции, не прошедшей проверку
+    std::string error;       // Почему программа не прошла проверку
+    int stack_bound = -1;    // Сколько байт стека нужно любому потоку программы, -1 -- не вычисляется статически
+    std::vector<bool> instruction_starts;  // Начала достижимых инструкций, индекс -- адрес
+    // Для начала инструкции: сколько инструкций исполнится подряд, начиная с нее, до инструкции, меняющей поток
+    // управления, включительно. Столько бюджета списывает Emulator::ChargeFuel
+    std::vector<int32_t> run_lengths;
+
+    bool IsInstructionStart(int32_t address) const;
+};
+
+// Обходит весь код, достижимый с начала программы и с меток spawn, и проверяет, что:
+//   - каждая инструкция известна и не обрезана концом программы, а исполнение не уходит за ее конец;
+//   - номера регистров в аргументах меньше числа регистров из заголовка;
+//   - метки переходов, call и spawn лежат в программе и указывают на начала инструкций.
+// Если в программе нет call, ret и syscall, а глубина стека перед каждой инструкцией не зависит от пути к ней,
+// кроме того вычисляет наибольшую глубину стека и проверяет, что стек не опустошается
+VerifiedProgram VerifyProgram(const char* code, int code_size);
+
+// Возвращает false, если в аргументах инструкции inst_code есть регистр с номером не меньше registers_count
+// (его номер записывается в bad_register)
+bool CheckRegisterArguments(const Instruction& inst, const char* inst_code, int registers_count, int& bad_register);
+
+}
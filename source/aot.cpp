@@ -0,0 +1,536 @@
+#include "aot.hpp"
+#include "assembler.hpp"
+#include "CodeAnalysis.hpp"
+#include "Emulator.hpp"
+#include "friday_asm_lang.hpp"
+#include "Verifier.hpp"
+#include "utility/BytesHelper.hpp"
+#include "utility/FileHelper.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Заголовки и библиотека среды исполнения, с которыми компилируется сгенерированный код. Задаются в CMakeLists.txt
+#ifndef FRIDAY_AOT_INCLUDE_DIR
+    #define FRIDAY_AOT_INCLUDE_DIR "source"
+#endif
+#ifndef FRIDAY_AOT_RUNTIME
+    #define FRIDAY_AOT_RUNTIME "libfriday-shared.a"
+#endif
+
+extern char** environ;
+
+using namespace FridayArch;
+using namespace BytesHelper;
+
+#ifdef FRIDAY_AOT_MAIN
+int main(int argc, char** argv) {
+    auto args = ParseAotArgs(argc, argv);
+    if (args._bad_syntax) {
+        PrintAotHelp();
+        return 0;
+    }
+    return CompileAheadOfTime(args) ? 0 : 1;
+}
+#endif
+
+AotArgs ParseAotArgs(int argc, char **argv) {
+    AotArgs result;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "--shared") == 0) {
+            result.shared_object = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-S") == 0) {
+            result.only_cpp = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            printf("error: nothing after '%s' argument\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+        if (strcmp(argv[i], "-o") == 0) {
+            result.output_filename = argv[i + 1];
+        } else if (strcmp(argv[i], "--cxx") == 0) {
+            result.compiler = argv[i + 1];
+        } else {
+            printf("error: unknown argument '%s'\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+        ++i;
+    }
+
+    for (; i < argc; ++i) {
+        result.input_files.push_back(argv[i]);
+    }
+    if (result.input_files.empty()) {
+        printf("error: no input files\n");
+        result._bad_syntax = true;
+    }
+    if (result.output_filename == nullptr) {
+        result.output_filename = result.only_cpp ? "a.cpp" : result.shared_object ? "a.so" : "a.out";
+    }
+    return result;
+}
+
+void PrintAotHelp() {
+    printf("friday-aot [-o <output>] [--shared] [-S] [--cxx <compiler>] <program.friday | file.s [other files...]>\n"
+           "Translate .friday program to C++ and compile it to a native executable\n"
+           "-o : output filename, default is \"a.out\"\n"
+           "--shared : build a shared object with 'extern \"C\" int friday_aot_main()' instead of an executable\n"
+           "-S : only write generated C++ to <output>, default is \"a.cpp\"\n"
+           "--cxx : C++ compiler to use, default is $CXX or c++\n"
+           "Assembler files (.s) are assembled first, as friday-asm does. Programs with threads (spawn, join) are\n"
+           "not supported\n");
+}
+
+
+//**  TRANSLATION TO C++  **//
+//#################################################################################################
+// Каждый базовый блок становится меткой L_<адрес> внутри одной функции, переходы -- goto. Регистры и sp -- локальные
+// переменные, стек и данные -- в памяти эмулятора. Переход по адресу со стека (ret) идет через switch по началам
+// блоков. Инструкции, для которых нет перевода, исполняет эмулятор: их семантика остается в friday_asm_lang.cpp
+namespace {
+
+const char* IntCondition(std::string_view name) {
+    if (name == "ja") return ">";
+    if (name == "jae") return ">=";
+    if (name == "jb") return "<";
+    if (name == "jbe") return "<=";
+    if (name == "je") return "==";
+    if (name == "jne") return "!=";
+    return nullptr;
+}
+
+const char* IntOperation(std::string_view name) {
+    if (name == "add") return "+";
+    if (name == "sub") return "-";
+    if (name == "mul") return "*";
+    if (name == "div") return "/";
+    if (name == "mod") return "%";
+    return nullptr;
+}
+
+// Для имен с суффиксом 'f' (jaf, addf, ...) возвращает имя без него, иначе пустую строку
+std::string_view WithoutFloatSuffix(std::string_view name) {
+    if (name.size() < 2 || name.back() != 'f') {
+        return {};
+    }
+    return name.substr(0, name.size() - 1);
+}
+
+class Translator {
+public:
+    Translator(const char* code, int code_size) :
+        code(code),
+        code_size(code_size)
+    {}
+
+    // Возвращает false в случае ошибки (она уже напечатана)
+    bool Translate(bool shared_object, std::string& result);
+
+private:
+    const char* code;
+    int code_size;
+    std::vector<DecodedInstruction> decoded;
+    std::vector<bool> leaders;  // Начинается ли по адресу базовый блок
+    // Проверять ли стек, как это делает эмулятор: он не проверяет его, только если VerifyProgram ограничил стек
+    bool stack_checks = true;
+    bool code_protected = false;  // Нельзя записывать код проверенной программы (Emulator::get_writable_range)
+    std::string out;
+
+    void Emit(const char* format, ...) __attribute__ ((format (printf, 2, 3)));
+    // Текст операнда i инструкции: регистр или константа
+    std::string Operand(const DecodedInstruction& d, int i) const;
+    std::string Goto(int target) const;
+    // Проверки, которые Emulator::RunSlice делает до и после инструкции. ip -- адрес, с которым эмулятор сообщает
+    // о выходе за стек после инструкции
+    void EmitStackCheckBefore(const DecodedInstruction& d);
+    std::string StackCheckAfter(const DecodedInstruction& d, int ip) const;
+    bool EmitInstruction(const DecodedInstruction& d);
+    void EmitFallback(const DecodedInstruction& d);
+    void EmitProgramBytes();
+};
+
+void Translator::Emit(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int length = vsnprintf(nullptr, 0, format, args);
+    va_end(args);
+
+    size_t old_size = out.size();
+    out.resize(old_size + length + 1);
+    vsnprintf(&out[old_size], length + 1, format, args_copy);
+    va_end(args_copy);
+    out.pop_back();  // '\0'
+}
+
+std::string Translator::Operand(const DecodedInstruction &d, int i) const {
+    const char* arg = code + d.address + sizeof(friday_inst_t);
+    for (int j = 0; j < i; ++j) {
+        arg += GetInstructionArgumentSize(d.inst->args[j]);
+    }
+
+    int32_t value = 0;
+    switch (d.inst->args[i]) {
+        case REGISTER:
+            return "r" + std::to_string(ReadFromBytes<friday_reg_t>(arg));
+        case PACKED_REGISTER:
+            return "r" + std::to_string(GetPackedRegister(d.inst->inst));
+        case CONSTANT:
+            value = ReadFromBytes<int32_t>(arg);
+            break;
+        case CONSTANT_8:
+            value = ReadFromBytes<int8_t>(arg);
+            break;
+        case CONSTANT_16:
+            value = ReadFromBytes<int16_t>(arg);
+            break;
+        default:
+            return std::string();
+    }
+    return value == INT32_MIN ? std::string("INT32_MIN") : std::to_string(value);
+}
+
+std::string Translator::Goto(int target) const {
+    if (target >= 0 && target < static_cast<int>(leaders.size()) && leaders[target]) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "goto L_%04x;", target);
+        return buffer;
+    }
+    // Not an instruction of the program, dispatch will raise SIGILL
+    return "{ ip = " + std::to_string(target) + "; goto dispatch; }";
+}
+
+void Translator::EmitStackCheckBefore(const DecodedInstruction &d) {
+    if (stack_checks && d.inst->stack_pops > 0) {
+        Emit("    if (stack_base - sp < %d) { rt.Raise(Emulator::SIGNAL_SIGSEGV, %d, sp); return; }\n",
+             d.inst->stack_pops, d.address);
+    }
+}
+
+std::string Translator::StackCheckAfter(const DecodedInstruction &d, int ip) const {
+    const Instruction& inst = *d.inst;
+    // Values which the instruction pops were checked before it, so only a growing stack can leave its bounds
+    bool known = inst.stack_pops >= 0 && inst.stack_pushes >= 0;
+    if (!stack_checks || (known && inst.stack_pushes <= inst.stack_pops)) {
+        return std::string();
+    }
+    return "if (sp < stack_limit || sp > stack_base) { rt.Raise(Emulator::SIGNAL_SIGSEGV, " + std::to_string(ip) +
+           ", sp); return; } ";
+}
+
+void Translator::EmitFallback(const DecodedInstruction &d) {
+    Emit("    FRIDAY_FALLBACK(%d);\n", d.address);
+}
+
+bool Translator::EmitInstruction(const DecodedInstruction &d) {
+    const Instruction& inst = *d.inst;
+    std::string_view name = inst.name;
+    int next = d.address + static_cast<int>(inst.inst_full_size);
+    std::string jump = Goto(d.jump_target);
+
+    if (inst.flow == FLOW_SPAWN || name == "join") {
+        printf("error: instruction '%s' at 0x%04x: threads are not supported by friday-aot, use friday-emu\n",
+               inst.name, d.address);
+        return false;
+    }
+
+    if (name == "end") {
+        Emit("    return;\n");
+    } else if (name == "push" && inst.args_count == 1) {
+        Emit("    Push(mem, sp, %s);\n", Operand(d, 0).c_str());
+    } else if (name == "pop" && inst.args_count == 1) {
+        Emit("    %s = Pop(mem, sp);\n", Operand(d, 0).c_str());
+    } else if (name == "dep") {
+        Emit("    Push(mem, sp, %d); %s\n", next, StackCheckAfter(d, next).c_str());
+    } else if (name == "call") {
+        Emit("    Push(mem, sp, %d); %s%s\n", next, StackCheckAfter(d, d.jump_target).c_str(), jump.c_str());
+    } else if (name == "ret") {
+        Emit("    ip = Pop(mem, sp); goto dispatch;\n");
+    } else if (name == "jmp") {
+        Emit("    %s\n", jump.c_str());
+    } else if (name == "ci2f") {
+        Emit("    Push(mem, sp, AsInt(static_cast<float>(Pop(mem, sp))));\n");
+    } else if (name == "cf2i") {
+        Emit("    Push(mem, sp, static_cast<int32_t>(AsFloat(Pop(mem, sp))));\n");
+    } else if (name == "sqrt") {
+        Emit("    Push(mem, sp, AsInt(static_cast<float>(std::sqrt(AsFloat(Pop(mem, sp))))));\n");
+    } else if (name == "dup") {
+        Emit("    Push(mem, sp, Peek(mem, sp, 0));\n");
+    } else if (name == "over") {
+        Emit("    Push(mem, sp, Peek(mem, sp, 1));\n");
+    } else if (name == "drop") {
+        Emit("    sp += 4;\n");
+    } else if (name == "swap") {
+        Emit("    { int32_t b = Pop(mem, sp); int32_t a = Pop(mem, sp); Push(mem, sp, b); Push(mem, sp, a); }\n");
+    } else if (IntOperation(name) != nullptr || IntOperation(WithoutFloatSuffix(name)) != nullptr) {
+        bool is_float = IntOperation(name) == nullptr;
+        const char* op = is_float ? IntOperation(WithoutFloatSuffix(name)) : IntOperation(name);
+        if (inst.args_count == 0) {
+            Emit("    { int32_t b = Pop(mem, sp); int32_t a = Pop(mem, sp); ");
+            if (is_float) {
+                Emit("Push(mem, sp, AsInt(AsFloat(a) %s AsFloat(b))); }\n", op);
+            } else {
+                Emit("Push(mem, sp, a %s b); }\n", op);
+            }
+        } else {
+            std::string target = Operand(d, 0);
+            std::string operand = Operand(d, 1);
+            if (is_float) {
+                Emit("    %s = AsInt(AsFloat(%s) %s AsFloat(%s));\n", target.c_str(), target.c_str(), op,
+                     operand.c_str());
+            } else {
+                Emit("    %s = %s %s %s;\n", target.c_str(), target.c_str(), op, operand.c_str());
+            }
+        }
+    } else if (IntCondition(name) != nullptr || IntCondition(WithoutFloatSuffix(name)) != nullptr) {
+        bool is_float = IntCondition(name) == nullptr;
+        const char* condition = is_float ? IntCondition(WithoutFloatSuffix(name)) : IntCondition(name);
+        if (inst.args_count == 1) {
+            Emit("    { int32_t b = Pop(mem, sp); int32_t a = Pop(mem, sp); ");
+            if (is_float) {
+                Emit("if (AsFloat(a) %s AsFloat(b)) %s }\n", condition, jump.c_str());
+            } else {
+                Emit("if (a %s b) %s }\n", condition, jump.c_str());
+            }
+        } else {
+            Emit("    if (%s %s %s) %s\n", Operand(d, 0).c_str(), condition, Operand(d, 1).c_str(), jump.c_str());
+        }
+    } else if ((name == "ld" || name == "st" || name == "ldb" || name == "stb") && inst.args_count == 2) {
+        // Same checks as InstLoad and InstStore
+        bool is_byte = name.back() == 'b';
+        std::string bad_address = "!InMemory(address, " + std::to_string(is_byte ? 1 : 4) + ")";
+        if (name[0] == 's' && code_protected) {
+            bad_address += " || static_cast<uint32_t>(address) < " + std::to_string(code_size) + "u";
+        }
+        Emit("    { int32_t address = %s + %s; if (%s) { rt.Raise(Emulator::SIGNAL_SIGSEGV, %d, sp); return; } ",
+             Operand(d, 0).c_str(), Operand(d, 1).c_str(), bad_address.c_str(), next);
+        if (name[0] == 'l') {
+            Emit(is_byte ? "Push(mem, sp, static_cast<uint8_t>(mem[address])); }\n"
+                         : "int32_t value; std::memcpy(&value, mem + address, 4); Push(mem, sp, value); }\n");
+        } else {
+            Emit(is_byte ? "mem[address] = static_cast<char>(Pop(mem, sp)); }\n"
+                         : "int32_t value = Pop(mem, sp); std::memcpy(mem + address, &value, 4); }\n");
+        }
+    } else {
+        EmitFallback(d);
+    }
+    return true;
+}
+
+void Translator::EmitProgramBytes() {
+    Emit("static const unsigned char PROGRAM[] = {");
+    for (int i = 0; i < code_size; ++i) {
+        Emit(i % 16 == 0 ? "\n    0x%02x," : " 0x%02x,", static_cast<uint8_t>(code[i]));
+    }
+    Emit("\n};\n\n");
+}
+
+bool Translator::Translate(bool shared_object, std::string &result) {
+    if (!DecodeProgram(code, code_size, decoded)) {
+        int address = decoded.empty() ? HEADER_SIZE : decoded.back().address + decoded.back().inst->inst_full_size;
+        printf("error: cannot decode instruction at 0x%04x, the program may contain data after code\n", address);
+        return false;
+    }
+    auto blocks = SplitIntoBasicBlocks(decoded);
+    leaders.assign(code_size + 1, false);
+    for (auto& block : blocks) {
+        leaders[decoded[block.first].address] = true;
+    }
+    // AotRuntime loads the program into an emulator of MEMORY_SIZE bytes, which decides the same way
+    // (Emulator::VerifyLoadedProgram)
+    VerifiedProgram verification = VerifyProgram(code, code_size);
+    code_protected = verification.ok;
+    stack_checks = !verification.ok || verification.stack_bound < 0 ||
+                   verification.stack_bound > Emulator::MEMORY_SIZE - 1 - code_size;
+
+    Emit("// Generated by friday-aot\n"
+         "#include \"AotRuntime.hpp\"\n"
+         "#include <cmath>\n"
+         "#include <cstdint>\n"
+         "#include <cstring>\n\n"
+         "using namespace FridayArch;\n"
+         "using namespace FridayArch::Aot;\n\n");
+    EmitProgramBytes();
+
+    // Registers are passed to the emulator in a temporary array, so locals r0..r7 never escape
+    Emit("#define FRIDAY_FALLBACK(address) {                                       \\\n"
+         "    int32_t regs[] = {r0, r1, r2, r3, r4, r5, r6, r7};                  \\\n"
+         "    sp = rt.Execute(address, regs, sp);                                 \\\n"
+         "    if (rt.Stopped()) return;                                           \\\n"
+         "    r0 = regs[0]; r1 = regs[1]; r2 = regs[2]; r3 = regs[3];             \\\n"
+         "    r4 = regs[4]; r5 = regs[5]; r6 = regs[6]; r7 = regs[7];             \\\n"
+         "}\n\n");
+    static_assert(MAX_REGISTER_INDEX == 8);
+
+    Emit("static void Body(AotRuntime& rt) {\n"
+         "    char* const mem = rt.emu.mem;\n"
+         "    int32_t sp = rt.emu.sp;\n"
+         "    int32_t r0 = 0, r1 = 0, r2 = 0, r3 = 0, r4 = 0, r5 = 0, r6 = 0, r7 = 0;\n"
+         "    int32_t ip = 0;\n");
+    if (stack_checks) {
+        Emit("    const int32_t stack_base = rt.emu.stack_base, stack_limit = rt.emu.stack_limit;\n");
+    }
+    Emit("\n");
+
+    for (auto& block : blocks) {
+        Emit("L_%04x:\n", decoded[block.first].address);
+        for (int i = block.first; i <= block.last; ++i) {
+            const DecodedInstruction& d = decoded[i];
+            EmitStackCheckBefore(d);
+            if (!EmitInstruction(d)) {
+                return false;
+            }
+            if (d.inst->flow == FLOW_NEXT) {
+                std::string check = StackCheckAfter(d, d.address + static_cast<int>(d.inst->inst_full_size));
+                if (!check.empty()) {
+                    check.pop_back();  // The space before the next statement
+                    Emit("    %s\n", check.c_str());
+                }
+            }
+        }
+    }
+    // After the code memory is zero, that is 'end'
+    Emit("    return;\n\n");
+
+    Emit("dispatch:\n"
+         "    switch (ip) {\n");
+    for (auto& block : blocks) {
+        Emit("        case %d: goto L_%04x;\n", decoded[block.first].address, decoded[block.first].address);
+    }
+    Emit("    }\n"
+         "    rt.Raise(Emulator::SIGNAL_SIGILL, ip, sp);\n"
+         "}\n\n");
+
+    Emit(shared_object ? "extern \"C\" int friday_aot_main() {\n" : "int main() {\n");
+    Emit("    return RunAotProgram(reinterpret_cast<const char*>(PROGRAM), sizeof(PROGRAM), Body);\n"
+         "}\n");
+
+    result = std::move(out);
+    return true;
+}
+
+}
+//#################################################################################################
+
+
+// Запускает компилятор и ждет его завершения. Возвращает false, если компиляция не удалась
+static bool RunCompiler(const AotArgs& args, const char* cpp_filename) {
+    const char* compiler = args.compiler;
+    if (compiler == nullptr) {
+        compiler = getenv("CXX") != nullptr ? getenv("CXX") : "c++";
+    }
+
+    std::vector<const char*> argv = {compiler, "-std=c++17", "-O2", "-fwrapv", "-I", FRIDAY_AOT_INCLUDE_DIR};
+    if (args.shared_object) {
+        argv.push_back("-shared");
+        argv.push_back("-fPIC");
+    }
+    argv.insert(argv.end(), {cpp_filename, FRIDAY_AOT_RUNTIME, "-pthread", "-o", args.output_filename, nullptr});
+
+    pid_t pid;
+    int error = posix_spawnp(&pid, compiler, nullptr, nullptr, const_cast<char**>(argv.data()), environ);
+    if (error != 0) {
+        printf("error: cannot run compiler '%s': %s\n", compiler, strerror(error));
+        return false;
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("error: compiler '%s' failed\n", compiler);
+        return false;
+    }
+    return true;
+}
+
+static bool EndsWith(std::string_view text, std::string_view suffix) {
+    return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
+
+static bool TranslateFile(const char* filename, const AotArgs& args, const char* cpp_filename) {
+    FileHelper::MappedFile file;
+    try {
+        file = FileHelper::MappedFile(filename);
+    } catch (const std::exception& exc) {
+        FileHelper::PrintErrorWorkingWithFile(filename, "reading", exc);
+        return false;
+    }
+    if (static_cast<int>(file.size()) < HEADER_SIZE || !CheckForFRDY(file.data())) {
+        printf("error: file '%s' is not a .friday executable\n", filename);
+        return false;
+    }
+    auto version = ReadFromBytes<int16_t>(file.data(), HEADER_ASM_VER_OFFSET);
+    if (version > ARCH_VERSION) {
+        printf("error: file '%s' is compiled for arch version %d, but friday-aot supports up to %d\n",
+               filename, version, ARCH_VERSION);
+        return false;
+    }
+    // Registers of the generated code are the locals r0..r7
+    auto registers = ReadFromBytes<friday_reg_t>(file.data(), HEADER_REG_COUNT_OFFSET);
+    if (registers > MAX_REGISTER_INDEX) {
+        printf("error: file '%s' has %d registers, but friday-aot supports up to %d\n", filename, registers,
+               MAX_REGISTER_INDEX);
+        return false;
+    }
+
+    std::string cpp;
+    if (!Translator(file.data(), static_cast<int>(file.size())).Translate(args.shared_object, cpp)) {
+        return false;
+    }
+    try {
+        FileHelper::WriteFileInBinary(cpp_filename, std::vector<char>(cpp.begin(), cpp.end()));
+    } catch (const std::exception& exc) {
+        FileHelper::PrintErrorWorkingWithFile(cpp_filename, "writing to", exc);
+        return false;
+    }
+    return true;
+}
+
+bool CompileAheadOfTime(const AotArgs &args) {
+    // Intermediate files (assembled program, generated C++) live in a temporary directory
+    char temp_dir[] = "/tmp/friday-aot-XXXXXX";
+    if (mkdtemp(temp_dir) == nullptr) {
+        printf("error: cannot create temporary directory: %s\n", strerror(errno));
+        return false;
+    }
+    std::string program = args.input_files[0];
+    std::string cpp = args.only_cpp ? args.output_filename : std::string(temp_dir) + "/program.cpp";
+
+    bool ok = true;
+    if (EndsWith(program, ".s")) {
+        AssemblerArgs asm_args;
+        program = std::string(temp_dir) + "/program.friday";
+        asm_args.output_filename = program.c_str();
+        asm_args.input_files = args.input_files;
+        ok = AssemblyAndLink(asm_args);
+    } else if (args.input_files.size() > 1) {
+        printf("error: only one .friday program can be compiled\n");
+        ok = false;
+    }
+
+    ok = ok && TranslateFile(program.c_str(), args, cpp.c_str());
+    ok = ok && (args.only_cpp || RunCompiler(args, cpp.c_str()));
+
+    unlink((std::string(temp_dir) + "/program.friday").c_str());
+    unlink((std::string(temp_dir) + "/program.cpp").c_str());
+    rmdir(temp_dir);
+    return ok;
+}
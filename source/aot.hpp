@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#ifdef FRIDAY_AOT_MAIN
+// Установите этот макрос, чтобы скомпилировать точку входа
+int main(int argc, char** argv);
+#endif
+
+// Параметры, необходимые для запуска AOT-компилятора
+typedef struct AotArgs {
+    const char* output_filename = nullptr;  // По умолчанию a.out, a.so или a.cpp
+    const char* compiler = nullptr;         // Компилятор C++, nullptr -- $CXX или c++
+    bool shared_object = false;             // Собрать .so с функцией friday_aot_main вместо исполняемого файла
+    bool only_cpp = false;                  // Только сгенерировать C++ в output_filename, не вызывая компилятор
+    std::vector<char*> input_files;         // Один .friday или несколько .s, которые сначала собираются ассемблером
+
+    bool _bad_syntax = false;
+
+    AotArgs() = default;
+} AotArgs;
+
+AotArgs ParseAotArgs(int argc, char** argv);
+void PrintAotHelp();
+
+// Возвращает false в случае ошибки (она уже напечатана)
+bool CompileAheadOfTime(const AotArgs& args);
@@ -0,0 +1,170 @@
+#include "asm_bench.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "assembler_inside_facade.hpp"
+
+#ifdef FRIDAY_ASM_BENCH_MAIN
+int main(int argc, char** argv) {
+    auto args = ParseAsmBenchArgs(argc, argv);
+    if (args._bad_syntax) {
+        PrintAsmBenchHelp();
+        return 0;
+    }
+    return RunAsmBench(args) ? 0 : 1;
+}
+#endif
+
+// Сколько инструкций в сгенерированном исходнике: его код должен поместиться в адресное пространство, поэтому
+// остальное -- строки комментариев, как у генератора кода, который подписывает каждое значение
+const static int GENERATED_INSTRUCTIONS = 12000;
+const static int INSTRUCTIONS_PER_BLOCK = 64;
+const static size_t GENERATOR_BUFFER_SIZE = 1024 * 1024;
+
+AsmBenchArgs ParseAsmBenchArgs(int argc, char **argv) {
+    AsmBenchArgs result;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-O") == 0) {
+            result.optimize = true;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            result.size_mb = atoll(argv[++i]);
+            if (result.size_mb <= 0) {
+                printf("error: expected positive size in megabytes after '-s' argument\n");
+                result._bad_syntax = true;
+                return result;
+            }
+        } else {
+            printf("error: unknown argument '%s'\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+    }
+    return result;
+}
+
+void PrintAsmBenchHelp() {
+    printf("friday-asm-bench [-s <megabytes>] [-O]\n"
+           "Generate synthetic assembly, pipe it into the streaming assembler and print lines/sec and peak RSS\n"
+           "-s : size of the generated source, default is 2048 MB\n"
+           "-O : same as for friday-asm\n");
+}
+
+static bool WriteAll(int fd, const std::string& text) {
+    for (size_t written = 0; written < text.size();) {
+        ssize_t length = write(fd, text.data() + written, text.size() - written);
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            return false;
+        }
+        written += length;
+    }
+    return true;
+}
+
+// index-я инструкция сгенерированного исходника. Блоки по INSTRUCTIONS_PER_BLOCK инструкций начинаются меткой и
+// заканчиваются переходом к следующему блоку, внутри -- идиомы стековой машины
+static void AppendInstruction(int index, std::string& text) {
+    char line[64];
+    int block = index / INSTRUCTIONS_PER_BLOCK;
+    int position = index % INSTRUCTIONS_PER_BLOCK;
+    if (position == 0) {
+        snprintf(line, sizeof(line), "block_%d:\n", block);
+    } else if (position == INSTRUCTIONS_PER_BLOCK - 1) {
+        snprintf(line, sizeof(line), "    jmp block_%d  # next block\n", block + 1);
+    } else {
+        switch (position % 4) {
+            case 1: snprintf(line, sizeof(line), "    push r%d\n", position % 8); break;
+            case 2: snprintf(line, sizeof(line), "    push %d  # step\n", index % 100); break;
+            case 3: snprintf(line, sizeof(line), "    add\n"); break;
+            default: snprintf(line, sizeof(line), "    pop r%d\n", (position - 3) % 8); break;
+        }
+    }
+    text += line;
+}
+
+// Пишет в fd около size байт исходника и закрывает fd
+static void GenerateSource(int fd, int64_t size) {
+    const char* comments[] = {
+        "    # generated table entry: value is kept for the reader of the listing\n",
+        "\n",
+        "    #   source: synthetic input of friday-asm-bench, nothing to see here\n",
+        "        # indented comment with\ttabs and trailing spaces   \n",
+    };
+    const int64_t AVERAGE_LINE_LENGTH = 48;
+    int64_t lines = std::max<int64_t>(size / AVERAGE_LINE_LENGTH, GENERATED_INSTRUCTIONS);
+    int64_t lines_per_instruction = lines / GENERATED_INSTRUCTIONS;
+
+    std::string text = ".friday_asm\n";
+    text.reserve(GENERATOR_BUFFER_SIZE + 256);
+    int64_t written = 0;
+    int instructions = 0;
+    bool ok = true;
+    for (int64_t line = 0; ok && written + static_cast<int64_t>(text.size()) < size; ++line) {
+        if (line % lines_per_instruction == 0 && instructions < GENERATED_INSTRUCTIONS) {
+            AppendInstruction(instructions++, text);
+        } else {
+            text += comments[line % 4];
+        }
+        if (text.size() >= GENERATOR_BUFFER_SIZE) {
+            ok = WriteAll(fd, text);
+            written += static_cast<int64_t>(text.size());
+            text.clear();
+        }
+    }
+    // The last jump goes to the end
+    text += "block_" + std::to_string((instructions + INSTRUCTIONS_PER_BLOCK - 1) / INSTRUCTIONS_PER_BLOCK) +
+            ":\n    end\n";
+    if (ok) {
+        WriteAll(fd, text);
+    }
+    close(fd);
+}
+
+bool RunAsmBench(const AsmBenchArgs &args) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        printf("error: cannot create pipe: %s\n", strerror(errno));
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);  // The generator stops when the assembler fails
+    std::thread generator(GenerateSource, fds[1], args.size_mb * 1024 * 1024);
+
+    auto start = std::chrono::steady_clock::now();
+    CompactSource source;
+    bool ok = true;
+    try {
+        ReadCompactSource(fds[0], source);
+    } catch (const std::exception& exc) {
+        printf("error: cannot read generated source: %s\n", exc.what());
+        ok = false;
+    }
+    close(fds[0]);
+    generator.join();
+
+    TextLocation loc;
+    loc.SetFile("<generated>", &source.source_lines);
+    FridayAsmWriter writer(&loc);
+    writer.WriteHeader();
+    ok = ok && CompileAndLinkFile(source.text, loc, writer, args.optimize);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    printf("friday-asm-bench: %lld MB, %lld lines (%zu with code, %d bytes of code) in %.2f s\n"
+           "%.0f lines/s, %.0f MB/s, peak RSS %ld KB\n",
+           static_cast<long long>(args.size_mb), static_cast<long long>(source.lines_read),
+           source.source_lines.size(), writer.GetCurrentCodeOffset() - FridayArch::HEADER_SIZE, seconds,
+           source.lines_read / seconds, args.size_mb / seconds, usage.ru_maxrss);
+    return ok;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef FRIDAY_ASM_BENCH_MAIN
+// Установите этот макрос, чтобы скомпилировать точку входа
+int main(int argc, char** argv);
+#endif
+
+// Параметры замера скорости ассемблера
+typedef struct AsmBenchArgs {
+    int64_t size_mb = 2048;           // Размер сгенерированного исходника
+    bool optimize = false;            // -O, как у friday-asm
+
+    bool _bad_syntax = false;
+
+    AsmBenchArgs() = default;
+} AsmBenchArgs;
+
+AsmBenchArgs ParseAsmBenchArgs(int argc, char** argv);
+void PrintAsmBenchHelp();
+// Генерирует исходник, передает его ассемблеру через канал и печатает скорость и пиковую память. Возвращает false,
+// если исходник не собрался
+bool RunAsmBench(const AsmBenchArgs& args);
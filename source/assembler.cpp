@@ -11,7 +11,10 @@ int main(int argc, char* argv[]) {
         PrintAssemblerHelp();
         return 0;
     }
-    AssemblyAndLink(args);
+    if (args.watch) {
+        return WatchAndAssemble(args) ? 0 : 1;
+    }
+    return AssemblyAndLink(args) ? 0 : 1;
 }
 
 #endif
@@ -23,11 +26,19 @@ AssemblerArgs ParseAssemblerArgs(int argc, char **argv) {
     result.output_filename = "a.friday";
 
     int i = 1;
-    for (; i < argc; i += 2) {
-        if (argv[i][0] != '-') {
+    for (; i < argc; ++i) {
+        if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
             break;
         }
 
+        if (strcmp(argv[i], "-O") == 0) {
+            result.optimize = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--watch") == 0) {
+            result.watch = true;
+            continue;
+        }
         if (i + 1 >= argc) {
             printf("error: nothing after '%s' argument\n", argv[i]);
             result._bad_syntax = true;
@@ -35,12 +46,22 @@ AssemblerArgs ParseAssemblerArgs(int argc, char **argv) {
         }
         if (strcmp(argv[i], "-o") == 0) {
             result.output_filename = argv[i + 1];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            result.map_filename = argv[i + 1];
+        } else if (strcmp(argv[i], "--profile-use") == 0) {
+            result.profile_filename = argv[i + 1];
+        } else if (strcmp(argv[i], "--profile-train") == 0) {
+            result.train_input_filename = argv[i + 1];
         }
+        ++i;
     }
 
     result.input_files.reserve(argc - i);
+    int stdin_inputs = 0;
     for (; i < argc; ++i) {
-        if (argv[i][0] == '-') {
+        if (strcmp(argv[i], "-") == 0) {
+            ++stdin_inputs;
+        } else if (argv[i][0] == '-') {
             printf("error: parameter '%s' must be before input files list\n", argv[i]);
             result._bad_syntax = true;
             return result;
@@ -48,6 +69,23 @@ AssemblerArgs ParseAssemblerArgs(int argc, char **argv) {
         result.input_files.push_back(argv[i]);
     }
 
+    if (stdin_inputs > 1 || (stdin_inputs > 0 && result.watch)) {
+        printf("error: stdin ('-') can be read only once and cannot be watched\n");
+        result._bad_syntax = true;
+        return result;
+    }
+
+    if (result.profile_filename != nullptr && result.train_input_filename != nullptr) {
+        printf("error: --profile-use and --profile-train cannot be used together\n");
+        result._bad_syntax = true;
+        return result;
+    }
+    if (result.watch && (result.profile_filename != nullptr || result.train_input_filename != nullptr)) {
+        printf("error: --watch cannot be used with a profile\n");
+        result._bad_syntax = true;
+        return result;
+    }
+
     if (result.input_files.empty()) {
         printf("error: no files to compile\n");
         result._bad_syntax = true;
@@ -57,10 +95,23 @@ AssemblerArgs ParseAssemblerArgs(int argc, char **argv) {
 }
 
 void PrintAssemblerHelp() {
-    printf("friday-asm [-o <out_filename>] <main_file> [other files...]\n"
+    printf("friday-asm [-O] [--watch] [-o <out_filename>] [-m <map_filename>]\n"
+           "           [--profile-use <profile> | --profile-train <input>] <main_file> [other files...]\n"
            "Assembly and link .friday program\n"
            "-o : specify output filename, default is \"a.friday\"\n"
-           "<main_file>, [other files] : files to assembly. Code execution will start from first instruction of <main_file>\n");
+           "-O : rewrite stack idioms into register forms (push r0; push 1; add; pop r0 => add r0, 1)\n"
+           "     replace calls of small leaf functions with their bodies (see .inline and .noinline)\n"
+           "     and tail calls with jumps, self-recursive tail calls with loops\n"
+           "--watch : stay running and rebuild the program whenever input files change, re-assembling only changed files\n"
+           "-m : save addresses of all labels to <map_filename> (used by friday-objdump -m)\n"
+           "--profile-use : lay out basic blocks by <profile> (friday-emu --profile of the program built with the same\n"
+           "     files and options, but without a profile): the hottest successor of a block follows it, conditional\n"
+           "     jumps are inverted to fall through, blocks never executed are moved to the end of their file\n"
+           "--profile-train : build the program, run it with <input> as stdin to collect the profile, and build it\n"
+           "     again as with --profile-use. The output of the training run is discarded\n"
+           "<main_file>, [other files] : files to assembly. Code execution will start from first instruction of <main_file>\n"
+           "     '-' reads a file from stdin. Stdin, pipes and files over 64 MiB are read in chunks, without keeping\n"
+           "     comments and blank lines in memory\n");
 }
 //#################################################################################################
 
@@ -11,7 +11,14 @@ int main(int argc, char** argv);
 // Параметры, необходимые для запуска ассемблера
 typedef struct AssemblerArgs {
     const char *output_filename = nullptr;
+    const char *map_filename = nullptr;  // Куда сохранить таблицу меток, nullptr -- не сохранять
     std::vector<char*> input_files;
+    bool optimize = false;               // -O: заменять идиомы стековой машины регистровыми формами инструкций и
+                                         // встраивать маленькие функции, заменять хвостовые вызовы переходами
+    bool watch = false;                  // --watch: пересобирать программу при изменении входных файлов
+    const char *profile_filename = nullptr;      // --profile-use: размещать базовые блоки по этому профилю
+    const char *train_input_filename = nullptr;  // --profile-train: снять профиль, запустив программу с этим вводом
+    std::string *messages = nullptr;             // Куда копить сообщения компиляции, nullptr -- печатать
 
     bool _bad_syntax = false;
 
@@ -21,4 +28,18 @@ typedef struct AssemblerArgs {
 AssemblerArgs ParseAssemblerArgs(int argc, char **argv);
 void PrintAssemblerHelp();
 
+// Собирает программу из args.input_files. Если в файлах ошибки, возвращает false и не записывает программу
 bool AssemblyAndLink(const AssemblerArgs& args);
+// Собирает программу и пересобирает ее после каждого изменения входных файлов, заново компилируя только те, код
+// которых мог измениться. Программа совпадает с той, что собирает AssemblyAndLink.
+// Возвращает false, только если следить за файлами не удалось
+bool WatchAndAssemble(const AssemblerArgs& args);
+
+// Каталог кэша байт-кода: $FRIDAY_CACHE_DIR, иначе $XDG_CACHE_HOME/friday, иначе ~/.cache/friday
+std::string GetBytecodeCacheDirectory();
+// Ищет в кэше байт-кода программу, собранную из args.input_files с опциями args, а если ее нет -- собирает ее
+// AssemblyAndLink и атомарно кладет в кэш. Ключ -- хэш содержимого файлов, опций и исполняемого файла ассемблера.
+// Возвращает путь к программе или пустую строку, если сборка не удалась (сообщения компиляции тогда напечатаны).
+// cache_hit -- нашлась ли программа в кэше. Если в кэш записать нельзя, программа собирается во временный файл
+// вне его и temporary становится true: этот файл удаляет вызывающий
+std::string AssembleCached(const AssemblerArgs& args, bool& cache_hit, bool& temporary);
@@ -1,17 +1,34 @@
+#include <algorithm>
 #include <cassert>
 #include <cstdarg>
+#include <cctype>
+#include <cstring>
+#include <initializer_list>
 #include "assembler_inside_facade.hpp"
+#include "Emulator.hpp"
+#include "Profile.hpp"
+#include "utility/BytesHelper.hpp"
 #include "utility/FileHelper.hpp"
 
 using namespace FridayArch;
 
-std::vector<std::string_view> SplitLine(const char *line, int& index) {
+std::vector<std::string_view> SplitLine(std::string_view text, int& index) {
     std::vector<std::string_view> result;
 
+    const char* line = text.data();
+    int length = static_cast<int>(text.size());
     int word_start = -1;
     bool comment = false;
 
     for (; true; ++index) {
+        if (index >= length) {
+            // Text is not required to end with '\0' (it may be a mapped file)
+            if (!comment && word_start != -1) {
+                result.emplace_back(line + word_start, index - word_start);
+            }
+            break;
+        }
+
         if (!comment) {
             bool word_ended = !isgraph(line[index]);
             if (line[index] == '#') {
@@ -36,12 +53,107 @@ std::vector<std::string_view> SplitLine(const char *line, int& index) {
     return result;
 }
 
-bool CompileAndLinkFile(const char* file, TextLocation& loc, FridayAsmWriter& writer, bool now_linking) {
+bool IsRegisterWord(std::string_view word) {
+    if (word.size() < 2 || word[0] != 'r') {
+        return false;
+    }
+    for (size_t i = 1; i < word.size(); ++i) {
+        if (!isdigit(word[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Второй операнд регистровой формы: регистр или число
+static bool IsOperandWord(std::string_view word) {
+    return IsRegisterWord(word) || isdigit(word[0]) || word[0] == '-' || word[0] == '+' || word[0] == '.';
+}
+
+static bool IsOneOf(std::string_view word, std::initializer_list<std::string_view> names) {
+    for (auto& name : names) {
+        if (word == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Читает до count строк-инструкций после строки, которая заканчивается в index. Пустые строки пропускаются, а метки,
+// дот-команды и аргументы через запятую прерывают чтение: через них идиома не склеивается. В ends для каждой
+// прочитанной строки записывается индекс ее конца
+static std::vector<std::vector<std::string_view>> PeekInstructions(std::string_view file, int index, int count,
+                                                                   std::vector<int>& ends) {
+    std::vector<std::vector<std::string_view>> result;
+    while (static_cast<int>(result.size()) < count) {
+        ++index;  // Skip '\n'
+        if (index >= static_cast<int>(file.size()) || file[index] == '\0') {
+            break;
+        }
+        auto line = SplitLine(file, index);
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0][0] == '.' || line[0].back() == ':') {
+            break;
+        }
+        for (auto& word : line) {
+            if (word.back() == ',') {
+                return result;
+            }
+        }
+        result.push_back(std::move(line));
+        ends.push_back(index);
+    }
+    return result;
+}
+
+int FuseStackIdiom(std::string_view file, int index, std::vector<std::string_view>& line) {
+    if (line.size() != 2 || line[0] != "push") {
+        return index;
+    }
+    std::vector<int> ends;
+    auto next = PeekInstructions(file, index, 3, ends);
+    if (next.size() < 2 || next[0].size() != 2 || next[0][0] != "push") {
+        return index;
+    }
+    std::string_view first = line[1];
+    std::string_view second = next[0][1];
+
+    // push rX; push Y; jCC LABEL  =>  jCC rX, Y, LABEL
+    if (next[1].size() == 2 && IsOneOf(next[1][0], {"ja", "jae", "jb", "jbe", "je", "jne"}) &&
+        IsRegisterWord(first) && IsOperandWord(second)) {
+        line = {next[1][0], first, second, next[1][1]};
+        return ends[1];
+    }
+
+    // push rX; push Y; op; pop rX  =>  op rX, Y  (and push Y; push rX; op; pop rX, if op is commutative)
+    if (next.size() < 3 || next[1].size() != 1 || next[2].size() != 2 || next[2][0] != "pop") {
+        return index;
+    }
+    std::string_view op = next[1][0];
+    std::string_view target = next[2][1];
+    if (!IsRegisterWord(target) || !IsOneOf(op, {"add", "sub", "mul", "div", "mod", "addf", "subf", "mulf", "divf"})) {
+        return index;
+    }
+    if (first == target && IsOperandWord(second)) {
+        line = {op, target, second};
+        return ends[2];
+    }
+    if (second == target && IsOperandWord(first) && IsOneOf(op, {"add", "mul", "addf", "mulf"})) {
+        line = {op, target, first};
+        return ends[2];
+    }
+    return index;
+}
+
+// Один проход по файлу. Без линковки только вычисляет адреса меток, с линковкой -- записывает итоговый код
+static bool CompileFilePass(std::string_view file, TextLocation& loc, FridayAsmWriter& writer, bool now_linking,
+                            bool fuse_stack_idioms) {
     int index = 0;
-    friday_address_t cur_code_offset = writer.GetCurrentCodeOffset();
 
     // In each iteration of cycle is only one line read
-    for (; file[index] != '\0';) {
+    for (; index < static_cast<int>(file.size()) && file[index] != '\0';) {
         auto line = SplitLine(file, index);
 
         if (line.empty()) {
@@ -55,7 +167,9 @@ bool CompileAndLinkFile(const char* file, TextLocation& loc, FridayAsmWriter& wr
             // Label
             line[0].remove_suffix(1);  // Remove ':'
             if (!now_linking) {
-                writer.RegisterLabelAtCurrentOffset(line[0]);
+                if (!writer.RegisterLabelAtCurrentOffset(line[0])) {
+                    return false;
+                }
             } else {
                 assert(writer.GetLabelAddress(line[0]) == writer.GetCurrentCodeOffset());
             }
@@ -64,17 +178,28 @@ bool CompileAndLinkFile(const char* file, TextLocation& loc, FridayAsmWriter& wr
 
             // Сначала обработает аргументы: удалим символы запятой
             bool last_was_comma = false;
-            for (int i = 1; i < line.size(); ++i) {
-                if (line[i][line[i].size() - 1] == ',') {
+            for (size_t i = 1; i < line.size(); ++i) {
+                bool has_comma = line[i][line[i].size() - 1] == ',';
+                if (has_comma) {
+                    line[i].remove_suffix(1);
+                }
+                if (line[i].empty()) {
+                    // Comma separated by spaces
                     if (last_was_comma) {
                         loc.PrintCompileMessage("error: argument expected after comma");
                         return false;
                     }
-                    last_was_comma = true;
-                    line[i].remove_suffix(1);
-                    if (line[i].empty()) {
-                        line.erase(line.begin() + i);
-                        --i;
+                    line.erase(line.begin() + i);
+                    --i;
+                }
+                last_was_comma = has_comma;
+            }
+
+            if (fuse_stack_idioms) {
+                int idiom_end = FuseStackIdiom(file, index, line);
+                for (; index < idiom_end; ++index) {
+                    if (file[index] == '\n') {
+                        loc.IncLine();
                     }
                 }
             }
@@ -95,13 +220,45 @@ bool CompileAndLinkFile(const char* file, TextLocation& loc, FridayAsmWriter& wr
         ++index;
     }
 
-    if (now_linking) {
-        return true;
-    } else {
-        writer.RemoveCodeFrom(cur_code_offset);
+    return true;
+}
+
+// Проходы компиляции по тексту, в котором уже раскрыты макросы
+static bool CompileFilePasses(std::string_view file, TextLocation& loc, FridayAsmWriter& writer,
+                              bool fuse_stack_idioms) {
+    friday_address_t file_start = writer.GetCurrentCodeOffset();
+    writer.BeginFile();
+
+    // Проходы без линковки повторяются, пока длина переходов не перестанет меняться
+    do {
+        writer.BeginPass(file_start);
         loc.ResetFile();
-        return CompileAndLinkFile(file, loc, writer, true);
+        if (!CompileFilePass(file, loc, writer, false, fuse_stack_idioms)) {
+            return false;
+        }
+    } while (writer.WidenFarShortJumps());
+
+    writer.BeginPass(file_start);
+    loc.ResetFile();
+    return CompileFilePass(file, loc, writer, true, fuse_stack_idioms);
+}
+
+bool CompileAndLinkFile(std::string_view file, TextLocation& loc, FridayAsmWriter& writer, bool optimize,
+                        BlockLayout* layout) {
+    if (layout == nullptr && !NeedsExpansion(file, optimize)) {
+        return CompileFilePasses(file, loc, writer, optimize);
+    }
+
+    // Lines of the expanded text are mapped to lines of the source, so loc reports them while compiling it
+    CompactSource expanded;
+    if (!ExpandMacrosAndOptimize(file, loc, optimize, expanded, layout)) {
+        return false;
     }
+    const std::vector<int>* file_lines = loc.source_lines;
+    loc.source_lines = &expanded.source_lines;
+    bool ok = CompileFilePasses(expanded.text, loc, writer, optimize);
+    loc.source_lines = file_lines;
+    return ok;
 }
 
 bool CompileDotCommand(const std::vector<std::string_view> &line, TextLocation &loc, FridayAsmWriter& writer) {
@@ -125,7 +282,7 @@ bool CompileDotCommand(const std::vector<std::string_view> &line, TextLocation &
         char* bad_ptr = nullptr;
         std::string arg_str(line[1]);
         int regs_value = strtol(arg_str.c_str(), &bad_ptr, 10);
-        if (regs_value < 0 || regs_value > MAX_REGISTER_INDEX) {
+        if (regs_value < 0 || regs_value > static_cast<int>(MAX_REGISTER_INDEX)) {
             loc.PrintCompileMessage("error: invalid number of registers: %d. Excepted a key between 0 and %d",
                                 regs_value, MAX_REGISTER_INDEX);
             return false;
@@ -137,6 +294,8 @@ bool CompileDotCommand(const std::vector<std::string_view> &line, TextLocation &
         }
         writer.SetCustomRegistersCount(regs_value);
         loc.PrintCompileMessage("warning: using .registers dot-command is not recommended\n");
+    } else if (line[0] == ".inline" || line[0] == ".noinline") {
+        // Hints for the function after them, only ExpandMacrosAndOptimize reads them
     } else {
         loc.PrintCompileMessage("error: unknown .%.*s dot-command", line[0].size(), line[0].data());
         return false;
@@ -145,46 +304,139 @@ bool CompileDotCommand(const std::vector<std::string_view> &line, TextLocation &
     return true;
 }
 
+// Собирает программу с метками блоков (код тот же, что и без размещения) и заполняет layout.counts по профилю
+// этой сборки: из файла args.profile_filename или снятому ее запуском на вводе args.train_input_filename
+static bool CountBlocksByProfile(const AssemblerArgs& args, const std::vector<AsmSource>& sources,
+                                 BlockLayout& layout) {
+    std::string messages;  // The final build prints the same warnings again
+    TextLocation loc;
+    loc.messages = &messages;
+    FridayAsmWriter writer(&loc);
+    bool ok = true;
+
+    writer.WriteHeader();
+    for (const AsmSource& source : sources) {
+        loc.SetFile(source.name, source.streamed ? &source.compact.source_lines : nullptr);
+        ok &= CompileAndLinkFile(source.text(), loc, writer, args.optimize, &layout);
+    }
+    if (!ok) {
+        printf("%s", messages.c_str());
+        return false;
+    }
+
+    const std::vector<char>& image = writer.GetBytecode();
+    Profile profile(image.size());
+    const char* profile_source = args.profile_filename != nullptr ? args.profile_filename
+                                                                  : args.train_input_filename;
+    try {
+        if (args.profile_filename != nullptr) {
+            profile.Load(args.profile_filename);
+        } else {
+            int signal = TrainProgram(image, args.train_input_filename, profile);
+            if (signal != Emulator::SIGNAL_EXIT) {
+                printf("warning: training run stopped with signal %d, its profile is used anyway\n", signal);
+            }
+        }
+    } catch (const std::exception& exc) {
+        FileHelper::PrintErrorWorkingWithFile(profile_source, "reading", exc);
+        return false;
+    }
+
+    if (!CountBlocks(image, writer.GetSymbolMap(), profile, layout)) {
+        printf("warning: profile '%s' is not of this program built without --profile-use, "
+               "blocks are left in place\n", profile_source);
+        layout.counts.clear();
+    }
+    layout.reorder = true;
+    layout.next_block = 0;
+    return true;
+}
+
 bool AssemblyAndLink(const AssemblerArgs &args) {
     assert(!args._bad_syntax);
 
     TextLocation loc;
+    loc.messages = args.messages;
     FridayAsmWriter writer(&loc);
+    bool ok = true;
 
     writer.WriteHeader();
 
-    for (char* filename : args.input_files) {
-        std::string file_;
-        try {
-            file_ = FileHelper::ReadFileFully(filename);
-        } catch (const std::exception& exc) {
-            FileHelper::PrintErrorWorkingWithFile(filename, "reading", exc);
+    if (args.profile_filename != nullptr || args.train_input_filename != nullptr) {
+        // The program is built twice, so all files are read first: stdin cannot be read again
+        std::vector<AsmSource> sources(args.input_files.size());
+        for (size_t i = 0; i < sources.size(); ++i) {
+            try {
+                ReadAsmSource(args.input_files[i], sources[i]);
+            } catch (const std::exception& exc) {
+                FileHelper::PrintErrorWorkingWithFile(args.input_files[i], "reading", exc);
+                return false;
+            }
+        }
+        BlockLayout layout;
+        if (!CountBlocksByProfile(args, sources, layout)) {
             return false;
         }
+        for (const AsmSource& source : sources) {
+            loc.SetFile(source.name, source.streamed ? &source.compact.source_lines : nullptr);
+            ok &= CompileAndLinkFile(source.text(), loc, writer, args.optimize, &layout);
+        }
+    } else {
+        for (char* filename : args.input_files) {
+            AsmSource source;
+            try {
+                ReadAsmSource(filename, source);
+            } catch (const std::exception& exc) {
+                FileHelper::PrintErrorWorkingWithFile(filename, "reading", exc);
+                return false;
+            }
 
-        const char* file = file_.c_str();
-        loc.SetFile(filename);
-        CompileAndLinkFile(file, loc, writer, false);
+            loc.SetFile(source.name, source.streamed ? &source.compact.source_lines : nullptr);
+            ok &= CompileAndLinkFile(source.text(), loc, writer, args.optimize);
+        }
     }
 
+    // As with --watch, a program with errors is not written: the previous one stays in place
+    if (!ok) {
+        return false;
+    }
     writer.WriteToFile(args.output_filename);
+    if (args.map_filename != nullptr) {
+        try {
+            writer.GetSymbolMap().Save(args.map_filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.map_filename, "writing to", exc);
+        }
+    }
     return true;
 }
 
 void TextLocation::PrintCompileMessage(const char *text, ...) {
-    printf("%s:%d  ", filename, line);
+    std::string message = std::string(filename) + ":" + std::to_string(SourceLine()) + "  ";
 
-    // Pass arguments to vfprintf
+    // Pass arguments to vsnprintf, the second time into the string of the right size
     va_list argptr;
     va_start(argptr, text);
-    vfprintf(stdout, text, argptr);
+    va_list copy;
+    va_copy(copy, argptr);
+    int length = vsnprintf(nullptr, 0, text, copy);
+    va_end(copy);
+    size_t prefix_length = message.size();
+    message.resize(prefix_length + std::max(length, 0) + 1);
+    vsnprintf(message.data() + prefix_length, message.size() - prefix_length, text, argptr);
     va_end(argptr);
+    message.back() = '\n';
 
-    printf("\n");
+    if (messages != nullptr) {
+        *messages += message;
+    } else {
+        fwrite(message.data(), 1, message.size(), stdout);
+    }
 }
 
-void TextLocation::SetFile(const char *filename) {
+void TextLocation::SetFile(const char *filename, const std::vector<int>* source_lines) {
     this->filename = filename;
+    this->source_lines = source_lines;
     line = 1;
 }
 
@@ -195,3 +447,10 @@ void TextLocation::IncLine() {
 void TextLocation::ResetFile() {
     line = 1;
 }
+
+int TextLocation::SourceLine() const {
+    if (source_lines == nullptr || source_lines->empty() || line < 1) {
+        return line;
+    }
+    return (*source_lines)[std::min<size_t>(line, source_lines->size()) - 1];
+}
@@ -1,33 +1,127 @@
 #pragma once
 
+#include <unordered_map>
+
 #include "assembler.hpp"
 #include "utility/StringHashTable.hpp"
 #include "friday_asm_lang.hpp"
+#include "SymbolMap.hpp"
+#include "utility/FileHelper.hpp"
+
+namespace FridayArch {
+class Profile;
+}
 
-std::vector<std::string_view> SplitLine(const char* line, int& index);
+std::vector<std::string_view> SplitLine(std::string_view text, int& index);
+// Слово вида rN
+bool IsRegisterWord(std::string_view word);
 
 // Класс, знающий, какую строчку мы сейчас компилируем, и умеющий печатать текст ошибки
 struct TextLocation {
     const char* filename = nullptr;
     int line = -1;
+    // Если компилируется сжатый текст (CompactSource) -- номера строк исходника для его строк
+    const std::vector<int>* source_lines = nullptr;
+    std::string* messages = nullptr;  // Куда копить сообщения компиляции, nullptr -- печатать в stdout
 
-    void SetFile(const char* filename);
+    void SetFile(const char* filename, const std::vector<int>* source_lines = nullptr);
     void IncLine();
     void ResetFile();
+    // Номер строки в исходном файле
+    int SourceLine() const;
 
     void PrintCompileMessage(const char* text, ...);
 };
 
 
+// Текст файла без комментариев, пустых строк и лишних пробелов. Проходы компиляции идут по нему, поэтому исходник
+// достаточно прочитать один раз и по кускам, а память зависит от объема кода, а не от размера исходника
+struct CompactSource {
+    std::string text;               // Значимые строки, слова в них разделены одним пробелом
+    std::vector<int> source_lines;  // Номер строки исходника для каждой строки text
+    int64_t lines_read = 0;         // Сколько всего строк прочитано
+};
+
+// Входной файл ассемблера. Обычный файл отображается в память, а stdin ("-"), каналы и файлы больше
+// STREAMED_FILE_SIZE читаются потоком и сжимаются
+struct AsmSource {
+    const static size_t STREAMED_FILE_SIZE = 64 * 1024 * 1024;
+
+    const char* name = nullptr;  // Имя для сообщений об ошибках
+    FileHelper::MappedFile mapped;
+    CompactSource compact;
+    bool streamed = false;
+
+    std::string_view text() const { return streamed ? std::string_view(compact.text) : mapped.view(); }
+};
+
+// Открывает и читает filename в source. Бросает std::exception, если файл не удалось прочитать
+void ReadAsmSource(const char* filename, AsmSource& source);
+// Читает fd до конца кусками по READ_CHUNK_SIZE байт и сжимает текст в source. Строка может пересекать границу
+// кусков, но не может быть длиннее куска. Бросает std::system_error при ошибке чтения и std::length_error, если
+// строка слишком длинная
+void ReadCompactSource(int fd, CompactSource& source);
+
+
+// Разобранный аргумент инструкции. Тип -- одна из длинных форм (CONSTANT, REGISTER или LABEL), а в какой форме
+// аргумент будет записан, решается после выбора инструкции
+struct ParsedArgument {
+    FridayArch::InstructionArgument type = FridayArch::_BAD_ARG;
+    int32_t value = 0;       // Биты константы, номер регистра или адрес метки (0, если метка еще неизвестна)
+    std::string_view label;  // Имя метки, если type == LABEL
+};
+
+
+// Код и метки одного файла программы, сохраненные после компиляции (friday-asm --watch). Код файла зависит только
+// от него самого и файлов перед ним, поэтому, пока они не менялись, его можно дописать в программу, не компилируя
+struct AsmObject {
+    FridayArch::friday_address_t start = 0;  // Адрес начала файла в программе
+    std::vector<char> code;
+    std::vector<std::pair<std::string, FridayArch::friday_address_t>> labels;  // В порядке объявления
+    int register_count = -1;  // Число регистров после файла, если оно задано .registers, иначе -1
+
+    bool operator==(const AsmObject& other) const {
+        return start == other.start && code == other.code && labels == other.labels &&
+               register_count == other.register_count;
+    }
+};
+
+
 class FridayAsmWriter {
+    // Короткий переход, записанный во время очередного прохода. Проверяется после прохода, что метка достаточно близко
+    struct ShortJump {
+        size_t index;                               // Порядковый номер перехода в файле
+        FridayArch::friday_address_t next_offset;   // Адрес следующей за переходом инструкции
+        std::string_view label;
+    };
+
     TextLocation* loc;
     std::vector<char> bytecode;
     StringHashTable<FridayArch::friday_address_t> labels;
+    std::vector<std::string> label_names;  // Все метки в порядке объявления, чтобы по ним можно было пройти
     bool custom_register_count = false;
 
+    // Состояние выбора длины переходов внутри текущего файла. Сначала все переходы к меткам короткие, а те, что не
+    // дотягиваются до своей метки, становятся длинными. Длина зависит только от этих флагов, поэтому проходы
+    // повторяются, пока флаги меняются
+    std::vector<bool> long_jumps;
+    std::vector<ShortJump> short_jumps;
+    size_t next_jump_index = 0;
+    bool first_pass = true;
+
     template <typename FRIDAY_ARG_TYPE>
     inline void WriteToBuffer(const FRIDAY_ARG_TYPE& argument, int code_offset = -1);
 
+    // Подходит ли разобранный аргумент под форму аргумента encoding у инструкции inst
+    bool CanEncodeArgument(const FridayArch::Instruction& inst, FridayArch::InstructionArgument encoding,
+                           const ParsedArgument& arg, bool short_jump_allowed) const;
+    // Среди инструкций с данным именем, в которые можно записать аргументы, выбирает самую короткую
+    const FridayArch::Instruction* SelectInstruction(const std::string_view& name,
+                                                     const std::vector<ParsedArgument>& args,
+                                                     bool short_jump_allowed) const;
+    void EncodeArgument(FridayArch::InstructionArgument encoding, const ParsedArgument& arg,
+                        FridayArch::friday_address_t next_offset);
+
 public:
     explicit FridayAsmWriter(TextLocation* loc):
             loc(loc)
@@ -35,18 +129,24 @@ public:
 
     void WriteHeader();
 
-    FridayArch::InstructionArgument ParseAndCompileArgument(const std::string_view& arg, bool link);
+    FridayArch::InstructionArgument ParseArgument(const std::string_view& arg, bool link, ParsedArgument& result);
 
     bool WriteInstruction(const std::vector<std::string_view>& inst_and_args, bool link);
 
     void WriteToFile(const char* filename) const;
+    // Заголовок и код программы, записанные до сих пор
+    const std::vector<char>& GetBytecode() const;
 
     FridayArch::friday_address_t GetCurrentCodeOffset() const;
 
-    void RegisterLabelAtCurrentOffset(const std::string_view& label);
+    // Регистрирует метку. В первом проходе по файлу повторное объявление -- ошибка, а в последующих проходах
+    // адрес метки обновляется. Возвращает false в случае ошибки
+    bool RegisterLabelAtCurrentOffset(const std::string_view& label);
 
     FridayArch::friday_address_t GetLabelAddress(const std::string_view& label);
 
+    FridayArch::SymbolMap GetSymbolMap();
+
     void RemoveCodeFrom(FridayArch::friday_address_t from_address);
 
     FridayArch::friday_reg_t GetCurrentRegisterCount() const;
@@ -54,8 +154,74 @@ public:
     void SetCustomRegistersCount(FridayArch::friday_reg_t count);
 
     bool IsCustomRegisterValue() const;
+
+    // Начинает компиляцию нового файла: все переходы снова считаются короткими
+    void BeginFile();
+    // Начинает очередной проход по текущему файлу, с адреса from_address
+    void BeginPass(FridayArch::friday_address_t from_address);
+    // Вызывается после прохода без линковки. Делает длинными короткие переходы, не дотянувшиеся до своих меток.
+    // Возвращает true, если что-то изменилось и проход нужно повторить
+    bool WidenFarShortJumps();
+
+    size_t GetLabelCount() const;
+    // Копирует в object код, записанный начиная с адреса start, и метки, объявленные после первых first_label
+    void ExtractObject(FridayArch::friday_address_t start, size_t first_label, AsmObject& object);
+    // Дописывает код и метки файла, сохраненные ExtractObject. Код по адресу object.start должен кончаться.
+    // Возвращает false, если метка уже объявлена
+    bool AppendObject(const AsmObject& object);
 };
 
 
-bool CompileAndLinkFile(const char* file, TextLocation& loc, FridayAsmWriter& writer, bool now_linking);
+// Если line -- начало идиомы стековой машины (например, push r0; push 1; add; pop r0), заменяет line одной
+// инструкцией с регистровыми операндами (add r0, 1). index -- конец строки line в file. Возвращает индекс конца
+// последней поглощенной строки, или index, если идиомы нет
+int FuseStackIdiom(std::string_view file, int index, std::vector<std::string_view>& line);
+
+// Сколько раз исполнялся базовый блок и куда из него ушло управление, по профилю (см. CountBlocks)
+struct BlockCounts {
+    uint64_t executions = 0;
+    uint64_t taken = 0;      // Условный переход в конце блока совершен
+    uint64_t not_taken = 0;
+};
+
+// Размещение базовых блоков по профилю (friday-asm --profile-use). Блоки без метки получают метки __block<N>,
+// нумерация сквозная по всем файлам, поэтому сборка с теми же файлами дает те же имена
+struct BlockLayout {
+    bool reorder = false;  // false -- только расставить метки блоков, не меняя код, чтобы сопоставить им профиль
+    int next_block = 0;
+    std::unordered_map<std::string, BlockCounts> counts;  // По меткам блоков
+};
+
+// optimize -- склеивать идиомы стековой машины (см. FuseStackIdiom), встраивать маленькие функции и устранять
+// хвостовые вызовы (см. ExpandMacrosAndOptimize). layout != nullptr -- разместить базовые блоки (см. LayOutBlocks)
+bool CompileAndLinkFile(std::string_view file, TextLocation& loc, FridayAsmWriter& writer, bool optimize = false,
+                        BlockLayout* layout = nullptr);
+
+// Строка исходника, разбитая на слова, после раскрытия макросов
+struct AsmLine {
+    std::vector<std::string> words;
+    int source_line;
+};
+
+// Нужно ли раскрывать в file макросы или оптимизировать вызовы. Проверка грубая: ищет в тексте .macro, .endm и call
+bool NeedsExpansion(std::string_view file, bool optimize);
+// Раскрывает макросы (.macro name params ... .endm, параметр в теле -- \param, \@ -- номер раскрытия) и, если
+// optimize, заменяет вызовы маленьких листовых функций их телами и устраняет хвостовые вызовы. В result -- текст для
+// проходов компиляции и номера строк исходника для его строк. Возвращает false, если в макросах ошибка
+bool ExpandMacrosAndOptimize(std::string_view file, TextLocation& loc, bool optimize, CompactSource& result,
+                             BlockLayout* layout = nullptr);
+// Заменяет хвостовые вызовы (за call сразу идет возврат его результата) переходом, а хвостовую рекурсию -- циклом,
+// чтобы стек не рос с глубиной вызовов. О каждой замене печатает сообщение со строкой исходника
+void EliminateTailCalls(std::vector<AsmLine>& lines, const TextLocation& loc);
+// Делит строки на базовые блоки и ставит метки тем, у кого их нет. Если layout.reorder, переставляет блоки так,
+// чтобы за блоком шел его самый частый преемник, обращает условные переходы, цель которых оказалась следующей, а
+// неисполнявшиеся блоки уносит в конец файла. Первый блок файла остается на месте. Печатает сводку по файлу
+void LayOutBlocks(std::vector<AsmLine>& lines, BlockLayout& layout, const TextLocation& loc);
+// Заполняет layout.counts по профилю программы image, собранной с метками блоков (BlockLayout::reorder == false).
+// Возвращает false, если профиль снят не с этой программы
+bool CountBlocks(const std::vector<char>& image, const FridayArch::SymbolMap& symbols,
+                 const FridayArch::Profile& profile, BlockLayout& layout);
+// Исполняет программу image с вводом из файла input_filename, собирая профиль. Вывод программы отбрасывается.
+// Возвращает сигнал, которым закончилась программа. Бросает std::exception, если ввод не удалось открыть
+int TrainProgram(const std::vector<char>& image, const char* input_filename, FridayArch::Profile& profile);
 bool CompileDotCommand(const std::vector<std::string_view>& line, TextLocation& loc, FridayAsmWriter& writer);
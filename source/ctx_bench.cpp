@@ -0,0 +1,172 @@
+#include "ctx_bench.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include "ContextScheduler.hpp"
+#include "Emulator.hpp"
+#include "utility/FileHelper.hpp"
+
+using namespace FridayArch;
+
+#ifdef FRIDAY_CTX_BENCH_MAIN
+int main(int argc, char** argv) {
+    auto args = ParseCtxBenchArgs(argc, argv);
+    if (args._bad_syntax) {
+        PrintCtxBenchHelp();
+        return 0;
+    }
+    return RunCtxBench(args) ? 0 : 1;
+}
+#endif
+
+CtxBenchArgs ParseCtxBenchArgs(int argc, char **argv) {
+    CtxBenchArgs result;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-m") == 0) {
+            int value = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+            if (value <= 0) {
+                printf("error: expected positive number after '%s' argument\n", argv[i]);
+                result._bad_syntax = true;
+                return result;
+            }
+            const char* option = argv[i++];
+            if (strcmp(option, "-n") == 0) {
+                result.contexts_count = value;
+            } else if (strcmp(option, "-j") == 0) {
+                result.threads_count = value;
+            } else {
+                result.memory_kb = value;
+            }
+        } else if (strcmp(argv[i], "-i") == 0) {
+            if (i + 1 >= argc) {
+                printf("error: nothing after '%s' argument\n", argv[i]);
+                result._bad_syntax = true;
+                return result;
+            }
+            result.input = argv[++i];
+        } else if (strcmp(argv[i], "--max-instructions") == 0) {
+            char* end = nullptr;
+            if (i + 1 >= argc || (result.max_instructions = strtoll(argv[i + 1], &end, 10)) < 0 || *end != '\0') {
+                printf("error: expected non-negative number of instructions after '%s' argument\n", argv[i]);
+                result._bad_syntax = true;
+                return result;
+            }
+            ++i;
+        } else {
+            printf("error: unknown argument '%s'\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+    }
+
+    if (i + 1 != argc) {
+        printf("error: expected exactly one program to run\n");
+        result._bad_syntax = true;
+        return result;
+    }
+    result.program = argv[i];
+    return result;
+}
+
+void PrintCtxBenchHelp() {
+    printf("friday-ctx-bench [-n <contexts>] [-j N] [-m <KB>] [-i <words>] [--max-instructions N] <.friday program>\n"
+           "Run many copies of the program at once on the context scheduler, feeding each copy its input one word\n"
+           "at a time, and print contexts/sec, peak RSS and whether all copies printed the same output\n"
+           "-n : number of copies, default is 10000\n"
+           "-j : number of host threads, default is number of cores\n"
+           "-m : memory of every copy in kilobytes, default is 1024\n"
+           "-i : input of every copy, words separated by spaces. Copies wait in 'in' until their word arrives\n"
+           "--max-instructions : budget of every copy, as for friday-emu\n");
+}
+
+static std::vector<std::string_view> SplitWords(std::string_view text) {
+    std::vector<std::string_view> words;
+    size_t begin = text.find_first_not_of(" \t\n");
+    while (begin != std::string_view::npos) {
+        size_t end = text.find_first_of(" \t\n", begin);
+        words.push_back(text.substr(begin, end - begin));
+        begin = end == std::string_view::npos ? end : text.find_first_not_of(" \t\n", end);
+    }
+    return words;
+}
+
+bool RunCtxBench(const CtxBenchArgs &args) {
+    std::shared_ptr<const ContextScheduler::Program> program;
+    try {
+        FileHelper::MappedFile file(args.program);
+        program = ContextScheduler::PrepareProgram(file.data(), file.size());
+    } catch (const std::exception& exc) {
+        FileHelper::PrintErrorWorkingWithFile(args.program, "reading", exc);
+        return false;
+    }
+
+    int threads_count = args.threads_count > 0 ? args.threads_count
+                                               : static_cast<int>(std::thread::hardware_concurrency());
+    std::vector<std::string_view> words = SplitWords(args.input);
+    auto start = std::chrono::steady_clock::now();
+
+    ContextScheduler scheduler(threads_count, args.memory_kb * 1024);
+    std::vector<int64_t> ids;
+    ids.reserve(args.contexts_count);
+    try {
+        for (int i = 0; i < args.contexts_count; ++i) {
+            ids.push_back(scheduler.Start(program, args.max_instructions));
+        }
+    } catch (const std::exception& exc) {
+        printf("error: cannot start context %zu: %s\n", ids.size(), exc.what());
+        return false;
+    }
+
+    // Every round gives each context its next word, so contexts run and wait for input many times
+    size_t peak_waiting = scheduler.WaitingContexts();
+    for (std::string_view word : words) {
+        for (int64_t id : ids) {
+            scheduler.Feed(id, word);
+        }
+        peak_waiting = std::max(peak_waiting, scheduler.WaitingContexts());
+    }
+    for (int64_t id : ids) {
+        scheduler.CloseInput(id);
+    }
+
+    ContextScheduler::Result first, first_failed;
+    int failed = 0, different = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        ContextScheduler::Result result;
+        scheduler.Wait(ids[i], result);
+        if (i == 0) {
+            first = result;
+        }
+        if (result.signal != Emulator::SIGNAL_EXIT && failed++ == 0) {
+            first_failed = result;
+        }
+        different += result.output != first.output;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    printf("friday-ctx-bench: %d contexts of %d KB on %d host threads, %zu words of input each, in %.2f s\n"
+           "%.0f contexts/s, peak %zu waiting for input, peak RSS %ld KB\n",
+           args.contexts_count, args.memory_kb, threads_count, words.size(), seconds,
+           args.contexts_count / seconds, peak_waiting, usage.ru_maxrss);
+    if (failed > 0) {
+        printf("%d contexts stopped with a signal other than exit, the first one with %d at ip = 0x%08x\n",
+               failed, first_failed.signal, first_failed.ip);
+    }
+    if (different > 0) {
+        printf("%d contexts printed output different from the first one\n", different);
+    }
+    printf("output of the first context:\n%s", first.output.c_str());
+    return failed == 0 && different == 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef FRIDAY_CTX_BENCH_MAIN
+// Установите этот макрос, чтобы скомпилировать точку входа
+int main(int argc, char** argv);
+#endif
+
+// Параметры замера планировщика контекстов
+typedef struct CtxBenchArgs {
+    const char* program = nullptr;
+    int contexts_count = 10000;       // Сколько копий программы исполнять одновременно
+    int threads_count = 0;            // Потоков хоста, 0 -- по числу ядер
+    int memory_kb = 1024;             // Память каждого контекста
+    const char* input = "";           // Слова ввода, каждый контекст получает их по одному
+    long long max_instructions = -1;  // Бюджет инструкций каждого контекста, -1 -- без ограничения
+
+    bool _bad_syntax = false;
+
+    CtxBenchArgs() = default;
+} CtxBenchArgs;
+
+CtxBenchArgs ParseCtxBenchArgs(int argc, char** argv);
+void PrintCtxBenchHelp();
+// Запускает копии программы контекстами ContextScheduler, передает им ввод по одному слову за раз, так что они
+// засыпают в in, и печатает скорость, пиковую память и итог. Возвращает false, если какая-то копия закончилась
+// не инструкцией end или их вывод различается
+bool RunCtxBench(const CtxBenchArgs& args);
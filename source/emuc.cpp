@@ -0,0 +1,142 @@
+#include "emud.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "DaemonProtocol.hpp"
+#include "utility/FileHelper.hpp"
+
+using namespace FridayArch;
+
+// Клиент не подключает ни эмулятор, ни набор инструкций: он только передает запрос демону
+
+#ifdef FRIDAY_EMUC_MAIN
+int main(int argc, char** argv) {
+    auto args = ParseDaemonClientArgs(argc, argv);
+    if (args._bad_syntax) {
+        PrintDaemonClientHelp();
+        return 0;
+    }
+    return RunDaemonClient(args);
+}
+#endif
+
+DaemonClientArgs ParseDaemonClientArgs(int argc, char **argv) {
+    DaemonClientArgs result;
+    result.socket_path = GetDefaultDaemonSocket();
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-b") == 0) {
+            result.send_bytes = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--ordered-output") == 0) {
+            result.ordered_output = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            printf("error: nothing after '%s' argument\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+        if (strcmp(argv[i], "-s") == 0) {
+            result.socket_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--input") == 0) {
+            result.input_filename = argv[i + 1];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if ((result.threads_count = atoi(argv[i + 1])) <= 0) {
+                printf("error: expected positive number of threads after '%s' argument\n", argv[i]);
+                result._bad_syntax = true;
+                return result;
+            }
+        } else {
+            printf("error: unknown argument '%s'\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+        ++i;
+    }
+
+    if (i + 1 != argc) {
+        result._bad_syntax = true;
+        return result;
+    }
+    result.program = argv[i];
+    return result;
+}
+
+void PrintDaemonClientHelp() {
+    printf("friday-emuc [-s <socket>] [-b] [-j N] [--ordered-output] [--input <file>] <.friday program>\n"
+           "Run .friday program in friday-emud, input and output are the same as with friday-emu\n"
+           "-s : path of the daemon socket, default is the same as for friday-emud\n"
+           "-b : send the program itself instead of its path (if the daemon cannot read the file)\n"
+           "-j, --ordered-output, --input : same as for friday-emu\n"
+           "Exit code is 0 if the program ends with 'end', 1 otherwise\n");
+}
+
+int RunDaemonClient(const DaemonClientArgs &args) {
+    std::vector<char> program;
+    DaemonRequest request = {};
+    memcpy(request.magic, DAEMON_MAGIC, sizeof(DAEMON_MAGIC));
+    request.threads_count = args.threads_count;
+    request.ordered_output = args.ordered_output;
+    if (args.send_bytes) {
+        try {
+            FileHelper::MappedFile file(args.program);
+            program.assign(file.data(), file.data() + file.size());
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.program, "reading", exc);
+            return 1;
+        }
+        request.program_kind = DAEMON_PROGRAM_BYTES;
+    } else {
+        // The daemon may have another working directory
+        char path[PATH_MAX];
+        const char* absolute = realpath(args.program, path);
+        const char* sent = absolute != nullptr ? absolute : args.program;
+        program.assign(sent, sent + strlen(sent));
+        request.program_kind = DAEMON_PROGRAM_PATH;
+    }
+    request.program_length = static_cast<uint32_t>(program.size());
+
+    int input_fd = STDIN_FILENO;
+    if (args.input_filename != nullptr) {
+        input_fd = open(args.input_filename, O_RDONLY | O_CLOEXEC);
+        if (input_fd < 0) {
+            printf("error: cannot open '%s': %s\n", args.input_filename, strerror(errno));
+            return 1;
+        }
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, args.socket_path.c_str(), sizeof(address.sun_path) - 1);
+    int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0 || connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        printf("error: cannot connect to friday-emud at '%s': %s\n", args.socket_path.c_str(), strerror(errno));
+        return 1;
+    }
+
+    // Everything printed before must come before the output of the program
+    fflush(stdout);
+    int fds[2] = {input_fd, STDOUT_FILENO};
+    DaemonReply reply = {-1};
+    bool ok = SendWithDescriptors(connection, &request, sizeof(request), fds, 2) &&
+              SendAll(connection, program.data(), program.size()) &&
+              ReceiveAll(connection, &reply, sizeof(reply));
+    close(connection);
+    if (!ok) {
+        printf("error: connection to friday-emud is lost\n");
+        return 1;
+    }
+    const int32_t SIGNAL_EXIT = 1;  // Emulator::SIGNAL_EXIT
+    return reply.signal == SIGNAL_EXIT ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+#include "emud.hpp"
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "DaemonProtocol.hpp"
+#include "Emulator.hpp"
+#include "GuestScheduler.hpp"
+#include "InputSource.hpp"
+#include "friday_asm_lang.hpp"
+#include "utility/BytesHelper.hpp"
+
+using namespace FridayArch;
+
+#ifdef FRIDAY_EMUD_MAIN
+int main(int argc, char** argv) {
+    auto args = ParseDaemonArgs(argc, argv);
+    if (args._bad_syntax) {
+        PrintDaemonHelp();
+        return 0;
+    }
+    return RunDaemon(args) ? 0 : 1;
+}
+#endif
+
+DaemonArgs ParseDaemonArgs(int argc, char **argv) {
+    DaemonArgs result;
+    result.socket_path = GetDefaultDaemonSocket();
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            printf("error: nothing after '%s' argument\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+        if (strcmp(argv[i], "-s") == 0) {
+            result.socket_path = argv[i + 1];
+        } else if (strcmp(argv[i], "-n") == 0) {
+            result.pool_size = atoi(argv[i + 1]);
+            if (result.pool_size <= 0) {
+                printf("error: expected positive number of emulators after '-n' argument\n");
+                result._bad_syntax = true;
+                return result;
+            }
+        } else {
+            printf("error: unknown argument '%s'\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+    }
+    return result;
+}
+
+void PrintDaemonHelp() {
+    printf("friday-emud [-s <socket>] [-n <emulators>]\n"
+           "Keep emulators ready and run .friday programs sent by friday-emuc, without starting a new process\n"
+           "-s : path of the Unix socket, default is $XDG_RUNTIME_DIR/friday-emud.sock or /tmp/friday-emud-<uid>.sock\n"
+           "-n : how many programs may run at once, default is 4\n");
+}
+
+// Загружает программу запроса в emu. Ошибки печатаются в output, как их печатает friday-emu
+static bool LoadProgram(Emulator& emu, const DaemonRequest& request, const std::vector<char>& program, FILE* output) {
+    std::string name = request.program_kind == DAEMON_PROGRAM_PATH ? std::string(program.begin(), program.end())
+                                                                    : std::string("<program bytes>");
+    if (request.program_kind == DAEMON_PROGRAM_PATH) {
+        try {
+            emu.LoadMemoryFromFile(name.c_str());
+        } catch (const std::exception& exc) {
+            fprintf(output, "Error while reading file '%s'. Check the file exists and is not a directory\n"
+                            "Exception's 'what()': %s\n", name.c_str(), exc.what());
+            return false;
+        }
+    } else if (program.size() >= static_cast<size_t>(HEADER_SIZE)) {
+        emu.LoadMemory(program.data(), static_cast<int>(program.size()));
+    }
+
+    if (emu.program_size < HEADER_SIZE || !CheckForFRDY(emu.mem)) {
+        fprintf(output, "error: file '%s' is not a .friday executable\n", name.c_str());
+        return false;
+    }
+    auto version = BytesHelper::ReadFromBytes<int16_t>(emu.mem, HEADER_ASM_VER_OFFSET);
+    if (version > ARCH_VERSION) {
+        fprintf(output, "error: file '%s' is compiled for arch version %d, but emulator supports up to %d\n",
+                name.c_str(), version, ARCH_VERSION);
+        return false;
+    }
+    return true;
+}
+
+// Ждет, пока в stop_fd не запишут. Если раньше отключится клиент, останавливает его программу: иначе бесконечная
+// программа навсегда заняла бы эмулятор пула
+static void WatchConnection(int connection, int stop_fd, GuestScheduler& scheduler, PrefetchedInput& input) {
+    while (true) {
+        pollfd fds[2] = {{connection, POLLRDHUP, 0}, {stop_fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("friday-emud: poll");
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        if (fds[0].revents != 0) {
+            // The program may be waiting for input which will never come, so the input is closed too
+            scheduler.Stop();
+            input.Close();
+            return;
+        }
+    }
+}
+
+// Исполняет программу запроса и возвращает сигнал, которым она закончилась. Если клиент отключается раньше,
+// программа останавливается
+static int32_t RunRequest(Emulator& emu, const DaemonRequest& request, const std::vector<char>& program,
+                          int connection, int input_fd, FILE* output) {
+    emu.Reset();
+    emu.output_stream = output;
+    if (!LoadProgram(emu, request, program, output)) {
+        return -1;
+    }
+    int stop_pipe[2];
+    if (pipe2(stop_pipe, O_CLOEXEC) != 0) {
+        perror("friday-emud: pipe");
+        return -1;
+    }
+
+    PrefetchedInput input(input_fd);
+    emu.input = &input;
+    int threads_count = request.threads_count > 0 ? request.threads_count
+                                                  : static_cast<int>(std::thread::hardware_concurrency());
+    {
+        GuestScheduler scheduler(emu, threads_count, request.ordered_output != 0);
+        std::thread watch(WatchConnection, connection, stop_pipe[0], std::ref(scheduler), std::ref(input));
+        scheduler.Run(false, nullptr);
+        char stop = 0;
+        while (write(stop_pipe[1], &stop, 1) < 0 && errno == EINTR) {}
+        watch.join();
+    }
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    emu.input = nullptr;
+    return emu.signal;
+}
+
+static void ServeConnection(int connection, Emulator& emu) {
+    DaemonRequest request = {};
+    int fds[2] = {-1, -1};  // Ввод и вывод программы
+    if (!ReceiveWithDescriptors(connection, &request, sizeof(request), fds, 2)) {
+        return;
+    }
+
+    std::vector<char> program;
+    size_t max_length = request.program_kind == DAEMON_PROGRAM_PATH ? PATH_MAX : Emulator::MEMORY_SIZE;
+    bool ok = memcmp(request.magic, DAEMON_MAGIC, sizeof(DAEMON_MAGIC)) == 0 && request.program_length <= max_length;
+    if (ok) {
+        program.resize(request.program_length);
+        ok = ReceiveAll(connection, program.data(), program.size());
+    }
+    FILE* output = fdopen(fds[1], "w");
+    if (!ok || output == nullptr) {
+        close(fds[0]);
+        output != nullptr ? fclose(output) : close(fds[1]);
+        return;
+    }
+
+    DaemonReply reply = {RunRequest(emu, request, program, connection, fds[0], output)};
+    emu.Reset();  // Memory of the finished program is not kept until the next request
+    fclose(output);
+    close(fds[0]);
+    SendAll(connection, &reply, sizeof(reply));
+}
+
+static void WorkerLoop(int listener) {
+    // Allocated once, every request only resets it
+    Emulator emu;
+    while (true) {
+        int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("friday-emud: accept");
+            return;
+        }
+        ServeConnection(connection, emu);
+        close(connection);
+    }
+}
+
+bool RunDaemon(const DaemonArgs &args) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (args.socket_path.size() >= sizeof(address.sun_path)) {
+        printf("error: socket path '%s' is too long\n", args.socket_path.c_str());
+        return false;
+    }
+    strcpy(address.sun_path, args.socket_path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(args.socket_path.c_str());  // Socket of a previous daemon which was killed
+    mode_t old_mask = umask(0077);     // Only the owner may run programs
+    bool bound = listener >= 0 && bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    umask(old_mask);
+    if (!bound || listen(listener, SOMAXCONN) != 0) {
+        printf("error: cannot listen on '%s': %s\n", args.socket_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    // Workers must not receive SIGINT and SIGTERM, the main thread waits for them. A client which went away
+    // must not kill the daemon with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < args.pool_size; ++i) {
+        workers.emplace_back(WorkerLoop, listener);
+    }
+    printf("friday-emud: listening on %s\n", args.socket_path.c_str());
+    fflush(stdout);
+
+    int received;
+    sigwait(&stop_signals, &received);
+    unlink(args.socket_path.c_str());
+    // Programs which are running now are not waited for
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+#if defined(FRIDAY_EMUD_MAIN) || defined(FRIDAY_EMUC_MAIN)
+// Установите один из этих макросов, чтобы скомпилировать точку входа демона или клиента
+int main(int argc, char** argv);
+#endif
+
+// Параметры демона friday-emud
+typedef struct DaemonArgs {
+    std::string socket_path;  // По умолчанию GetDefaultDaemonSocket()
+    int pool_size = 4;        // Сколько программ исполняется одновременно, у каждой свой заранее созданный Emulator
+
+    bool _bad_syntax = false;
+
+    DaemonArgs() = default;
+} DaemonArgs;
+
+DaemonArgs ParseDaemonArgs(int argc, char** argv);
+void PrintDaemonHelp();
+// Принимает запросы, пока процесс не получит SIGINT или SIGTERM. Возвращает false, если сокет не удалось создать
+bool RunDaemon(const DaemonArgs& args);
+
+// Параметры клиента friday-emuc. Ключи те же, что у friday-emu
+typedef struct DaemonClientArgs {
+    std::string socket_path;
+    const char* program = nullptr;
+    bool send_bytes = false;               // Отправить саму программу, а не путь к ней
+    int threads_count = 0;
+    bool ordered_output = false;
+    const char* input_filename = nullptr;  // Откуда читать in/in_f, nullptr -- stdin
+
+    bool _bad_syntax = false;
+
+    DaemonClientArgs() = default;
+} DaemonClientArgs;
+
+DaemonClientArgs ParseDaemonClientArgs(int argc, char** argv);
+void PrintDaemonClientHelp();
+// Возвращает код возврата процесса: 0, если программа закончилась инструкцией end
+int RunDaemonClient(const DaemonClientArgs& args);
@@ -1,43 +1,302 @@
 #include "emulate.hpp"
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
 #include "Emulator.hpp"
+#include "GuestScheduler.hpp"
+#include "InputSource.hpp"
+#include "Debugger.hpp"
+#include "SymbolMap.hpp"
+#include "Profile.hpp"
+#include "Verifier.hpp"
+#include "assembler.hpp"
 #include "utility/FileHelper.hpp"
 #include "friday_asm_lang.hpp"
+#include "utility/BytesHelper.hpp"
 
 using namespace FridayArch;
 
 #ifdef FRIDAY_EMU_MAIN
 int main(int argc, char** argv) {
-    if (argc != 2 && (argc != 3 || strcmp(argv[1], "-d") != 0)) {
+    auto args = ParseEmulatorArgs(argc, argv);
+    if (args._bad_syntax) {
         PrintEmulatorHelp();
         return 0;
     }
-    bool debug_mode = argc == 3;
-    Emulate(argv[argc - 1], debug_mode);
+    Emulate(args);
 }
 #endif
+
+// Исходник ассемблера, а не собранная программа
+static bool IsAssemblySource(const char* filename) {
+    size_t length = strlen(filename);
+    return length > 2 && strcmp(filename + length - 2, ".s") == 0;
+}
+
+EmulatorArgs ParseEmulatorArgs(int argc, char **argv) {
+    EmulatorArgs result;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-d") == 0) {
+            result.debug_mode = true;
+        } else if (strcmp(argv[i], "-g") == 0) {
+            result.interactive_debugger = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            if (i + 1 >= argc) {
+                printf("error: nothing after '%s' argument\n", argv[i]);
+                result._bad_syntax = true;
+                return result;
+            }
+            result.profile_filename = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc || (result.threads_count = atoi(argv[i + 1])) <= 0) {
+                printf("error: expected positive number of threads after '%s' argument\n", argv[i]);
+                result._bad_syntax = true;
+                return result;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--input") == 0 || strcmp(argv[i], "--record") == 0 ||
+                   strcmp(argv[i], "--replay") == 0 || strcmp(argv[i], "-m") == 0) {
+            if (i + 1 >= argc) {
+                printf("error: nothing after '%s' argument\n", argv[i]);
+                result._bad_syntax = true;
+                return result;
+            }
+            const char* option = argv[i++];
+            if (strcmp(option, "--input") == 0) {
+                result.input_filename = argv[i];
+            } else if (strcmp(option, "--record") == 0) {
+                result.record_filename = argv[i];
+            } else if (strcmp(option, "-m") == 0) {
+                result.map_filename = argv[i];
+            } else {
+                result.replay_filename = argv[i];
+            }
+        } else if (strcmp(argv[i], "--max-instructions") == 0) {
+            char* end = nullptr;
+            if (i + 1 >= argc || (result.max_instructions = strtoll(argv[i + 1], &end, 10)) < 0 || *end != '\0') {
+                printf("error: expected non-negative number of instructions after '%s' argument\n", argv[i]);
+                result._bad_syntax = true;
+                return result;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--ordered-output") == 0) {
+            result.ordered_output = true;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            result.optimize = true;
+        } else {
+            printf("error: unknown argument '%s'\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+    }
+
+    if (result.replay_filename != nullptr && (result.input_filename != nullptr || result.record_filename != nullptr)) {
+        printf("error: '--replay' cannot be used with '--input' or '--record'\n");
+        result._bad_syntax = true;
+        return result;
+    }
+    if (i < argc && IsAssemblySource(argv[i])) {
+        // The program is given by its sources, the first one is the main file as for friday-asm
+        result.program = argv[i];
+        result.sources.assign(argv + i, argv + argc);
+        return result;
+    }
+    if (i + 1 != argc) {
+        printf("error: expected exactly one program to run\n");
+        result._bad_syntax = true;
+        return result;
+    }
+    result.program = argv[i];
+    return result;
+}
+
 void PrintEmulatorHelp() {
-    printf("friday-emu [-d] <.friday program>\n"
+    printf("friday-emu [-d] [-g [-m <map>]] [--profile <file>] [-j N] [--ordered-output] [--input <file>]\n"
+           "           [--record <file> | --replay <file>] [--max-instructions N] [-O]\n"
+           "           <.friday program> | <main_file.s> [other files.s...]\n"
            "Emulates executing of the program on friday processor\n"
-           "-d : enables debug information, which is printed after every tick\n");
+           "Sources (.s) are assembled as by friday-asm and the program is kept in the bytecode cache\n"
+           "($FRIDAY_CACHE_DIR, $XDG_CACHE_HOME/friday or ~/.cache/friday) under the hash of the sources and options,\n"
+           "so next runs of the same sources load it without assembling. Assembler warnings are not printed\n"
+           "-d : enables debug information, which is printed after every tick. Also prints what the load-time\n"
+           "     verifier found about the program\n"
+           "-g : run the program under interactive debugger with breakpoints, type 'help' in it for commands.\n"
+           "     Commands are read from the terminal, or from stdin if there is no terminal\n"
+           "-m : map of labels made by friday-asm -m, lets the debugger set breakpoints on labels\n"
+           "--profile : count executions of every instruction and save them to <file> (see friday-objdump -p)\n"
+           "-j : run guest threads (spawn) on N host threads, default is number of cores\n"
+           "--ordered-output : print output of every guest thread when it is joined, so the order is deterministic\n"
+           "--input : read values for in/in_f from <file> instead of stdin\n"
+           "--record : save every value read by in/in_f to binary log <file>\n"
+           "--replay : read values for in/in_f from log <file>, made by --record, instead of parsing input\n"
+           "--max-instructions : stop the program with OUT OF FUEL after N instructions of all its threads.\n"
+           "     The budget is charged once per run of straight-line code, before the run starts\n"
+           "-O : assemble sources as friday-asm -O\n");
 }
 
-void Emulate(const char *filename, bool debug_mode) {
-    std::string file;
+static void RunProgram(Emulator& emu, const EmulatorArgs& args);
+static void RunDebugger(Emulator& emu, const EmulatorArgs& args);
+
+static void PrintVerification(const VerifiedProgram& verification) {
+    if (!verification.ok) {
+        printf("verifier: 0x%08x: %s. Running with run-time checks\n", verification.error_address,
+               verification.error.c_str());
+    } else if (verification.stack_bound < 0) {
+        printf("verifier: ok, stack depth is not known statically. Running with stack checks\n");
+    } else {
+        printf("verifier: ok, stack depth is at most %d bytes. Running without run-time checks\n",
+               verification.stack_bound);
+    }
+}
+
+void Emulate(const EmulatorArgs& args) {
+    const char* filename = args.program;
+    std::string cached;
+    bool temporary = false;  // The cache is not writable, the program is in a private temporary file
+    if (!args.sources.empty()) {
+        AssemblerArgs assembler_args;
+        assembler_args.input_files = args.sources;
+        assembler_args.optimize = args.optimize;
+        bool cache_hit = false;
+        cached = AssembleCached(assembler_args, cache_hit, temporary);
+        if (cached.empty()) {
+            return;
+        }
+        if (args.debug_mode) {
+            printf("bytecode cache: %s %s\n", cache_hit ? "loading" : temporary ? "is not writable, assembled into"
+                                                                               : "assembled into", cached.c_str());
+        }
+        filename = cached.c_str();
+    }
+
+    Emulator emu;
     try {
-        file = FileHelper::ReadFileFullyInBinary(filename);
+        emu.LoadMemoryFromFile(filename);
     } catch (const std::exception& exc) {
         FileHelper::PrintErrorWorkingWithFile(filename, "reading", exc);
+        if (temporary) {
+            unlink(filename);
+        }
         return;
     }
+    // The mapping keeps the program, its file is not needed anymore
+    if (temporary) {
+        unlink(filename);
+    }
 
-    if (!CheckForFRDY(file.c_str())) {
+    if (!CheckForFRDY(emu.mem)) {
         printf("error: file '%s' is not a .friday executable\n", filename);
         return;
     }
+    auto version = BytesHelper::ReadFromBytes<int16_t>(emu.mem, HEADER_ASM_VER_OFFSET);
+    if (version > ARCH_VERSION) {
+        printf("error: file '%s' is compiled for arch version %d, but emulator supports up to %d\n",
+               filename, version, ARCH_VERSION);
+        return;
+    }
+    if (args.debug_mode) {
+        PrintVerification(*emu.verification);
+    }
+    if (args.max_instructions >= 0) {
+        emu.AddFuel(args.max_instructions);
+    }
 
-    Emulator emu;
-    emu.LoadMemory(file.c_str(), file.size());
-    emu.Run(debug_mode);
+    if (args.replay_filename != nullptr) {
+        std::unique_ptr<ReplayInput> replay;
+        try {
+            replay = std::make_unique<ReplayInput>(args.replay_filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.replay_filename, "reading", exc);
+            return;
+        }
+        emu.input = replay.get();
+        RunProgram(emu, args);
+        emu.input = nullptr;
+        return;
+    }
+
+    int input_fd = STDIN_FILENO;
+    if (args.input_filename != nullptr) {
+        size_t input_size = 0;
+        try {
+            input_fd = FileHelper::OpenRegularFile(args.input_filename, input_size);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.input_filename, "reading", exc);
+            return;
+        }
+    }
+    PrefetchedInput input(input_fd);
+    std::unique_ptr<RecordingInput> recording;
+    if (args.record_filename != nullptr) {
+        try {
+            recording = std::make_unique<RecordingInput>(input, args.record_filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.record_filename, "writing to", exc);
+        }
+    }
+
+    if (args.record_filename == nullptr || recording != nullptr) {
+        emu.input = recording != nullptr ? static_cast<InputSource*>(recording.get()) : &input;
+        RunProgram(emu, args);
+        emu.input = nullptr;
+    }
+    if (recording != nullptr) {
+        try {
+            recording->Finish();
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.record_filename, "writing to", exc);
+        }
+    }
+    if (input_fd != STDIN_FILENO) {
+        close(input_fd);
+    }
+}
+
+static void RunProgram(Emulator& emu, const EmulatorArgs& args) {
+    if (args.interactive_debugger) {
+        RunDebugger(emu, args);
+        return;
+    }
+
+    int threads_count = args.threads_count > 0 ? args.threads_count
+                                               : static_cast<int>(std::thread::hardware_concurrency());
+    GuestScheduler scheduler(emu, threads_count, args.ordered_output);
+    if (args.profile_filename == nullptr) {
+        scheduler.Run(args.debug_mode, nullptr);
+        return;
+    }
+
+    Profile profile(emu.program_size);
+    scheduler.Run(args.debug_mode, &profile);
+    try {
+        profile.Save(args.profile_filename);
+    } catch (const std::exception& exc) {
+        FileHelper::PrintErrorWorkingWithFile(args.profile_filename, "writing to", exc);
+    }
+}
+
+static void RunDebugger(Emulator& emu, const EmulatorArgs& args) {
+    SymbolMap symbols;
+    if (args.map_filename != nullptr) {
+        try {
+            symbols.Load(args.map_filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.map_filename, "reading", exc);
+            return;
+        }
+    }
+
+    // stdin может быть вводом программы, поэтому команды по возможности читаются прямо с терминала
+    FILE* terminal = fopen("/dev/tty", "r");
+    Debugger debugger(emu, args.map_filename != nullptr ? &symbols : nullptr, terminal != nullptr ? terminal : stdin);
+    debugger.Run();
+    if (terminal != nullptr) {
+        fclose(terminal);
+    }
 }
@@ -1,9 +1,34 @@
 #pragma once
 
+#include <vector>
+
 #ifdef FRIDAY_EMU_MAIN
 // Установите этот макрос, чтобы скомпилировать точку входа
 int main(int argc, char** argv);
 #endif
+
+// Параметры, необходимые для запуска эмулятора
+typedef struct EmulatorArgs {
+    const char* program = nullptr;
+    std::vector<char*> sources;              // Исходники программы, если она задана файлами .s
+    bool optimize = false;                   // -O: собирать исходники как friday-asm -O
+    bool debug_mode = false;
+    bool interactive_debugger = false;       // Исполнять программу под управлением команд отладчика
+    const char* map_filename = nullptr;      // Таблица меток для отладчика (friday-asm -m)
+    const char* profile_filename = nullptr;  // Куда сохранить профиль исполнения, nullptr -- не профилировать
+    int threads_count = 0;                   // Потоков хоста для гостевых потоков, 0 -- по числу ядер
+    bool ordered_output = false;             // Печатать вывод гостевых потоков в порядке join
+    const char* input_filename = nullptr;    // Откуда читать in/in_f, nullptr -- stdin
+    const char* record_filename = nullptr;   // Куда записать журнал прочитанных значений
+    const char* replay_filename = nullptr;   // Журнал, из которого брать значения вместо ввода
+    long long max_instructions = -1;         // Бюджет инструкций всех потоков программы, -1 -- без ограничения
+
+    bool _bad_syntax = false;
+
+    EmulatorArgs() = default;
+} EmulatorArgs;
+
+EmulatorArgs ParseEmulatorArgs(int argc, char** argv);
 void PrintEmulatorHelp();
 
-void Emulate(const char* filename, bool debug_mode);
+void Emulate(const EmulatorArgs& args);
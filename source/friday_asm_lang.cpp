@@ -1,18 +1,26 @@
 #include "friday_asm_lang.hpp"
 #include "Emulator.hpp"
 #include "utility/BytesHelper.hpp"
+#include "VectorKernels.hpp"
+#include "GuestScheduler.hpp"
+#include "InputSource.hpp"
+#include "Intrinsics.hpp"
 #include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+#include <utility>
 #ifndef NDEBUG
     #include <cassert>
-    #include <cstring>
-#include <cmath>
-
 #endif
 
 namespace FridayArch {
 
-std::vector<Instruction> INSTRUCTION_SET;
-std::vector<friday_inst_t> MAP_OF_INSTRUCTIONS_BY_BYTECODE(MAX_INSTRUCTION_VALUE + 1, -1);
+// Both tables are filled by RegisterInstruction during static initialization and only read afterwards, so any number
+// of emulators and assemblers may use them from different threads
+static std::vector<Instruction> INSTRUCTION_SET;
+// Instructions are more than friday_inst_t can count, so indexes are wider
+static std::vector<int16_t> MAP_OF_INSTRUCTIONS_BY_BYTECODE(MAX_INSTRUCTION_VALUE + 1, -1);
 
 bool AreInstructionArgsEqual(unsigned int args_count, const InstructionArgument *array1,
                              const InstructionArgument *array2) {
@@ -24,21 +32,35 @@ bool AreInstructionArgsEqual(unsigned int args_count, const InstructionArgument
     return true;
 }
 
+bool HasPackedRegisterArg(unsigned int args_count, const InstructionArgument *args) {
+    for (unsigned int i = 0; i < args_count; ++i) {
+        if (args[i] == PACKED_REGISTER) {
+            return true;
+        }
+    }
+    return false;
+}
+
 char RegisterInstruction(const char *name, friday_inst_t inst, int args_count, InstructionArgument *args,
-        void (*callback)(Emulator*)) {
+        void (*callback)(Emulator*), InstructionFlow flow, InstructionIO io) {
 #ifndef NDEBUG
     for (auto &inst_ : INSTRUCTION_SET) {
         assert(inst != inst_.inst);
+        // Group of instructions with packed register share signature, they differ in the packed register
         assert(strcmp(name, inst_.name) != 0 || args_count != inst_.args_count ||
-               !AreInstructionArgsEqual(args_count, args, inst_.args));
+               !AreInstructionArgsEqual(args_count, args, inst_.args) || HasPackedRegisterArg(args_count, args));
     }
 #endif
 
-    INSTRUCTION_SET.emplace_back(name, inst, args_count, args, callback);
-    MAP_OF_INSTRUCTIONS_BY_BYTECODE[inst] = INSTRUCTION_SET.size() - 1;
+    INSTRUCTION_SET.emplace_back(name, inst, args_count, args, callback, flow, io);
+    MAP_OF_INSTRUCTIONS_BY_BYTECODE[static_cast<uint8_t>(inst)] = INSTRUCTION_SET.size() - 1;
     return '\0';
 }
 
+const std::vector<Instruction> &GetInstructionSet() {
+    return INSTRUCTION_SET;
+}
+
 Instruction *FindInstructionBySignature(const std::string_view &name, int args_count,
                                                                 const InstructionArgument *args) {
     for (auto &inst : INSTRUCTION_SET) {
@@ -56,6 +78,10 @@ const char *GetInstructionArgumentName(InstructionArgument value) {
         case CONSTANT: return "CONSTANT";
         case REGISTER: return "REGISTER";
         case LABEL: return "LABEL";
+        case CONSTANT_8: return "CONSTANT_8";
+        case CONSTANT_16: return "CONSTANT_16";
+        case PACKED_REGISTER: return "PACKED_REGISTER";
+        case LABEL_REL_8: return "LABEL_REL_8";
         case _BAD_ARG: return "_BAD_ARG";
     }
     return "what the hell is this InstructionArgument";
@@ -66,13 +92,18 @@ size_t GetInstructionArgumentSize(InstructionArgument value) {
         case CONSTANT: return sizeof(friday_constant_t);
         case REGISTER: return sizeof(friday_reg_t);
         case LABEL: return sizeof(friday_address_t);
+        case CONSTANT_8: return sizeof(int8_t);
+        case CONSTANT_16: return sizeof(int16_t);
+        case PACKED_REGISTER: return 0;
+        case LABEL_REL_8: return sizeof(friday_short_offset_t);
         case _BAD_ARG: return -1;
     }
     return -1;
 }
 
 Instruction *GetInstructionByBytecode(friday_inst_t bytecode) {
-    int index = MAP_OF_INSTRUCTIONS_BY_BYTECODE[bytecode];
+    // friday_inst_t is signed, so opcodes above 0x7f must not become negative indexes
+    int index = MAP_OF_INSTRUCTIONS_BY_BYTECODE[static_cast<uint8_t>(bytecode)];
     if (index == -1) {
         return nullptr;
     }
@@ -96,33 +127,101 @@ size_t CalculateInstructionFullSize(int args_count, const InstructionArgument *a
     return result;
 }
 
+// Действие инструкций на стек. Инструкции с одним именем отличаются только формой аргументов, поэтому действие
+// определяется именем и числом аргументов (-1 -- любым)
+struct StackEffect {
+    const char* name;
+    int args_count;
+    int pops;
+    int pushes;
+};
+const static int SLOT = sizeof(friday_constant_t);
+const static StackEffect STACK_EFFECTS[] = {
+    {"end", -1, 0, 0}, {"trap", -1, 0, 0}, {"jmp", -1, 0, 0},
+    {"push", -1, 0, SLOT}, {"pop", -1, SLOT, 0}, {"dup", -1, SLOT, 2 * SLOT}, {"swap", -1, 2 * SLOT, 2 * SLOT},
+    {"over", -1, 2 * SLOT, 3 * SLOT}, {"drop", -1, SLOT, 0},
+    {"in", -1, 0, SLOT}, {"in_f", -1, 0, SLOT}, {"out", -1, SLOT, 0}, {"outf", -1, SLOT, 0},
+    {"dep", -1, 0, SLOT}, {"call", -1, 0, SLOT}, {"ret", -1, SLOT, 0},
+    {"ci2f", -1, SLOT, SLOT}, {"cf2i", -1, SLOT, SLOT}, {"sqrt", -1, SLOT, SLOT},
+    // Comparison pops two values, the register forms do not touch the stack
+    {"ja", 1, 2 * SLOT, 0}, {"jae", 1, 2 * SLOT, 0}, {"jb", 1, 2 * SLOT, 0}, {"jbe", 1, 2 * SLOT, 0},
+    {"je", 1, 2 * SLOT, 0}, {"jne", 1, 2 * SLOT, 0}, {"jaf", 1, 2 * SLOT, 0}, {"jaef", 1, 2 * SLOT, 0},
+    {"jbf", 1, 2 * SLOT, 0}, {"jbef", 1, 2 * SLOT, 0}, {"jef", 1, 2 * SLOT, 0}, {"jnef", 1, 2 * SLOT, 0},
+    {"ja", 3, 0, 0}, {"jae", 3, 0, 0}, {"jb", 3, 0, 0}, {"jbe", 3, 0, 0}, {"je", 3, 0, 0}, {"jne", 3, 0, 0},
+    {"add", 0, 2 * SLOT, SLOT}, {"sub", 0, 2 * SLOT, SLOT}, {"mul", 0, 2 * SLOT, SLOT}, {"div", 0, 2 * SLOT, SLOT},
+    {"mod", 0, 2 * SLOT, SLOT}, {"addf", 0, 2 * SLOT, SLOT}, {"subf", 0, 2 * SLOT, SLOT},
+    {"mulf", 0, 2 * SLOT, SLOT}, {"divf", 0, 2 * SLOT, SLOT},
+    {"add", 2, 0, 0}, {"sub", 2, 0, 0}, {"mul", 2, 0, 0}, {"div", 2, 0, 0}, {"mod", 2, 0, 0},
+    {"addf", 2, 0, 0}, {"subf", 2, 0, 0}, {"mulf", 2, 0, 0}, {"divf", 2, 0, 0},
+    {"vadd", -1, 2 * VECTOR_SIZE, VECTOR_SIZE}, {"vsub", -1, 2 * VECTOR_SIZE, VECTOR_SIZE},
+    {"vmul", -1, 2 * VECTOR_SIZE, VECTOR_SIZE}, {"vcmpeq", -1, 2 * VECTOR_SIZE, VECTOR_SIZE},
+    {"vcmpgt", -1, 2 * VECTOR_SIZE, VECTOR_SIZE}, {"vaddf", -1, 2 * VECTOR_SIZE, VECTOR_SIZE},
+    {"vsubf", -1, 2 * VECTOR_SIZE, VECTOR_SIZE}, {"vmulf", -1, 2 * VECTOR_SIZE, VECTOR_SIZE},
+    {"vcmpeqf", -1, 2 * VECTOR_SIZE, VECTOR_SIZE}, {"vcmpgtf", -1, 2 * VECTOR_SIZE, VECTOR_SIZE},
+    {"vhsum", -1, VECTOR_SIZE, SLOT}, {"vhsumf", -1, VECTOR_SIZE, SLOT}, {"vsplat", -1, SLOT, VECTOR_SIZE},
+    {"vfmaf", -1, 3 * VECTOR_SIZE, VECTOR_SIZE}, {"vsqrtf", -1, VECTOR_SIZE, VECTOR_SIZE},
+    {"ld", 2, 0, SLOT}, {"ld", 0, SLOT, SLOT}, {"st", 2, SLOT, 0}, {"st", 0, 2 * SLOT, 0},
+    {"ldb", -1, 0, SLOT}, {"stb", -1, SLOT, 0}, {"vld", -1, 0, VECTOR_SIZE}, {"vst", -1, VECTOR_SIZE, 0},
+    {"memcpy", -1, 3 * SLOT, 0}, {"memset", -1, 3 * SLOT, 0}, {"memcmp", -1, 3 * SLOT, SLOT},
+    {"spawn", -1, SLOT, SLOT}, {"join", -1, SLOT, SLOT}, {"xadd", -1, 2 * SLOT, SLOT},
+};
+
+// Instructions missing from the table (syscall) have unknown effect
+static StackEffect GetStackEffect(const char* name, int args_count) {
+    for (auto& effect : STACK_EFFECTS) {
+        if (strcmp(effect.name, name) == 0 && (effect.args_count == -1 || effect.args_count == args_count)) {
+            return effect;
+        }
+    }
+    return {name, args_count, -1, -1};
+}
+
 Instruction::Instruction(const char *name, friday_inst_t instruction, int args_count,
-                     const InstructionArgument *args, void (*callback)(Emulator*)) :
+                     const InstructionArgument *args, void (*callback)(Emulator*), InstructionFlow flow,
+                     InstructionIO io) :
     name(name),
     inst(instruction),
     args_count(args_count),
     args(args),
     inst_full_size(CalculateInstructionFullSize(args_count, args)),
-    callback(callback)
+    callback(callback),
+    flow(flow),
+    io(io),
+    stack_pops(GetStackEffect(name, args_count).pops),
+    stack_pushes(GetStackEffect(name, args_count).pushes)
 {}
 
 
 //**  MACROS FOR INSTRUCTIONS  **//
 //#################################################################################################
 #define FRIDAY_INST_CLASS_NAME(name, inst) __Instruction##_##name##_##inst
-#define FRIDAY_INST(name, inst, args)                                                                        \
+// Arguments are variadic, because braced list of several arguments contains commas
+#define FRIDAY_INST(name, inst, ...) FRIDAY_INST_IMPL(name, inst, FLOW_NEXT, IO_NONE, __VA_ARGS__)
+#define FRIDAY_INST_FLOW(name, inst, args, flow) FRIDAY_INST_IMPL(name, inst, flow, IO_NONE, args)
+#define FRIDAY_INST_IO(name, inst, args, io) FRIDAY_INST_IMPL(name, inst, FLOW_NEXT, io, args)
+#define FRIDAY_INST_BRANCH(name, inst, ...) FRIDAY_INST_IMPL(name, inst, FLOW_BRANCH, IO_NONE, __VA_ARGS__)
+// Instructions which end a run of straight-line code pay for the next run (see Emulator::ChargeFuel), so the
+// instructions inside the run cost nothing
+#define FRIDAY_INST_IMPL(name, inst, flow, io, ...)                                                          \
 class FRIDAY_INST_CLASS_NAME(name, inst) {                                                                   \
     FRIDAY_INST_CLASS_NAME(name, inst)() = default; /* Private constructor */                                \
 public:                                                                                                      \
     static void Execute(Emulator*);                                                                          \
+    static void Body(Emulator*);                                                                             \
     static char __register_instruction __attribute__ ((unused));                                             \
 };                                                                                                           \
 char FRIDAY_INST_CLASS_NAME(name, inst)::__register_instruction = RegisterInstruction(                       \
         #name /* name */, inst /* instruction */,                                                            \
-        sizeof((InstructionArgument[]) args) / sizeof(InstructionArgument) /* args_count */,                 \
-        (InstructionArgument[]) args /* args */,                                                             \
-        FRIDAY_INST_CLASS_NAME(name, inst)::Execute /* callback */ );                                        \
-void FRIDAY_INST_CLASS_NAME(name, inst)::Execute(Emulator* emu) /* now define callback */
+        sizeof((InstructionArgument[]) __VA_ARGS__) / sizeof(InstructionArgument) /* args_count */,          \
+        (InstructionArgument[]) __VA_ARGS__ /* args */,                                                      \
+        FRIDAY_INST_CLASS_NAME(name, inst)::Execute /* callback */, flow, io);                               \
+void FRIDAY_INST_CLASS_NAME(name, inst)::Execute(Emulator* emu) {                                            \
+    Body(emu);                                                                                               \
+    if constexpr (flow != FLOW_NEXT && flow != FLOW_EXIT) {                                                  \
+        emu->ChargeFuel();                                                                                   \
+    }                                                                                                        \
+}                                                                                                            \
+void FRIDAY_INST_CLASS_NAME(name, inst)::Body(Emulator* emu) /* now define callback */
 //#################################################################################################
 
 
@@ -131,46 +230,87 @@ void FRIDAY_INST_CLASS_NAME(name, inst)::Execute(Emulator* emu) /* now define ca
 using namespace BytesHelper;
 inline void InstDepart(Emulator* emu);
 inline void InstUnconditionalJump(Emulator* emu);
+inline void InstShortJump(Emulator* emu);
 template <typename U, typename T>
 inline void InstConditionalJump(Emulator* emu, T condition);
 template <typename U, typename T>
+inline void InstConditionalShortJump(Emulator* emu, T condition);
+template <typename U>
+inline void InstPushShortConstant(Emulator* emu);
+inline void InstVectorBinary(Emulator* emu, void (*kernel)(const char*, const char*, char*));
+template <typename U>
+inline void InstVectorReduce(Emulator* emu, U (*kernel)(const char*));
+inline void InstVectorSplat(Emulator* emu);
+inline void InstVectorFma(Emulator* emu);
+inline void InstVectorSqrt(Emulator* emu);
+static const VectorKernels& VECTOR_KERNELS = GetVectorKernels();
+struct VectorBytes {
+    char bytes[VECTOR_SIZE];
+};
+template <typename A, typename U = int32_t>
+inline void InstLoad(Emulator* emu);
+template <typename A, typename U = int32_t>
+inline void InstStore(Emulator* emu);
+inline void InstLoadFromStack(Emulator* emu);
+inline void InstStoreFromStack(Emulator* emu);
+inline void InstMemcpy(Emulator* emu);
+inline void InstMemset(Emulator* emu);
+inline void InstMemcmp(Emulator* emu);
+inline void InstPushPackedRegister(Emulator* emu);
+inline void InstPopPackedRegister(Emulator* emu);
+template <typename T>
+inline void InstInput(Emulator* emu, const char* format);
+template <typename T>
+inline void InstOutput(Emulator* emu, const char* format, T value);
+template <typename A>
+inline void InstSyscall(Emulator* emu);
+inline void InstSpawn(Emulator* emu);
+inline void InstJoin(Emulator* emu);
+inline void InstAtomicAdd(Emulator* emu);
+template <typename U, typename T>
 inline void InstArithmetics(Emulator* emu, T operation);
+template <typename U, typename A, typename T>
+inline void InstRegisterArithmetics(Emulator* emu, T operation);
+template <typename A, typename L, typename T>
+inline void InstRegisterBranch(Emulator* emu, T condition);
+inline void InstPushStackSlot(Emulator* emu, int slot);
+inline void InstSwap(Emulator* emu);
 //------------------------------------------------------------------------------------
-FRIDAY_INST(end,  0x00, {})            { emu->signal = Emulator::SIGNAL_EXIT; }
+FRIDAY_INST_FLOW(end,  0x00, {}, FLOW_EXIT)            { emu->signal = Emulator::SIGNAL_EXIT; }
 FRIDAY_INST(push, 0x01, { CONSTANT })  { emu->push(emu->get_arg_ptr(), 4); }
 FRIDAY_INST(push, 0x02, { REGISTER })  { int32_t value = emu->regs[BytesAs<uint8_t>(emu->get_arg_ptr())];
                                          emu->push(AsBytes(value), 4); }
 FRIDAY_INST(pop,  0x03, { REGISTER })  { emu->regs[BytesAs<uint8_t>(emu->get_arg_ptr())] = emu->pop_int();
                                          /* either would work with float */ }
-FRIDAY_INST(in,   0x04, {})            { emu->sp -= 4; scanf("%d", &BytesAs<int>(emu->get_stack_ptr())); }
-FRIDAY_INST(out,  0x05, {})            { printf("%d\n", emu->pop_int()); }
-FRIDAY_INST(outf, 0x06, {})            { printf("%g\n", emu->pop_float()); }
+FRIDAY_INST_IO(in,   0x04, {}, IO_INPUT)    { InstInput<int32_t>(emu, "%d"); }
+FRIDAY_INST_IO(out,  0x05, {}, IO_OUTPUT)   { InstOutput(emu, "%d\n", emu->pop_int()); }
+FRIDAY_INST_IO(outf, 0x06, {}, IO_OUTPUT)   { InstOutput(emu, "%g\n", emu->pop_float()); }
 // dep (fully: depart) = push ip
-FRIDAY_INST(dep,  0x07, {})            { InstDepart(emu); }
+FRIDAY_INST_FLOW(dep,  0x07, {}, FLOW_CALL)            { InstDepart(emu); }
 // call = push ip && jmp LABEL
-FRIDAY_INST(call, 0x08, { LABEL })     { InstDepart(emu); InstUnconditionalJump(emu); }
+FRIDAY_INST_FLOW(call, 0x08, { LABEL }, FLOW_CALL)     { InstDepart(emu); InstUnconditionalJump(emu); }
 // ret (fully: return) = pop ip
-FRIDAY_INST(ret,  0x09, {})            { emu->ip = emu->pop_int(); }
+FRIDAY_INST_FLOW(ret,  0x09, {}, FLOW_RET)             { emu->ip = emu->pop_int(); }
 // ci2f (full convert integer to float) = pop integer && push float of the same value
 FRIDAY_INST(ci2f, 0x0a, {})           { emu->push(AsBytes(static_cast<float>(emu->pop_int())), sizeof(float)); }
 // ci2f (full convert float to integer) = pop float && push integer of the same value
 FRIDAY_INST(cf2i, 0x0b, {})           { emu->push(AsBytes(static_cast<int>(emu->pop_float())), sizeof(int)); }
-FRIDAY_INST(in_f, 0x0c, {})           { emu->sp -= 4; scanf("%f", &BytesAs<float>(emu->get_stack_ptr())); }
+FRIDAY_INST_IO(in_f, 0x0c, {}, IO_INPUT)   { InstInput<float>(emu, "%f"); }
 
 
-FRIDAY_INST(jmp,  0x10, { LABEL })    { InstUnconditionalJump(emu); }
-FRIDAY_INST(ja,   0x11, { LABEL })    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a >  b; }); }
-FRIDAY_INST(jae,  0x12, { LABEL })    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a >= b; }); }
-FRIDAY_INST(jb,   0x13, { LABEL })    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a <  b; }); }
-FRIDAY_INST(jbe,  0x14, { LABEL })    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a <= b; }); }
-FRIDAY_INST(je,   0x15, { LABEL })    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a == b; }); }
-FRIDAY_INST(jne,  0x16, { LABEL })    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a != b; }); }
-FRIDAY_INST(jaf,  0x1a, { LABEL })    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a >  b; }); }
-FRIDAY_INST(jaef, 0x1b, { LABEL })    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a >= b; }); }
-FRIDAY_INST(jbf,  0x1c, { LABEL })    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a <  b; }); }
-FRIDAY_INST(jbef, 0x1d, { LABEL })    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a <= b; }); }
-FRIDAY_INST(jef,  0x1e, { LABEL })    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a == b; }); }
-FRIDAY_INST(jnef, 0x1f, { LABEL })    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a != b; }); }
+FRIDAY_INST_FLOW(jmp,  0x10, { LABEL }, FLOW_JUMP)    { InstUnconditionalJump(emu); }
+FRIDAY_INST_FLOW(ja,   0x11, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a >  b; }); }
+FRIDAY_INST_FLOW(jae,  0x12, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a >= b; }); }
+FRIDAY_INST_FLOW(jb,   0x13, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a <  b; }); }
+FRIDAY_INST_FLOW(jbe,  0x14, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a <= b; }); }
+FRIDAY_INST_FLOW(je,   0x15, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a == b; }); }
+FRIDAY_INST_FLOW(jne,  0x16, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<int>(emu, [] (int a, int b) -> bool { return a != b; }); }
+FRIDAY_INST_FLOW(jaf,  0x1a, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a >  b; }); }
+FRIDAY_INST_FLOW(jaef, 0x1b, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a >= b; }); }
+FRIDAY_INST_FLOW(jbf,  0x1c, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a <  b; }); }
+FRIDAY_INST_FLOW(jbef, 0x1d, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a <= b; }); }
+FRIDAY_INST_FLOW(jef,  0x1e, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a == b; }); }
+FRIDAY_INST_FLOW(jnef, 0x1f, { LABEL }, FLOW_BRANCH)    { InstConditionalJump<float>(emu, [] (float a, float b) -> bool { return a != b; }); }
 
 
 FRIDAY_INST(add,  0x20, {})           { InstArithmetics<int>(emu, [] (int a, int b) -> int { return a + b; }); }
@@ -183,6 +323,177 @@ FRIDAY_INST(subf, 0x2b, {})           { InstArithmetics<float>(emu, [] (float a,
 FRIDAY_INST(mulf, 0x2c, {})           { InstArithmetics<float>(emu, [] (float a, float b) -> float { return a * b; }); }
 FRIDAY_INST(divf, 0x2d, {})           { InstArithmetics<float>(emu, [] (float a, float b) -> float { return a / b; }); }
 FRIDAY_INST(sqrt, 0x2e, {})           { emu->push(AsBytes(static_cast<float>(sqrt(emu->pop_float()))), sizeof(friday_constant_t)); }
+
+
+// Short forms (arch version 2). Assembler chooses them automatically
+FRIDAY_INST(push, 0x30, { CONSTANT_8 })       { InstPushShortConstant<int8_t>(emu); }
+FRIDAY_INST(push, 0x31, { CONSTANT_16 })      { InstPushShortConstant<int16_t>(emu); }
+
+FRIDAY_INST(push, 0x40, { PACKED_REGISTER })  { InstPushPackedRegister(emu); }
+FRIDAY_INST(push, 0x41, { PACKED_REGISTER })  { InstPushPackedRegister(emu); }
+FRIDAY_INST(push, 0x42, { PACKED_REGISTER })  { InstPushPackedRegister(emu); }
+FRIDAY_INST(push, 0x43, { PACKED_REGISTER })  { InstPushPackedRegister(emu); }
+FRIDAY_INST(push, 0x44, { PACKED_REGISTER })  { InstPushPackedRegister(emu); }
+FRIDAY_INST(push, 0x45, { PACKED_REGISTER })  { InstPushPackedRegister(emu); }
+FRIDAY_INST(push, 0x46, { PACKED_REGISTER })  { InstPushPackedRegister(emu); }
+FRIDAY_INST(push, 0x47, { PACKED_REGISTER })  { InstPushPackedRegister(emu); }
+FRIDAY_INST(pop,  0x48, { PACKED_REGISTER })  { InstPopPackedRegister(emu); }
+FRIDAY_INST(pop,  0x49, { PACKED_REGISTER })  { InstPopPackedRegister(emu); }
+FRIDAY_INST(pop,  0x4a, { PACKED_REGISTER })  { InstPopPackedRegister(emu); }
+FRIDAY_INST(pop,  0x4b, { PACKED_REGISTER })  { InstPopPackedRegister(emu); }
+FRIDAY_INST(pop,  0x4c, { PACKED_REGISTER })  { InstPopPackedRegister(emu); }
+FRIDAY_INST(pop,  0x4d, { PACKED_REGISTER })  { InstPopPackedRegister(emu); }
+FRIDAY_INST(pop,  0x4e, { PACKED_REGISTER })  { InstPopPackedRegister(emu); }
+FRIDAY_INST(pop,  0x4f, { PACKED_REGISTER })  { InstPopPackedRegister(emu); }
+
+FRIDAY_INST_FLOW(jmp,  0x50, { LABEL_REL_8 }, FLOW_JUMP)  { InstShortJump(emu); }
+FRIDAY_INST_FLOW(ja,   0x51, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<int>(emu, [] (int a, int b) -> bool { return a >  b; }); }
+FRIDAY_INST_FLOW(jae,  0x52, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<int>(emu, [] (int a, int b) -> bool { return a >= b; }); }
+FRIDAY_INST_FLOW(jb,   0x53, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<int>(emu, [] (int a, int b) -> bool { return a <  b; }); }
+FRIDAY_INST_FLOW(jbe,  0x54, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<int>(emu, [] (int a, int b) -> bool { return a <= b; }); }
+FRIDAY_INST_FLOW(je,   0x55, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<int>(emu, [] (int a, int b) -> bool { return a == b; }); }
+FRIDAY_INST_FLOW(jne,  0x56, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<int>(emu, [] (int a, int b) -> bool { return a != b; }); }
+FRIDAY_INST_FLOW(jaf,  0x5a, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<float>(emu, [] (float a, float b) -> bool { return a >  b; }); }
+FRIDAY_INST_FLOW(jaef, 0x5b, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<float>(emu, [] (float a, float b) -> bool { return a >= b; }); }
+FRIDAY_INST_FLOW(jbf,  0x5c, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<float>(emu, [] (float a, float b) -> bool { return a <  b; }); }
+FRIDAY_INST_FLOW(jbef, 0x5d, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<float>(emu, [] (float a, float b) -> bool { return a <= b; }); }
+FRIDAY_INST_FLOW(jef,  0x5e, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<float>(emu, [] (float a, float b) -> bool { return a == b; }); }
+FRIDAY_INST_FLOW(jnef, 0x5f, { LABEL_REL_8 }, FLOW_BRANCH)  { InstConditionalShortJump<float>(emu, [] (float a, float b) -> bool { return a != b; }); }
+
+
+// Vector instructions: a vector is VECTOR_LANES int or float values on the stack, lane 0 is at sp.
+// Binary ones pop b, then a and push (a op b)
+FRIDAY_INST(vadd,    0x60, {})       { InstVectorBinary(emu, VECTOR_KERNELS.add_i32); }
+FRIDAY_INST(vsub,    0x61, {})       { InstVectorBinary(emu, VECTOR_KERNELS.sub_i32); }
+FRIDAY_INST(vmul,    0x62, {})       { InstVectorBinary(emu, VECTOR_KERNELS.mul_i32); }
+// vhsum = pop vector && push sum of its lanes
+FRIDAY_INST(vhsum,   0x63, {})       { InstVectorReduce(emu, VECTOR_KERNELS.hsum_i32); }
+// vcmp* = lane is -1 where condition is true and 0 otherwise
+FRIDAY_INST(vcmpeq,  0x64, {})       { InstVectorBinary(emu, VECTOR_KERNELS.cmpeq_i32); }
+FRIDAY_INST(vcmpgt,  0x65, {})       { InstVectorBinary(emu, VECTOR_KERNELS.cmpgt_i32); }
+// vsplat = pop value && push vector with this value in every lane
+FRIDAY_INST(vsplat,  0x66, {})       { InstVectorSplat(emu); }
+FRIDAY_INST(vaddf,   0x68, {})       { InstVectorBinary(emu, VECTOR_KERNELS.add_f32); }
+FRIDAY_INST(vsubf,   0x69, {})       { InstVectorBinary(emu, VECTOR_KERNELS.sub_f32); }
+FRIDAY_INST(vmulf,   0x6a, {})       { InstVectorBinary(emu, VECTOR_KERNELS.mul_f32); }
+FRIDAY_INST(vhsumf,  0x6b, {})       { InstVectorReduce(emu, VECTOR_KERNELS.hsum_f32); }
+FRIDAY_INST(vcmpeqf, 0x6c, {})       { InstVectorBinary(emu, VECTOR_KERNELS.cmpeq_f32); }
+FRIDAY_INST(vcmpgtf, 0x6d, {})       { InstVectorBinary(emu, VECTOR_KERNELS.cmpgt_f32); }
+// vfmaf = pop c, b, a && push a * b + c
+FRIDAY_INST(vfmaf,   0x6e, {})       { InstVectorFma(emu); }
+FRIDAY_INST(vsqrtf,  0x6f, {})       { InstVectorSqrt(emu); }
+
+
+// Memory access. Address is (value of register + offset), or is popped from stack when there are no arguments.
+// Access out of emulator memory raises SIGSEGV
+// ld = push 4 bytes from memory
+FRIDAY_INST(ld,     0x70, { REGISTER, CONSTANT })    { InstLoad<friday_constant_t>(emu); }
+FRIDAY_INST(ld,     0x71, { REGISTER, CONSTANT_8 })  { InstLoad<int8_t>(emu); }
+// st = pop 4 bytes to memory
+FRIDAY_INST(st,     0x72, { REGISTER, CONSTANT })    { InstStore<friday_constant_t>(emu); }
+FRIDAY_INST(st,     0x73, { REGISTER, CONSTANT_8 })  { InstStore<int8_t>(emu); }
+// ld = pop address && push 4 bytes from it
+FRIDAY_INST(ld,     0x74, {})                        { InstLoadFromStack(emu); }
+// st = pop value, pop address && write value to address
+FRIDAY_INST(st,     0x75, {})                        { InstStoreFromStack(emu); }
+// ldb, stb = same as ld and st with one byte, the byte is zero-extended to int
+FRIDAY_INST(ldb,    0x76, { REGISTER, CONSTANT })    { InstLoad<friday_constant_t, uint8_t>(emu); }
+FRIDAY_INST(stb,    0x77, { REGISTER, CONSTANT })    { InstStore<friday_constant_t, uint8_t>(emu); }
+// vld, vst = same as ld and st with a whole vector
+FRIDAY_INST(vld,    0x78, { REGISTER, CONSTANT })    { InstLoad<friday_constant_t, VectorBytes>(emu); }
+FRIDAY_INST(vst,    0x79, { REGISTER, CONSTANT })    { InstStore<friday_constant_t, VectorBytes>(emu); }
+// memcpy = pop n, src, dst && copy n bytes from src to dst (ranges may overlap)
+FRIDAY_INST(memcpy, 0x7c, {})                        { InstMemcpy(emu); }
+// memset = pop n, byte, dst && fill n bytes at dst with byte
+FRIDAY_INST(memset, 0x7d, {})                        { InstMemset(emu); }
+// memcmp = pop n, b, a && push -1, 0 or 1 comparing n bytes at a and b as unsigned
+FRIDAY_INST(memcmp, 0x7e, {})                        { InstMemcmp(emu); }
+
+
+// Guest threads, see GuestScheduler. Without scheduler these instructions raise SIGILL
+// spawn = pop arg && start new thread from LABEL with arg on its stack && push id of the thread (-1 if too many threads)
+FRIDAY_INST_FLOW(spawn, 0x80, { LABEL }, FLOW_SPAWN) { InstSpawn(emu); }
+// join = pop id && wait until the thread ends && push value from the top of its stack (0 if its stack is empty)
+FRIDAY_INST(join,   0x81, {})                        { InstJoin(emu); }
+// xadd = pop value, pop address && atomically add value to 4 bytes at address && push old value
+// Address must be aligned by 4, otherwise SIGSEGV
+FRIDAY_INST(xadd,   0x82, {})                        { InstAtomicAdd(emu); }
+
+
+// syscall = call host intrinsic with this number (see Intrinsics.cpp), unknown number raises SIGILL
+FRIDAY_INST(syscall, 0x90, { CONSTANT })             { InstSyscall<friday_constant_t>(emu); }
+FRIDAY_INST(syscall, 0x91, { CONSTANT_8 })           { InstSyscall<int8_t>(emu); }
+
+
+// Stack manipulation
+// dup = push copy of the top value
+FRIDAY_INST(dup,    0xa0, {})                        { InstPushStackSlot(emu, 0); }
+// swap = exchange two top values
+FRIDAY_INST(swap,   0xa1, {})                        { InstSwap(emu); }
+// over = push copy of the value under the top
+FRIDAY_INST(over,   0xa2, {})                        { InstPushStackSlot(emu, 1); }
+// drop = pop and forget the top value
+FRIDAY_INST(drop,   0xa3, {})                        { emu->pop(sizeof(friday_constant_t)); }
+
+
+// Register forms of arithmetics: op rX, Y = (rX = rX op Y), Y is a register or a constant. Stack is not touched
+FRIDAY_INST(add,  0xb0, { REGISTER, REGISTER })      { InstRegisterArithmetics<int, friday_reg_t>(emu, [] (int a, int b) -> int { return a + b; }); }
+FRIDAY_INST(sub,  0xb1, { REGISTER, REGISTER })      { InstRegisterArithmetics<int, friday_reg_t>(emu, [] (int a, int b) -> int { return a - b; }); }
+FRIDAY_INST(mul,  0xb2, { REGISTER, REGISTER })      { InstRegisterArithmetics<int, friday_reg_t>(emu, [] (int a, int b) -> int { return a * b; }); }
+FRIDAY_INST(div,  0xb3, { REGISTER, REGISTER })      { InstRegisterArithmetics<int, friday_reg_t>(emu, [] (int a, int b) -> int { return a / b; }); }
+FRIDAY_INST(mod,  0xb4, { REGISTER, REGISTER })      { InstRegisterArithmetics<int, friday_reg_t>(emu, [] (int a, int b) -> int { return a % b; }); }
+FRIDAY_INST(addf, 0xba, { REGISTER, REGISTER })      { InstRegisterArithmetics<float, friday_reg_t>(emu, [] (float a, float b) -> float { return a + b; }); }
+FRIDAY_INST(subf, 0xbb, { REGISTER, REGISTER })      { InstRegisterArithmetics<float, friday_reg_t>(emu, [] (float a, float b) -> float { return a - b; }); }
+FRIDAY_INST(mulf, 0xbc, { REGISTER, REGISTER })      { InstRegisterArithmetics<float, friday_reg_t>(emu, [] (float a, float b) -> float { return a * b; }); }
+FRIDAY_INST(divf, 0xbd, { REGISTER, REGISTER })      { InstRegisterArithmetics<float, friday_reg_t>(emu, [] (float a, float b) -> float { return a / b; }); }
+
+FRIDAY_INST(add,  0xc0, { REGISTER, CONSTANT_8 })    { InstRegisterArithmetics<int, int8_t>(emu, [] (int a, int b) -> int { return a + b; }); }
+FRIDAY_INST(sub,  0xc1, { REGISTER, CONSTANT_8 })    { InstRegisterArithmetics<int, int8_t>(emu, [] (int a, int b) -> int { return a - b; }); }
+FRIDAY_INST(mul,  0xc2, { REGISTER, CONSTANT_8 })    { InstRegisterArithmetics<int, int8_t>(emu, [] (int a, int b) -> int { return a * b; }); }
+FRIDAY_INST(div,  0xc3, { REGISTER, CONSTANT_8 })    { InstRegisterArithmetics<int, int8_t>(emu, [] (int a, int b) -> int { return a / b; }); }
+FRIDAY_INST(mod,  0xc4, { REGISTER, CONSTANT_8 })    { InstRegisterArithmetics<int, int8_t>(emu, [] (int a, int b) -> int { return a % b; }); }
+
+FRIDAY_INST(add,  0xd0, { REGISTER, CONSTANT })      { InstRegisterArithmetics<int, friday_constant_t>(emu, [] (int a, int b) -> int { return a + b; }); }
+FRIDAY_INST(sub,  0xd1, { REGISTER, CONSTANT })      { InstRegisterArithmetics<int, friday_constant_t>(emu, [] (int a, int b) -> int { return a - b; }); }
+FRIDAY_INST(mul,  0xd2, { REGISTER, CONSTANT })      { InstRegisterArithmetics<int, friday_constant_t>(emu, [] (int a, int b) -> int { return a * b; }); }
+FRIDAY_INST(div,  0xd3, { REGISTER, CONSTANT })      { InstRegisterArithmetics<int, friday_constant_t>(emu, [] (int a, int b) -> int { return a / b; }); }
+FRIDAY_INST(mod,  0xd4, { REGISTER, CONSTANT })      { InstRegisterArithmetics<int, friday_constant_t>(emu, [] (int a, int b) -> int { return a % b; }); }
+FRIDAY_INST(addf, 0xda, { REGISTER, CONSTANT })      { InstRegisterArithmetics<float, friday_constant_t>(emu, [] (float a, float b) -> float { return a + b; }); }
+FRIDAY_INST(subf, 0xdb, { REGISTER, CONSTANT })      { InstRegisterArithmetics<float, friday_constant_t>(emu, [] (float a, float b) -> float { return a - b; }); }
+FRIDAY_INST(mulf, 0xdc, { REGISTER, CONSTANT })      { InstRegisterArithmetics<float, friday_constant_t>(emu, [] (float a, float b) -> float { return a * b; }); }
+FRIDAY_INST(divf, 0xdd, { REGISTER, CONSTANT })      { InstRegisterArithmetics<float, friday_constant_t>(emu, [] (float a, float b) -> float { return a / b; }); }
+
+
+// Compare and branch: jCC rX, Y, LABEL = jump if (rX CC Y), Y is a register or a constant. Stack is not touched
+FRIDAY_INST_BRANCH(ja,  0xe1, { REGISTER, CONSTANT_8, LABEL_REL_8 })        { InstRegisterBranch<int8_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a >  b; }); }
+FRIDAY_INST_BRANCH(jae, 0xe2, { REGISTER, CONSTANT_8, LABEL_REL_8 })        { InstRegisterBranch<int8_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a >= b; }); }
+FRIDAY_INST_BRANCH(jb,  0xe3, { REGISTER, CONSTANT_8, LABEL_REL_8 })        { InstRegisterBranch<int8_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a <  b; }); }
+FRIDAY_INST_BRANCH(jbe, 0xe4, { REGISTER, CONSTANT_8, LABEL_REL_8 })        { InstRegisterBranch<int8_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a <= b; }); }
+FRIDAY_INST_BRANCH(je,  0xe5, { REGISTER, CONSTANT_8, LABEL_REL_8 })        { InstRegisterBranch<int8_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a == b; }); }
+FRIDAY_INST_BRANCH(jne, 0xe6, { REGISTER, CONSTANT_8, LABEL_REL_8 })        { InstRegisterBranch<int8_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a != b; }); }
+FRIDAY_INST_BRANCH(ja,  0xe9, { REGISTER, REGISTER, LABEL_REL_8 })          { InstRegisterBranch<friday_reg_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a >  b; }); }
+FRIDAY_INST_BRANCH(jae, 0xea, { REGISTER, REGISTER, LABEL_REL_8 })          { InstRegisterBranch<friday_reg_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a >= b; }); }
+FRIDAY_INST_BRANCH(jb,  0xeb, { REGISTER, REGISTER, LABEL_REL_8 })          { InstRegisterBranch<friday_reg_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a <  b; }); }
+FRIDAY_INST_BRANCH(jbe, 0xec, { REGISTER, REGISTER, LABEL_REL_8 })          { InstRegisterBranch<friday_reg_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a <= b; }); }
+FRIDAY_INST_BRANCH(je,  0xed, { REGISTER, REGISTER, LABEL_REL_8 })          { InstRegisterBranch<friday_reg_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a == b; }); }
+FRIDAY_INST_BRANCH(jne, 0xee, { REGISTER, REGISTER, LABEL_REL_8 })          { InstRegisterBranch<friday_reg_t, friday_short_offset_t>(emu, [] (int a, int b) -> bool { return a != b; }); }
+FRIDAY_INST_BRANCH(ja,  0xf1, { REGISTER, CONSTANT, LABEL })                { InstRegisterBranch<friday_constant_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a >  b; }); }
+FRIDAY_INST_BRANCH(jae, 0xf2, { REGISTER, CONSTANT, LABEL })                { InstRegisterBranch<friday_constant_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a >= b; }); }
+FRIDAY_INST_BRANCH(jb,  0xf3, { REGISTER, CONSTANT, LABEL })                { InstRegisterBranch<friday_constant_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a <  b; }); }
+FRIDAY_INST_BRANCH(jbe, 0xf4, { REGISTER, CONSTANT, LABEL })                { InstRegisterBranch<friday_constant_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a <= b; }); }
+FRIDAY_INST_BRANCH(je,  0xf5, { REGISTER, CONSTANT, LABEL })                { InstRegisterBranch<friday_constant_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a == b; }); }
+FRIDAY_INST_BRANCH(jne, 0xf6, { REGISTER, CONSTANT, LABEL })                { InstRegisterBranch<friday_constant_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a != b; }); }
+FRIDAY_INST_BRANCH(ja,  0xf9, { REGISTER, REGISTER, LABEL })                { InstRegisterBranch<friday_reg_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a >  b; }); }
+FRIDAY_INST_BRANCH(jae, 0xfa, { REGISTER, REGISTER, LABEL })                { InstRegisterBranch<friday_reg_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a >= b; }); }
+FRIDAY_INST_BRANCH(jb,  0xfb, { REGISTER, REGISTER, LABEL })                { InstRegisterBranch<friday_reg_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a <  b; }); }
+FRIDAY_INST_BRANCH(jbe, 0xfc, { REGISTER, REGISTER, LABEL })                { InstRegisterBranch<friday_reg_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a <= b; }); }
+FRIDAY_INST_BRANCH(je,  0xfd, { REGISTER, REGISTER, LABEL })                { InstRegisterBranch<friday_reg_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a == b; }); }
+FRIDAY_INST_BRANCH(jne, 0xfe, { REGISTER, REGISTER, LABEL })                { InstRegisterBranch<friday_reg_t, friday_address_t>(emu, [] (int a, int b) -> bool { return a != b; }); }
+
+
+// trap = raise SIGNAL_TRAP, ip stays at the trap. The debugger patches it over instructions with breakpoints
+FRIDAY_INST(trap,   TRAP_INSTRUCTION, {})            { emu->signal = Emulator::SIGNAL_TRAP;
+                                                       emu->ip = emu->ap - static_cast<int32_t>(sizeof(friday_inst_t)); }
 //------------------------------------------------------------------------------------
 inline void InstDepart(Emulator* emu) {
     emu->push(AsBytes(emu->ip), sizeof(emu->ip));
@@ -190,14 +501,219 @@ inline void InstDepart(Emulator* emu) {
 inline void InstUnconditionalJump(Emulator* emu) {
     emu->ip = BytesAs<friday_address_t>(emu->get_arg_ptr());
 }
+inline void InstShortJump(Emulator* emu) {
+    // ip already points to the next instruction
+    emu->ip += BytesAs<friday_short_offset_t>(emu->get_arg_ptr());
+}
 template <typename U, typename T>
-inline void InstConditionalJump(Emulator* emu, T condition) {
+inline bool PopAndCompare(Emulator* emu, T condition) {
     U op2 = BytesAs<U>(emu->pop(sizeof(friday_constant_t)));
     U op1 = BytesAs<U>(emu->pop(sizeof(friday_constant_t)));
-    if (condition(op1, op2)) {
-        emu->ip = BytesAs<friday_address_t>(emu->get_arg_ptr());
+    return condition(op1, op2);
+}
+template <typename U, typename T>
+inline void InstConditionalJump(Emulator* emu, T condition) {
+    if (PopAndCompare<U>(emu, condition)) {
+        InstUnconditionalJump(emu);
+    }
+}
+template <typename U, typename T>
+inline void InstConditionalShortJump(Emulator* emu, T condition) {
+    if (PopAndCompare<U>(emu, condition)) {
+        InstShortJump(emu);
+    }
+}
+template <typename U>
+inline void InstPushShortConstant(Emulator* emu) {
+    auto value = static_cast<int32_t>(BytesAs<U>(emu->get_arg_ptr()));
+    emu->push(AsBytes(value), sizeof(friday_constant_t));
+}
+inline void InstVectorBinary(Emulator* emu, void (*kernel)(const char*, const char*, char*)) {
+    const char* b = emu->pop(VECTOR_SIZE);
+    const char* a = emu->pop(VECTOR_SIZE);
+    emu->sp -= VECTOR_SIZE;  // Result takes place of a
+    kernel(a, b, emu->get_stack_ptr());
+}
+template <typename U>
+inline void InstVectorReduce(Emulator* emu, U (*kernel)(const char*)) {
+    U result = kernel(emu->pop(VECTOR_SIZE));
+    emu->push(AsBytes(result), sizeof(friday_constant_t));
+}
+inline void InstVectorSplat(Emulator* emu) {
+    int32_t value = emu->pop_int();
+    emu->sp -= VECTOR_SIZE;
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+        WriteBytes(emu->get_stack_ptr(), value, i * sizeof(friday_constant_t));
+    }
+}
+inline void InstVectorFma(Emulator* emu) {
+    const char* c = emu->pop(VECTOR_SIZE);
+    const char* b = emu->pop(VECTOR_SIZE);
+    const char* a = emu->pop(VECTOR_SIZE);
+    emu->sp -= VECTOR_SIZE;
+    VECTOR_KERNELS.fma_f32(a, b, c, emu->get_stack_ptr());
+}
+inline void InstVectorSqrt(Emulator* emu) {
+    VECTOR_KERNELS.sqrt_f32(emu->get_stack_ptr(), emu->get_stack_ptr());
+}
+// Returns (register + offset) address from instruction arguments, offset is stored as A
+template <typename A>
+inline int32_t GetRegisterOffsetAddress(Emulator* emu) {
+    const char* args = emu->get_arg_ptr();
+    int32_t base = emu->regs[BytesAs<friday_reg_t>(args)];
+    return base + static_cast<int32_t>(BytesAs<A>(args, sizeof(friday_reg_t)));
+}
+// Values narrower than a stack slot are zero-extended to friday_constant_t
+template <typename U>
+inline void PushValue(Emulator* emu, const U& value) {
+    if constexpr (sizeof(U) < sizeof(friday_constant_t)) {
+        emu->push(AsBytes(static_cast<friday_constant_t>(value)), sizeof(friday_constant_t));
+    } else {
+        emu->push(AsBytes(value), sizeof(U));
+    }
+}
+template <typename U>
+inline U PopValue(Emulator* emu) {
+    if constexpr (sizeof(U) < sizeof(friday_constant_t)) {
+        return static_cast<U>(BytesAs<friday_constant_t>(emu->pop(sizeof(friday_constant_t))));
+    } else {
+        return BytesAs<U>(emu->pop(sizeof(U)));
+    }
+}
+template <typename A, typename U>
+inline void InstLoad(Emulator* emu) {
+    const char* src = emu->get_memory_range(GetRegisterOffsetAddress<A>(emu), sizeof(U));
+    if (src != nullptr) {
+        PushValue(emu, BytesAs<U>(src));
+    }
+}
+template <typename A, typename U>
+inline void InstStore(Emulator* emu) {
+    char* dst = emu->get_writable_range(GetRegisterOffsetAddress<A>(emu), sizeof(U));
+    if (dst != nullptr) {
+        BytesAs<U>(dst) = PopValue<U>(emu);
+    }
+}
+inline void InstLoadFromStack(Emulator* emu) {
+    const char* src = emu->get_memory_range(emu->pop_int(), sizeof(friday_constant_t));
+    if (src != nullptr) {
+        emu->push(src, sizeof(friday_constant_t));
+    }
+}
+inline void InstStoreFromStack(Emulator* emu) {
+    int32_t value = emu->pop_int();
+    char* dst = emu->get_writable_range(emu->pop_int(), sizeof(friday_constant_t));
+    if (dst != nullptr) {
+        BytesAs<int32_t>(dst) = value;
+    }
+}
+// Bulk instructions check each range once and then run libc routines, which are vectorized
+inline void InstMemcpy(Emulator* emu) {
+    auto length = static_cast<uint32_t>(emu->pop_int());
+    int32_t src_address = emu->pop_int();
+    int32_t dst_address = emu->pop_int();
+    const char* src = emu->get_memory_range(src_address, length);
+    char* dst = emu->get_writable_range(dst_address, length);
+    if (src != nullptr && dst != nullptr) {
+        std::memmove(dst, src, length);
+    }
+}
+inline void InstMemset(Emulator* emu) {
+    auto length = static_cast<uint32_t>(emu->pop_int());
+    int32_t value = emu->pop_int();
+    char* dst = emu->get_writable_range(emu->pop_int(), length);
+    if (dst != nullptr) {
+        std::memset(dst, value, length);
+    }
+}
+inline void InstMemcmp(Emulator* emu) {
+    auto length = static_cast<uint32_t>(emu->pop_int());
+    int32_t b_address = emu->pop_int();
+    int32_t a_address = emu->pop_int();
+    const char* b = emu->get_memory_range(b_address, length);
+    const char* a = emu->get_memory_range(a_address, length);
+    if (a != nullptr && b != nullptr) {
+        int result = std::memcmp(a, b, length);
+        emu->push(AsBytes(static_cast<int32_t>((result > 0) - (result < 0))), sizeof(friday_constant_t));
     }
 }
+// Value is 0 if input is over. If the value has not arrived yet, the emulator stops and waits for it
+template <typename T>
+inline void InstInput(Emulator* emu, const char* format) {
+    T value = 0;
+    if (emu->input != nullptr) {
+        if (emu->input->TryRead(value) == InputSource::READ_PENDING) {
+            // Execute this in again when the value arrives
+            emu->signal = Emulator::SIGNAL_WAITING_INPUT;
+            emu->ip = emu->ap - static_cast<int32_t>(sizeof(friday_inst_t));
+            return;
+        }
+    } else {
+        scanf(format, &value);
+    }
+    emu->push(AsBytes(value), sizeof(T));
+}
+template <typename T>
+inline void InstOutput(Emulator* emu, const char* format, T value) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), format, value);
+    emu->WriteOutput(text, length);
+}
+template <typename A>
+inline void InstSyscall(Emulator* emu) {
+    const Intrinsic* intrinsic = GetIntrinsic(BytesAs<A>(emu->get_arg_ptr()));
+    if (intrinsic == nullptr) {
+        emu->signal = Emulator::SIGNAL_SIGILL;
+        return;
+    }
+    intrinsic->callback(emu);
+}
+inline void InstSpawn(Emulator* emu) {
+    if (emu->scheduler == nullptr) {
+        emu->signal = Emulator::SIGNAL_SIGILL;
+        return;
+    }
+    int32_t address = BytesAs<friday_address_t>(emu->get_arg_ptr());
+    int32_t arg = emu->pop_int();
+    emu->push(AsBytes(emu->scheduler->Spawn(address, arg)), sizeof(int32_t));
+}
+inline void InstJoin(Emulator* emu) {
+    if (emu->scheduler == nullptr) {
+        emu->signal = Emulator::SIGNAL_SIGILL;
+        return;
+    }
+    int32_t id = emu->pop_int();
+    int32_t result = 0;
+    if (emu->scheduler->Join(*emu, id, result)) {
+        emu->push(AsBytes(result), sizeof(int32_t));
+    } else if (emu->signal == Emulator::SIGNAL_BLOCKED) {
+        // The thread is still running: execute this join again when emu is resumed
+        emu->push(AsBytes(id), sizeof(int32_t));
+        emu->ip = emu->ap - static_cast<int32_t>(sizeof(friday_inst_t));
+    }
+}
+inline void InstAtomicAdd(Emulator* emu) {
+    int32_t value = emu->pop_int();
+    int32_t address = emu->pop_int();
+    char* target = emu->get_writable_range(address, sizeof(int32_t));
+    if (target == nullptr || address % sizeof(int32_t) != 0) {
+        emu->signal = Emulator::SIGNAL_SIGSEGV;
+        return;
+    }
+    int32_t old = __atomic_fetch_add(reinterpret_cast<int32_t*>(target), value, __ATOMIC_SEQ_CST);
+    emu->push(AsBytes(old), sizeof(int32_t));
+}
+inline friday_reg_t PackedRegisterOfCurrentInst(Emulator* emu) {
+    // ap points right after the instruction number
+    return GetPackedRegister(emu->mem[emu->ap - sizeof(friday_inst_t)]);
+}
+inline void InstPushPackedRegister(Emulator* emu) {
+    int32_t value = emu->regs[PackedRegisterOfCurrentInst(emu)];
+    emu->push(AsBytes(value), sizeof(friday_constant_t));
+}
+inline void InstPopPackedRegister(Emulator* emu) {
+    emu->regs[PackedRegisterOfCurrentInst(emu)] = emu->pop_int();
+}
 template <typename U, typename T>
 inline void InstArithmetics(Emulator* emu, T operation) {
     const char* op2 = emu->pop(sizeof(friday_constant_t));
@@ -205,6 +721,48 @@ inline void InstArithmetics(Emulator* emu, T operation) {
     U result = operation(BytesAs<U>(op1), BytesAs<U>(op2));
     emu->push(AsBytes(result), sizeof(friday_constant_t));
 }
+// Second operand of register forms: a register, if A is friday_reg_t, otherwise a constant of type A (sign-extended)
+template <typename A>
+inline int32_t ReadSecondOperand(Emulator* emu, const char* arg) {
+    if constexpr (std::is_same_v<A, friday_reg_t>) {
+        return emu->regs[BytesAs<friday_reg_t>(arg)];
+    } else {
+        return static_cast<int32_t>(BytesAs<A>(arg));
+    }
+}
+template <typename U, typename A, typename T>
+inline void InstRegisterArithmetics(Emulator* emu, T operation) {
+    const char* args = emu->get_arg_ptr();
+    int32_t& target = emu->regs[BytesAs<friday_reg_t>(args)];
+    int32_t operand = ReadSecondOperand<A>(emu, args + sizeof(friday_reg_t));
+    U result = operation(BytesAs<U>(AsBytes(target)), BytesAs<U>(AsBytes(operand)));
+    target = BytesAs<int32_t>(AsBytes(result));
+}
+// Label is stored as L: friday_short_offset_t (relative to the next instruction) or friday_address_t
+template <typename A, typename L, typename T>
+inline void InstRegisterBranch(Emulator* emu, T condition) {
+    const char* args = emu->get_arg_ptr();
+    int32_t op1 = emu->regs[BytesAs<friday_reg_t>(args)];
+    int32_t op2 = ReadSecondOperand<A>(emu, args + sizeof(friday_reg_t));
+    if (!condition(op1, op2)) {
+        return;
+    }
+    const char* label = args + sizeof(friday_reg_t) + sizeof(A);
+    if constexpr (std::is_same_v<L, friday_short_offset_t>) {
+        emu->ip += BytesAs<L>(label);  // ip already points to the next instruction
+    } else {
+        emu->ip = BytesAs<L>(label);
+    }
+}
+// slot 0 is the top of the stack
+inline void InstPushStackSlot(Emulator* emu, int slot) {
+    int32_t value = BytesAs<int32_t>(emu->get_stack_ptr(), slot * sizeof(friday_constant_t));
+    emu->push(AsBytes(value), sizeof(friday_constant_t));
+}
+inline void InstSwap(Emulator* emu) {
+    char* top = emu->get_stack_ptr();
+    std::swap(BytesAs<int32_t>(top), BytesAs<int32_t>(top, sizeof(friday_constant_t)));
+}
 //#################################################################################################
 
 }
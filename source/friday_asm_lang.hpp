@@ -15,10 +15,10 @@ constexpr unsigned int TwoInPowerOf(unsigned int power) noexcept {
 
 namespace FridayArch {
 
-const int16_t ARCH_VERSION = 1;
+const int16_t ARCH_VERSION = 2;
 
 // Некоторые параметры заголовка
-const static char* FRDY = "FRDY";
+const static char FRDY[] = "FRDY";
 const static int HEADER_ASM_VER_OFFSET = 4;
 const static int HEADER_REG_COUNT_OFFSET = 6;
 const static int HEADER_SIZE = 8;
@@ -28,6 +28,7 @@ typedef uint8_t  friday_reg_t;       // Тип номера регистра
 typedef char     friday_inst_t;      // Тип номера инструкции
 typedef uint32_t friday_constant_t;  // Тип для хранения константы
 typedef uint16_t friday_address_t;   // Тип адреса
+typedef int8_t   friday_short_offset_t;  // Тип смещения короткого перехода (относительно следующей инструкции)
 
 const unsigned int MAX_REGISTER_INDEX = 8;
 const unsigned int MAX_INSTRUCTION_VALUE = TwoInPowerOf(sizeof(friday_inst_t)) - 1;
@@ -36,18 +37,52 @@ const unsigned int MAX_ADDRESS_VALUE = TwoInPowerOf(sizeof(friday_address_t)) -
 
 const friday_reg_t DEFAULT_REG_COUNT = 8;  // Количество регистров, зарезервированных по умолчанию
 
+// Инструкции с аргументом PACKED_REGISTER хранят номер регистра в младших битах своего номера. Такие инструкции
+// регистрируются группой из MAX_REGISTER_INDEX штук, начиная с номера, кратного MAX_REGISTER_INDEX
+const friday_inst_t PACKED_REGISTER_MASK = MAX_REGISTER_INDEX - 1;
+// Инструкция trap. Отладчик записывает ее поверх первого байта инструкции, на которой стоит точка останова
+const friday_inst_t TRAP_INSTRUCTION = static_cast<friday_inst_t>(0xcc);
+
 class Emulator;
 
 typedef enum A {
     CONSTANT,
     REGISTER,
     LABEL,
+    // Короткие формы (с версии 2). Ассемблер выбирает их сам, если значение аргумента в них помещается
+    CONSTANT_8,       // 1 байт, знаково расширяется до friday_constant_t
+    CONSTANT_16,      // 2 байта, знаково расширяется до friday_constant_t
+    PACKED_REGISTER,  // 0 байт, номер регистра упакован в номер инструкции
+    LABEL_REL_8,      // 1 байт, смещение метки относительно следующей инструкции
     _BAD_ARG
 } InstructionArgument;
 
+// Как инструкция влияет на поток управления
+typedef enum {
+    FLOW_NEXT,    // Управление переходит к следующей инструкции
+    FLOW_JUMP,    // Безусловный переход на метку
+    FLOW_BRANCH,  // Условный переход на метку
+    FLOW_CALL,    // На стек кладется адрес следующей инструкции (call, dep), после возврата исполнение продолжится с нее
+    FLOW_RET,     // Переход по адресу со стека
+    FLOW_EXIT,    // Конец программы
+    FLOW_SPAWN    // Управление переходит к следующей инструкции, а с метки начинает исполняться новый поток
+} InstructionFlow;
+
+// Обменивается ли инструкция значением с внешним миром
+typedef enum {
+    IO_NONE,
+    IO_INPUT,   // Кладет на стек прочитанное значение (in, in_f)
+    IO_OUTPUT   // Снимает со стека и печатает значение (out, outf)
+} InstructionIO;
+
 const char* GetInstructionArgumentName(InstructionArgument value);
 size_t GetInstructionArgumentSize(InstructionArgument value);
 
+// Возвращает номер регистра, упакованный в номер инструкции с аргументом PACKED_REGISTER
+inline friday_reg_t GetPackedRegister(friday_inst_t inst) {
+    return inst & PACKED_REGISTER_MASK;
+}
+
 // Проверяет, что первые символы text совпадают с FRDY
 bool CheckForFRDY(const char* text);
 
@@ -58,15 +93,24 @@ struct Instruction {
     const InstructionArgument *args;
     const size_t inst_full_size;
     void (*const callback)(Emulator*);
+    const InstructionFlow flow;
+    const InstructionIO io;
+    // Сколько байт инструкция требует на стеке и сколько байт стека занято после нее вместо них (dup требует 4 и
+    // оставляет 8). -1, если это известно только во время исполнения (syscall)
+    const int stack_pops;
+    const int stack_pushes;
 
     Instruction(const char* name, friday_inst_t instruction, int args_count, const InstructionArgument *args,
-                void (*callback)(Emulator*));
+                void (*callback)(Emulator*), InstructionFlow flow, InstructionIO io);
 };
 
 Instruction* GetInstructionByBytecode(friday_inst_t bytecode);
 
+// Вызывается только при статической инициализации (FRIDAY_INST), потом набор инструкций только читается
 char RegisterInstruction(const char* name, friday_inst_t inst, int args_count, InstructionArgument *args,
-        void (*callback)(Emulator*));
+        void (*callback)(Emulator*), InstructionFlow flow = FLOW_NEXT, InstructionIO io = IO_NONE);
+
+const std::vector<Instruction>& GetInstructionSet();
 
 Instruction* FindInstructionBySignature(const std::string_view& name, int args_count, const InstructionArgument* args);
 
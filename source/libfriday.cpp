@@ -0,0 +1,242 @@
+#include "libfriday.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include "Emulator.hpp"
+#include "EmulatorObserver.hpp"
+#include "InputSource.hpp"
+#include "assembler_inside_facade.hpp"
+#include "friday_asm_lang.hpp"
+#include "utility/BytesHelper.hpp"
+
+using namespace FridayArch;
+
+// Столько инструкций исполняется между передачами накопленного вывода обработчику write
+const static int OUTPUT_SLICE_STEPS = 64 * 1024;
+
+namespace {
+
+// Ввод из обработчиков friday_io
+class CallbackInput : public InputSource {
+public:
+    const friday_io& io;
+
+    explicit CallbackInput(const friday_io& io) : io(io) {}
+
+    bool Read(int32_t& value) override {
+        value = 0;
+        return io.read_int != nullptr && io.read_int(io.context, &value) != 0;
+    }
+    bool Read(float& value) override {
+        value = 0;
+        return io.read_float != nullptr && io.read_float(io.context, &value) != 0;
+    }
+};
+
+struct CountingObserver : NullObserver {
+    uint64_t executed = 0;
+
+    void OnInstruction(const Emulator& /*emu*/, int /*address*/, const Instruction& /*inst*/) {
+        ++executed;
+    }
+};
+
+}
+
+struct friday_emulator {
+    Emulator emu;
+    friday_io io{};
+    CallbackInput input{io};
+    std::string output;  // Вывод программы, еще не переданный io.write
+
+    // Reset забывает ввод и вывод, поэтому они подключаются заново после каждого сброса
+    void ConnectIO() {
+        emu.input = &input;
+        emu.output_buffer = &output;
+        emu.output_stream = nullptr;
+    }
+
+    void FlushOutput() {
+        if (!output.empty() && io.write != nullptr) {
+            io.write(io.context, output.data(), output.size());
+        }
+        output.clear();
+    }
+};
+
+// Копия text в памяти malloc, которую вызывающий освобождает friday_free
+static char* CopyString(const std::string& text) {
+    auto result = static_cast<char*>(std::malloc(text.size() + 1));
+    if (result != nullptr) {
+        std::memcpy(result, text.c_str(), text.size() + 1);
+    }
+    return result;
+}
+
+int friday_api_version() {
+    return FRIDAY_API_VERSION;
+}
+
+void friday_free(void* memory) {
+    std::free(memory);
+}
+
+int friday_assemble(const char* name, const char* source, size_t source_size, unsigned flags,
+                    char** program, size_t* program_size, char** messages) {
+    if (messages != nullptr) {
+        *messages = nullptr;
+    }
+    if ((source == nullptr && source_size > 0) || program == nullptr || program_size == nullptr) {
+        return FRIDAY_ERROR_ARGUMENT;
+    }
+    *program = nullptr;
+    *program_size = 0;
+
+    try {
+        std::string text;
+        TextLocation loc;
+        loc.messages = &text;
+        loc.SetFile(name != nullptr ? name : "<source>");
+        FridayAsmWriter writer(&loc);
+        writer.WriteHeader();
+        bool ok = CompileAndLinkFile(std::string_view(source, source_size), loc, writer,
+                                     (flags & FRIDAY_ASSEMBLE_OPTIMIZE) != 0);
+
+        if (messages != nullptr && !text.empty()) {
+            *messages = CopyString(text);
+        }
+        if (!ok) {
+            return FRIDAY_ERROR_SOURCE;
+        }
+        const std::vector<char>& bytecode = writer.GetBytecode();
+        *program = static_cast<char*>(std::malloc(bytecode.size()));
+        if (*program == nullptr) {
+            return FRIDAY_ERROR_NO_MEMORY;
+        }
+        std::memcpy(*program, bytecode.data(), bytecode.size());
+        *program_size = bytecode.size();
+        return FRIDAY_OK;
+    } catch (const std::bad_alloc&) {
+        return FRIDAY_ERROR_NO_MEMORY;
+    } catch (const std::exception& exc) {
+        if (messages != nullptr && *messages == nullptr) {
+            *messages = CopyString(std::string("error: ") + exc.what() + "\n");
+        }
+        return FRIDAY_ERROR_SOURCE;
+    }
+}
+
+friday_emulator* friday_emulator_create() {
+    try {
+        auto result = new friday_emulator;
+        result->ConnectIO();
+        return result;
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+void friday_emulator_destroy(friday_emulator* emu) {
+    delete emu;
+}
+
+int friday_emulator_load(friday_emulator* emu, const char* program, size_t program_size, char** error) {
+    if (error != nullptr) {
+        *error = nullptr;
+    }
+    if (emu == nullptr || program == nullptr) {
+        return FRIDAY_ERROR_ARGUMENT;
+    }
+    emu->emu.Reset();
+    emu->ConnectIO();
+    emu->output.clear();
+
+    std::string problem;
+    if (program_size < static_cast<size_t>(HEADER_SIZE) || !CheckForFRDY(program)) {
+        problem = "error: program is not a .friday executable";
+    } else if (program_size > static_cast<size_t>(Emulator::MEMORY_SIZE)) {
+        problem = "error: program does not fit in emulator memory";
+    } else if (BytesHelper::ReadFromBytes<int16_t>(program, HEADER_ASM_VER_OFFSET) > ARCH_VERSION) {
+        problem = "error: program is compiled for arch version " +
+                  std::to_string(BytesHelper::ReadFromBytes<int16_t>(program, HEADER_ASM_VER_OFFSET)) +
+                  ", but emulator supports up to " + std::to_string(ARCH_VERSION);
+    }
+    if (!problem.empty()) {
+        if (error != nullptr) {
+            *error = CopyString(problem);
+        }
+        return FRIDAY_ERROR_PROGRAM;
+    }
+
+    try {
+        emu->emu.LoadMemory(program, static_cast<int>(program_size));
+    } catch (const std::bad_alloc&) {
+        emu->emu.Reset();
+        emu->ConnectIO();
+        return FRIDAY_ERROR_NO_MEMORY;
+    }
+    return FRIDAY_OK;
+}
+
+void friday_emulator_set_io(friday_emulator* emu, const friday_io* io) {
+    if (emu != nullptr) {
+        emu->io = io != nullptr ? *io : friday_io{};
+    }
+}
+
+int friday_emulator_run(friday_emulator* emu, uint64_t max_instructions, uint64_t* executed) {
+    if (executed != nullptr) {
+        *executed = 0;
+    }
+    if (emu == nullptr) {
+        return FRIDAY_SIGNAL_NOT_LOADED;
+    }
+
+    CountingObserver observer;
+    while (emu->emu.signal == Emulator::NO_SIGNAL && observer.executed < max_instructions) {
+        uint64_t left = max_instructions - observer.executed;
+        emu->emu.RunSlice(static_cast<int>(std::min<uint64_t>(left, OUTPUT_SLICE_STEPS)), observer);
+        emu->FlushOutput();
+    }
+    if (executed != nullptr) {
+        *executed = observer.executed;
+    }
+    return emu->emu.signal;
+}
+
+int friday_emulator_signal(const friday_emulator* emu) {
+    return emu != nullptr ? emu->emu.signal : FRIDAY_SIGNAL_NOT_LOADED;
+}
+
+int32_t friday_emulator_ip(const friday_emulator* emu) {
+    return emu != nullptr ? emu->emu.ip : -1;
+}
+
+int32_t friday_emulator_sp(const friday_emulator* emu) {
+    return emu != nullptr ? emu->emu.sp : -1;
+}
+
+int friday_emulator_registers(const friday_emulator* emu, int32_t* values, int capacity) {
+    if (emu == nullptr) {
+        return 0;
+    }
+    const std::vector<int32_t>& regs = emu->emu.regs;
+    if (values != nullptr && capacity > 0) {
+        std::copy_n(regs.begin(), std::min<size_t>(capacity, regs.size()), values);
+    }
+    return static_cast<int>(regs.size());
+}
+
+int friday_emulator_read_memory(const friday_emulator* emu, int32_t address, void* buffer, size_t length) {
+    auto begin = static_cast<uint32_t>(address);
+    if (emu == nullptr || (buffer == nullptr && length > 0) || length > static_cast<size_t>(Emulator::MEMORY_SIZE) ||
+            begin > static_cast<uint32_t>(Emulator::MEMORY_SIZE) - length) {
+        return FRIDAY_ERROR_ARGUMENT;
+    }
+    if (length > 0) {
+        std::memcpy(buffer, emu->emu.mem + begin, length);
+    }
+    return FRIDAY_OK;
+}
@@ -0,0 +1,93 @@
+#ifndef LIBFRIDAY_H
+#define LIBFRIDAY_H
+
+// libfriday -- ассемблер и эмулятор Friday для встраивания в другие программы, с C ABI.
+// Функции ничего не печатают и не читают stdin: ошибки возвращаются строками, а ввод и вывод программы идут через
+// friday_io. Разные эмуляторы можно использовать из разных потоков одновременно, один эмулятор -- из одного потока
+// за раз. friday_assemble можно вызывать из любых потоков
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Меняется, только если меняется ABI (тогда меняется и SOVERSION библиотеки)
+#define FRIDAY_API_VERSION 1
+
+enum friday_status {
+    FRIDAY_OK = 0,
+    FRIDAY_ERROR_ARGUMENT = 1,  // Нулевой указатель или размер вне допустимого
+    FRIDAY_ERROR_SOURCE = 2,    // Ошибки в исходнике, они описаны в messages
+    FRIDAY_ERROR_PROGRAM = 3,   // Это не программа Friday или она собрана для более новой версии архитектуры
+    FRIDAY_ERROR_NO_MEMORY = 4
+};
+
+// Сигналы, которыми останавливается исполнение (совпадают с номерами в сообщениях friday-emu)
+enum friday_signal {
+    FRIDAY_SIGNAL_NOT_LOADED = -1,  // Программа не загружена
+    FRIDAY_SIGNAL_NONE = 0,         // Исполнение остановлено, потому что кончился бюджет инструкций
+    FRIDAY_SIGNAL_EXIT = 1,         // Исполнена инструкция end
+    FRIDAY_SIGNAL_SIGSEGV = 2,
+    FRIDAY_SIGNAL_SIGILL = 3,       // В том числе spawn и join: гостевые потоки встроенному эмулятору недоступны
+    FRIDAY_SIGNAL_TRAP = 5
+};
+
+// Флаги friday_assemble
+#define FRIDAY_ASSEMBLE_OPTIMIZE 1u  // Как friday-asm -O
+
+// Ввод и вывод программы. Любой обработчик может быть NULL: тогда ввод сразу закончен, а вывод отбрасывается.
+// Обработчики вызываются в потоке, который вызвал friday_emulator_run
+typedef struct friday_io {
+    void* context;  // Передается обработчикам первым аргументом
+    // Читают значение для in и in_f. Возвращают 0, если ввод закончился (тогда программа получает 0)
+    int (*read_int)(void* context, int32_t* value);
+    int (*read_float)(void* context, float* value);
+    // Получает текст, который напечатали out и outf. Текст не заканчивается '\0'
+    void (*write)(void* context, const char* text, size_t length);
+} friday_io;
+
+typedef struct friday_emulator friday_emulator;
+
+int friday_api_version(void);
+
+// Освобождает память, которую вернули функции библиотеки
+void friday_free(void* memory);
+
+// Собирает программу из текста source длиной source_size. name -- имя файла в сообщениях (NULL -- "<source>").
+// При успехе в *program -- образ программы, как в файле .friday, в *program_size -- его размер. Если messages не
+// NULL, туда записываются сообщения ассемблера (ошибки, заметки -O) или NULL, если их нет. *program и *messages
+// освобождаются friday_free
+int friday_assemble(const char* name, const char* source, size_t source_size, unsigned flags,
+                    char** program, size_t* program_size, char** messages);
+
+// Возвращает NULL, если не хватило памяти. Память эмулятора (128 МиБ) резервируется, но выделяется по мере
+// использования
+friday_emulator* friday_emulator_create(void);
+void friday_emulator_destroy(friday_emulator* emu);
+
+// Загружает программу (копирует образ), сбрасывая предыдущую: память, регистры и сигнал. Если error не NULL, при
+// ошибке туда записывается ее описание, которое освобождается friday_free
+int friday_emulator_load(friday_emulator* emu, const char* program, size_t program_size, char** error);
+// Задает ввод и вывод программы. io копируется, NULL -- без ввода и вывода
+void friday_emulator_set_io(friday_emulator* emu, const friday_io* io);
+
+// Исполняет не больше max_instructions инструкций или до сигнала. Возвращает сигнал (friday_signal):
+// FRIDAY_SIGNAL_NONE -- бюджет кончился, и исполнение можно продолжить следующим вызовом. Если executed не NULL,
+// туда записывается, сколько инструкций исполнено
+int friday_emulator_run(friday_emulator* emu, uint64_t max_instructions, uint64_t* executed);
+
+int friday_emulator_signal(const friday_emulator* emu);
+int32_t friday_emulator_ip(const friday_emulator* emu);
+int32_t friday_emulator_sp(const friday_emulator* emu);
+// Копирует в values первые capacity регистров и возвращает, сколько их всего у программы
+int friday_emulator_registers(const friday_emulator* emu, int32_t* values, int capacity);
+// Копирует length байт памяти программы с адреса address в buffer
+int friday_emulator_read_memory(const friday_emulator* emu, int32_t address, void* buffer, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,59 +1,334 @@
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <memory>
 #include "objdump.hpp"
 #include "utility/FileHelper.hpp"
 #include "ListingGenerator.hpp"
 #include "friday_asm_lang.hpp"
+#include "CodeAnalysis.hpp"
+#include "Profile.hpp"
+#include "SymbolMap.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <numeric>
+
+using namespace FridayArch;
 
 #ifdef FRIDAY_OBJDUMP_MAIN
 int main(int argc, char** argv) {
-    if (argc != 2) {
+    auto args = ParseObjdumpArgs(argc, argv);
+    if (args._bad_syntax) {
         PrintObjdumpHelp();
         return 0;
     }
-    Objdump(argv[1]);
+    Objdump(args);
     return 0;
 }
 #endif
 
+ObjdumpArgs ParseObjdumpArgs(int argc, char **argv) {
+    ObjdumpArgs result;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i += 2) {
+        if (i + 1 >= argc) {
+            printf("error: nothing after '%s' argument\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+        if (strcmp(argv[i], "-j") == 0) {
+            result.threads_count = atoi(argv[i + 1]);
+            if (result.threads_count <= 0) {
+                result.threads_count = static_cast<int>(std::thread::hardware_concurrency());
+            }
+        } else if (strcmp(argv[i], "-p") == 0) {
+            result.profile_filename = argv[i + 1];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            result.map_filename = argv[i + 1];
+        } else {
+            printf("error: unknown argument '%s'\n", argv[i]);
+            result._bad_syntax = true;
+            return result;
+        }
+    }
+
+    if (i + 1 != argc) {
+        result._bad_syntax = true;
+        return result;
+    }
+    result.program = argv[i];
+    return result;
+}
+
 void PrintObjdumpHelp() {
-    printf("friday-objdump <.friday program>\n"
-           "Display all information and assembler content from compiled .friday program\n");
+    printf("friday-objdump [-j <threads>] [-p <profile>] [-m <map>] <.friday program>\n"
+           "Display all information and assembler content from compiled .friday program\n"
+           "-j : disassemble the file in chunks on several threads, 0 = number of cores\n"
+           "-p : annotate every instruction with execution count from 'friday-emu --profile', mark the hottest\n"
+           "     basic blocks with '*' and print time spent in every block and function\n"
+           "-m : print labels from 'friday-asm -m' map file, and name functions by them\n");
+}
+
+// Печатает инструкции из [begin, end). Возвращает false, если встретилась ошибка (она уже напечатана)
+static bool DisassembleRange(ListingGenerator& listing, const char* file, int begin, int end) {
+    for (int pos = begin; pos < end;) {
+        int bytes_read = listing.PrintInstruction(file + pos, end - pos);
+        if (bytes_read < 0) {
+            listing.PrintReadError();
+            return false;
+        }
+        pos += bytes_read;
+    }
+    return true;
+}
+
+// Быстро проходит по коду, смотря только на длины инструкций, и делит его на chunks_count кусков по
+// границам инструкций. Возвращает границы кусков, первая -- HEADER_SIZE, последняя -- file_size.
+// Если код испорчен, все после испорченного места попадает в последний кусок, который и сообщит об ошибке
+static std::vector<int> SplitAtInstructionBoundaries(const char* file, int file_size, int chunks_count) {
+    int inst_sizes[MAX_INSTRUCTION_VALUE + 1] = {};
+    for (auto& inst : GetInstructionSet()) {
+        inst_sizes[static_cast<unsigned char>(inst.inst)] = static_cast<int>(inst.inst_full_size);
+    }
+
+    int chunk_size = (file_size - HEADER_SIZE) / chunks_count + 1;
+    std::vector<int> bounds = {HEADER_SIZE};
+    int pos = HEADER_SIZE;
+    while (pos < file_size) {
+        int size = inst_sizes[static_cast<unsigned char>(file[pos])];
+        if (size == 0 || pos + size > file_size) {
+            break;
+        }
+        pos += size;
+        if (pos - bounds.back() >= chunk_size && pos < file_size) {
+            bounds.push_back(pos);
+        }
+    }
+    bounds.push_back(file_size);
+    return bounds;
+}
+
+static void DisassembleInParallel(const char* file, int file_size, int threads_count,
+                                  const ListingAnnotations* annotations);
+
+static const int HOT_BLOCKS_COUNT = 5;
+
+// Считает, сколько инструкций исполнено в каждом блоке, и помечает в annotations блоки, где их больше всего.
+// Возвращает номера блоков, отсортированные по убыванию исполненных инструкций
+static std::vector<int> FindHotBlocks(const std::vector<DecodedInstruction>& decoded,
+                                      const std::vector<BasicBlock>& blocks, const Profile& profile,
+                                      std::vector<uint64_t>& block_executions, ListingAnnotations& annotations) {
+    block_executions.assign(blocks.size(), 0);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        for (int j = blocks[i].first; j <= blocks[i].last; ++j) {
+            block_executions[i] += profile.GetExecutions(decoded[j].address);
+        }
+    }
+
+    std::vector<int> order(blocks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&] (int a, int b) { return block_executions[a] > block_executions[b]; });
+
+    annotations.hot.assign(decoded.empty() ? 0 : decoded.back().address + 1, false);
+    for (int i = 0; i < HOT_BLOCKS_COUNT && i < static_cast<int>(order.size()); ++i) {
+        if (block_executions[order[i]] == 0) {
+            break;
+        }
+        auto& block = blocks[order[i]];
+        for (int j = block.first; j <= block.last; ++j) {
+            annotations.hot[decoded[j].address] = true;
+        }
+    }
+    return order;
+}
+
+// Начала функций: точка входа, цели инструкций call и spawn и метки из таблицы меток, по возрастанию
+static std::vector<int> FindFunctionStarts(const std::vector<DecodedInstruction>& decoded, const SymbolMap* symbols) {
+    std::vector<int> starts = {HEADER_SIZE};
+    for (auto& inst : decoded) {
+        if ((inst.inst->flow == FLOW_CALL || inst.inst->flow == FLOW_SPAWN) && inst.jump_target >= 0) {
+            starts.push_back(inst.jump_target);
+        }
+    }
+    if (symbols != nullptr) {
+        for (auto& symbol : symbols->GetSymbols()) {
+            starts.push_back(symbol.address);
+        }
+    }
+    std::sort(starts.begin(), starts.end());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+    return starts;
+}
+
+static void PrintLocation(int address, int function_start, const SymbolMap* symbols) {
+    auto* symbol = symbols != nullptr ? symbols->FindByAddress(function_start) : nullptr;
+    if (symbol != nullptr) {
+        printf("%s+0x%x", symbol->name.c_str(), address - function_start);
+    } else {
+        printf("<file_start+%04x>", address);
+    }
+}
+
+static void PrintShare(uint64_t count, uint64_t total) {
+    printf("%12" PRIu64 " %6.2f%%  ", count, total == 0 ? 0.0 : 100.0 * count / total);
 }
 
-void Objdump(const char *filename) {
-    std::string file_;
+static void PrintProfileSummary(const std::vector<DecodedInstruction>& decoded, const std::vector<BasicBlock>& blocks,
+                                const std::vector<int>& hot_order, const std::vector<uint64_t>& block_executions,
+                                const Profile& profile, uint64_t total, const SymbolMap* symbols) {
+    auto function_starts = FindFunctionStarts(decoded, symbols);
+    auto function_of = [&] (int address) {
+        return *(std::upper_bound(function_starts.begin(), function_starts.end(), address) - 1);
+    };
+
+    printf("\nHottest basic blocks:\n  executions   share  block\n");
+    for (int i = 0; i < HOT_BLOCKS_COUNT && i < static_cast<int>(hot_order.size()); ++i) {
+        int index = hot_order[i];
+        if (block_executions[index] == 0) {
+            break;
+        }
+        int begin = decoded[blocks[index].first].address;
+        int end = decoded[blocks[index].last].address;
+        PrintShare(block_executions[index], total);
+        PrintLocation(begin, function_of(begin), symbols);
+        printf(" .. ");
+        PrintLocation(end, function_of(end), symbols);
+        uint64_t branch_executions = profile.GetExecutions(end);
+        if (decoded[blocks[index].last].inst->flow == FLOW_BRANCH && branch_executions > 0) {
+            printf("  (branch taken %.1f%%)", 100.0 * profile.GetTaken(end) / branch_executions);
+        }
+        printf("\n");
+    }
+
+    std::vector<uint64_t> function_executions(function_starts.size(), 0);
+    for (auto& inst : decoded) {
+        size_t index = std::upper_bound(function_starts.begin(), function_starts.end(), inst.address) -
+                       function_starts.begin() - 1;
+        function_executions[index] += profile.GetExecutions(inst.address);
+    }
+    std::vector<int> order(function_starts.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&] (int a, int b) { return function_executions[a] > function_executions[b]; });
+
+    printf("\nTime by function:\n  executions   share  function\n");
+    for (int index : order) {
+        if (function_executions[index] == 0) {
+            break;
+        }
+        PrintShare(function_executions[index], total);
+        auto* symbol = symbols != nullptr ? symbols->FindByAddress(function_starts[index]) : nullptr;
+        if (symbol != nullptr) {
+            printf("%s\n", symbol->name.c_str());
+        } else {
+            printf("<file_start+%04x>\n", function_starts[index]);
+        }
+    }
+}
+
+void Objdump(const ObjdumpArgs& args) {
+    const char* filename = args.program;
+    int threads_count = args.threads_count;
+
+    Profile profile;
+    SymbolMap symbols;
+    ListingAnnotations annotations;
+    if (args.profile_filename != nullptr) {
+        try {
+            profile.Load(args.profile_filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.profile_filename, "reading", exc);
+            return;
+        }
+        annotations.profile = &profile;
+        annotations.total_executions = profile.GetTotalExecutions();
+    }
+    if (args.map_filename != nullptr) {
+        try {
+            symbols.Load(args.map_filename);
+        } catch (const std::exception& exc) {
+            FileHelper::PrintErrorWorkingWithFile(args.map_filename, "reading", exc);
+            return;
+        }
+        annotations.symbols = &symbols;
+    }
+
+    FileHelper::MappedFile file_;
     try {
-        file_ = FileHelper::ReadFileFullyInBinary(filename);
+        file_ = FileHelper::MappedFile(filename);
     } catch (const std::exception& exc) {
         FileHelper::PrintErrorWorkingWithFile(filename, "reading", exc);
         return;
     }
-    const char* file = file_.c_str();
+    const char* file = file_.data();
+    int file_size = static_cast<int>(file_.size());
 
-    if (!FridayArch::CheckForFRDY(file)) {
+    if (file_size < HEADER_SIZE || !CheckForFRDY(file)) {
         printf("File '%s' is not a .friday executable\n", filename);
         return;
     }
 
+    std::vector<DecodedInstruction> decoded;
+    std::vector<BasicBlock> blocks;
+    std::vector<int> hot_order;
+    std::vector<uint64_t> block_executions;
+    if (annotations.profile != nullptr) {
+        DecodeProgram(file, file_size, decoded);
+        blocks = SplitIntoBasicBlocks(decoded);
+        hot_order = FindHotBlocks(decoded, blocks, profile, block_executions, annotations);
+    }
+    const ListingAnnotations* used_annotations =
+            annotations.profile != nullptr || annotations.symbols != nullptr ? &annotations : nullptr;
+
     printf("Objdump for file %s\n\n", filename);
-    ListingGenerator listing(stdout);
-    int file_size = file_.size();
-
-    while (file_size > 0) {
-        int bytes_read;
-        if (file == file_.c_str()) {
-            // We are in the beginning, read header
-            bytes_read = listing.PrintHeader(file, file_size);
-        } else {
-            bytes_read = listing.PrintInstruction(file, file_size);
-        }
+    fflush(stdout);
+    {
+        ListingGenerator header(stdout, 0, used_annotations);
+        header.PrintHeader(file, file_size);
+    }
 
-        if (bytes_read < 0) {
-            printf("<file_start+%04x> error reading instruction or header. Abort\n", listing.GetOffset());
-            return;
-        }
+    if (threads_count <= 1) {
+        ListingGenerator listing(stdout, HEADER_SIZE, used_annotations);
+        DisassembleRange(listing, file, HEADER_SIZE, file_size);
+    } else {
+        DisassembleInParallel(file, file_size, threads_count, used_annotations);
+    }
+
+    if (annotations.profile != nullptr) {
+        fflush(stdout);
+        PrintProfileSummary(decoded, blocks, hot_order, block_executions, profile, annotations.total_executions,
+                            annotations.symbols);
+    }
+}
 
-        file += bytes_read;
-        file_size -= bytes_read;
+static void DisassembleInParallel(const char* file, int file_size, int threads_count,
+                                  const ListingAnnotations* annotations) {
+    auto bounds = SplitAtInstructionBoundaries(file, file_size, threads_count);
+    std::vector<std::unique_ptr<ListingGenerator>> chunks;
+    std::vector<std::thread> workers;
+    std::vector<char> chunk_ok(bounds.size() - 1);
+    // All generators exist before any thread starts: push_back must not move chunks while workers read it
+    for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+        chunks.push_back(std::make_unique<ListingGenerator>(nullptr, bounds[i], annotations));
+    }
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        workers.emplace_back([&, i] {
+            chunk_ok[i] = DisassembleRange(*chunks[i], file, bounds[i], bounds[i + 1]);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        auto& text = chunks[i]->GetBuffer();
+        fwrite(text.data(), 1, text.size(), stdout);
+        if (!chunk_ok[i]) {
+            break;
+        }
     }
 }
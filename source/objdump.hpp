@@ -5,6 +5,19 @@
 int main(int argc, char** argv);
 #endif
 
+// Параметры, необходимые для запуска дизассемблера
+typedef struct ObjdumpArgs {
+    const char* program = nullptr;
+    int threads_count = 1;                   // > 1 -- дизассемблировать файл кусками параллельно
+    const char* profile_filename = nullptr;  // Профиль из friday-emu --profile для аннотирования листинга
+    const char* map_filename = nullptr;      // Таблица меток из friday-asm -m
+
+    bool _bad_syntax = false;
+
+    ObjdumpArgs() = default;
+} ObjdumpArgs;
+
+ObjdumpArgs ParseObjdumpArgs(int argc, char** argv);
 void PrintObjdumpHelp();
 
-void Objdump(const char* filename);
+void Objdump(const ObjdumpArgs& args);
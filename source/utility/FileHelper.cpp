@@ -1,31 +1,68 @@
 #include <fstream>
 #include <cstdio>
+#include <cerrno>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "FileHelper.hpp"
 
-std::string FileHelper::ReadFileFully(const char *filename) {
-    std::ifstream file(filename);
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
+int FileHelper::OpenRegularFile(const char *filename, size_t &size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open");
+    }
 
-    std::string buffer(size, '\0');
-    file.seekg(0);
-    file.read(buffer.data(), size);
-    file.close();
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "fstat");
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        throw std::system_error(EINVAL, std::generic_category(), "not a regular file");
+    }
 
-    return buffer;
+    size = st.st_size;
+    return fd;
 }
 
-std::string FileHelper::ReadFileFullyInBinary(const char *filename) {
-    std::ifstream file(filename, std::ios::binary);
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
+FileHelper::MappedFile::MappedFile(const char *filename) {
+    int fd = OpenRegularFile(filename, size_);
+    if (size_ == 0) {
+        // mmap не умеет отображать пустые файлы
+        data_ = "";
+        close(fd);
+        return;
+    }
 
-    std::string buffer(size, '\0');
-    file.seekg(0);
-    file.read(buffer.data(), size);
-    file.close();
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::system_error(error, std::generic_category(), "mmap");
+    }
+    data_ = static_cast<const char*>(addr);
+}
+
+FileHelper::MappedFile::~MappedFile() {
+    if (size_ > 0) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+FileHelper::MappedFile::MappedFile(MappedFile &&other) noexcept :
+    data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0))
+{}
 
-    return buffer;
+FileHelper::MappedFile &FileHelper::MappedFile::operator=(MappedFile &&other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
 }
 
 void FileHelper::WriteFileInBinary(const char *filename, const std::vector<char>& bytes) {
@@ -34,6 +71,25 @@ void FileHelper::WriteFileInBinary(const char *filename, const std::vector<char>
     file.write(bytes.data(), bytes.size());
 }
 
+void FileHelper::WriteFileAtomically(const char *filename, const std::vector<char>& bytes) {
+    std::string temporary = std::string(filename) + ".tmp" + std::to_string(getpid());
+    try {
+        WriteFileInBinary(temporary.c_str(), bytes);
+    } catch (const std::ios_base::failure& exc) {
+        unlink(temporary.c_str());
+        throw std::system_error(EIO, std::generic_category(), "write");
+    }
+    ReplaceFile(temporary.c_str(), filename);
+}
+
+void FileHelper::ReplaceFile(const char *temporary_filename, const char *filename) {
+    if (rename(temporary_filename, filename) != 0) {
+        int error = errno;
+        unlink(temporary_filename);
+        throw std::system_error(error, std::generic_category(), "rename");
+    }
+}
+
 void FileHelper::PrintErrorWorkingWithFile(const char *filename, const char *action_with_file,
         const std::exception& exc) {
     printf("Error while %s file '%s'. Check the file exists and is not a directory\n", action_with_file, filename);
@@ -1,14 +1,41 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace FileHelper {
-    std::string ReadFileFully(const char* filename);
+    // Файл, отображенный в память только для чтения через mmap. Отображение живет, пока жив объект.
+    // Конструктор бросает std::system_error, если файл не удалось открыть или отобразить
+    class MappedFile {
+        const char* data_ = nullptr;
+        size_t size_ = 0;
 
-    std::string ReadFileFullyInBinary(const char* filename);
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const char* filename);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+        std::string_view view() const { return std::string_view(data_, size_); }
+    };
+
+    // Открывает обычный файл на чтение и возвращает его дескриптор, а в size -- размер файла.
+    // Бросает std::system_error в случае ошибки
+    int OpenRegularFile(const char* filename, size_t& size);
 
     void WriteFileInBinary(const char *filename, const std::vector<char>& bytes);
+    // Записывает bytes во временный файл рядом с filename и переименовывает его в filename, так что читатели видят
+    // либо старое, либо новое содержимое целиком. Бросает std::system_error в случае ошибки
+    void WriteFileAtomically(const char *filename, const std::vector<char>& bytes);
+    // Переименовывает временный файл в filename. Бросает std::system_error в случае ошибки
+    void ReplaceFile(const char* temporary_filename, const char* filename);
 
     // action_with_file = "reading" or "writing to"
     void PrintErrorWorkingWithFile(const char* filename, const char* action_with_file, const std::exception& exc);
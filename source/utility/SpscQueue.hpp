@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Очередь фиксированной емкости для одного производителя и одного потребителя. Кольцевой буфер без блокировок:
+// каждая сторона пишет только свой индекс. Мьютекс используется, лишь когда сторона засыпает в ожидании
+// (очередь пуста или полна дольше, чем SPIN_COUNT проверок)
+template <typename T>
+class SpscQueue {
+private:
+    static const int SPIN_COUNT = 1024;
+    static const size_t CACHE_LINE = 64;
+
+    std::vector<T> buffer;
+    const size_t mask;
+
+    alignas(CACHE_LINE) std::atomic<size_t> head{0};  // Следующий элемент для потребителя
+    size_t cached_tail = 0;                           // Копия tail у потребителя
+    alignas(CACHE_LINE) std::atomic<size_t> tail{0};  // Следующее свободное место для производителя
+    size_t cached_head = 0;                           // Копия head у производителя
+    alignas(CACHE_LINE) std::atomic<bool> closed{false};
+    std::atomic<int> sleepers{0};
+    std::mutex sleep_lock;
+    std::condition_variable sleep_cv;
+
+    // Ждет, пока ready() не станет true или очередь не закроют
+    template <typename Predicate>
+    void WaitFor(Predicate ready);
+    void WakeSleepers();
+
+public:
+    // Емкость округляется вверх до степени двойки
+    explicit SpscQueue(size_t capacity);
+
+    // Только для производителя. Кладет count элементов, при необходимости ожидая места.
+    // Возвращает false, если очередь закрыта
+    bool Push(const T* items, size_t count);
+    // Только для потребителя. Ожидает и извлекает элемент. Возвращает false, если очередь закрыта и пуста
+    bool Pop(T& item);
+    // Для любой стороны: элементов больше не будет, ожидающие просыпаются
+    void Close();
+};
+
+#include "SpscQueue_impl.hpp"
@@ -0,0 +1,99 @@
+#include <thread>
+
+// class SpscQueue //
+
+static size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+template <typename T>
+SpscQueue<T>::SpscQueue(size_t capacity) :
+    buffer(RoundUpToPowerOfTwo(capacity)),
+    mask(buffer.size() - 1)
+{}
+
+template <typename T>
+template <typename Predicate>
+void SpscQueue<T>::WaitFor(Predicate ready) {
+    for (int i = 0; i < SPIN_COUNT; ++i) {
+        if (ready() || closed) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    // sleepers и индексы изменяются с seq_cst: либо другая сторона увидит sleepers и разбудит,
+    // либо мы увидим ее изменение при проверке ready()
+    std::unique_lock<std::mutex> guard(sleep_lock);
+    ++sleepers;
+    sleep_cv.wait(guard, [&] { return ready() || closed; });
+    --sleepers;
+}
+
+template <typename T>
+void SpscQueue<T>::WakeSleepers() {
+    if (sleepers > 0) {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        sleep_cv.notify_all();
+    }
+}
+
+template <typename T>
+bool SpscQueue<T>::Push(const T* items, size_t count) {
+    size_t position = tail.load(std::memory_order_relaxed);
+    while (count > 0) {
+        if (position - cached_head > mask) {
+            cached_head = head;
+            if (position - cached_head > mask) {
+                WaitFor([&] { return position - head <= mask; });
+                if (closed) {
+                    return false;
+                }
+                continue;
+            }
+        }
+
+        size_t free_space = buffer.size() - (position - cached_head);
+        size_t batch = count < free_space ? count : free_space;
+        for (size_t i = 0; i < batch; ++i) {
+            buffer[(position + i) & mask] = items[i];
+        }
+        items += batch;
+        count -= batch;
+        position += batch;
+        tail = position;
+        WakeSleepers();
+    }
+    return !closed;
+}
+
+template <typename T>
+bool SpscQueue<T>::Pop(T& item) {
+    size_t position = head.load(std::memory_order_relaxed);
+    if (position == cached_tail) {
+        cached_tail = tail;
+        if (position == cached_tail) {
+            WaitFor([&] { return position != tail; });
+            cached_tail = tail;
+            if (position == cached_tail) {
+                return false;  // Закрыта и пуста
+            }
+        }
+    }
+
+    item = buffer[position & mask];
+    head = position + 1;
+    WakeSleepers();
+    return true;
+}
+
+template <typename T>
+void SpscQueue<T>::Close() {
+    closed = true;
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    sleep_cv.notify_all();
+}
@@ -0,0 +1,150 @@
+#!/bin/sh
+# Checks that friday-asm --watch writes the same program as friday-asm, and refuses the same programs.
+# Usage: watch_matches_asm.sh <friday-asm> <programs directory>
+set -u
+
+ASM=$1
+PROGRAMS=$2
+DIR=$(mktemp -d)
+WATCH_PID=
+FAILED=0
+
+cleanup() {
+    if [ -n "$WATCH_PID" ]; then
+        kill "$WATCH_PID" 2>/dev/null
+        wait "$WATCH_PID" 2>/dev/null
+    fi
+    rm -rf "$DIR"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAIL: $*"
+    FAILED=1
+}
+
+# Starts --watch in the background, its messages go to $DIR/watch.log
+start_watch() {
+    : > "$DIR/watch.log"
+    "$ASM" --watch -o "$DIR/watch.friday" "$@" > "$DIR/watch.log" 2>&1 &
+    WATCH_PID=$!
+}
+
+stop_watch() {
+    kill "$WATCH_PID" 2>/dev/null
+    wait "$WATCH_PID" 2>/dev/null
+    WATCH_PID=
+}
+
+# Waits until --watch reports the n-th rebuild
+wait_rebuild() {
+    for _ in $(seq 100); do
+        if [ "$(grep -c "^friday-asm: '.*' \(updated\|is not updated\)" "$DIR/watch.log")" -ge "$1" ]; then
+            return 0
+        fi
+        sleep 0.05
+    done
+    fail "no rebuild #$1 reported by --watch"
+    cat "$DIR/watch.log"
+    return 1
+}
+
+# Compares the current output of --watch with friday-asm on the same files
+check_same() {
+    rm -f "$DIR/one.friday"
+    if ! "$ASM" -o "$DIR/one.friday" "$@" > /dev/null; then
+        fail "friday-asm rejected $*"
+    elif ! cmp -s "$DIR/one.friday" "$DIR/watch.friday"; then
+        fail "--watch output differs from friday-asm for $*"
+    fi
+}
+
+# Both modes must report errors and write nothing
+check_rejected() {
+    rm -f "$DIR/one.friday" "$DIR/watch.friday"
+    if "$ASM" -o "$DIR/one.friday" "$@" > /dev/null || [ -e "$DIR/one.friday" ]; then
+        fail "friday-asm accepted $*"
+    fi
+    start_watch "$@"
+    wait_rebuild 1
+    stop_watch
+    if ! grep -q "is not updated because of errors" "$DIR/watch.log" || [ -e "$DIR/watch.friday" ]; then
+        fail "--watch accepted $*"
+    fi
+}
+
+for program in "$PROGRAMS"/*.s; do
+    rm -f "$DIR/watch.friday"
+    start_watch "$program"
+    wait_rebuild 1
+    stop_watch
+    check_same "$program"
+done
+
+# A jump back into the previous file is short in friday-asm, so it has to be short in --watch too
+cat > "$DIR/a.s" << 'EOF'
+    .friday_asm
+    push 3
+    pop r0
+back:
+    push r0
+    out
+    push r0
+    push 1
+    sub
+    pop r0
+EOF
+cat > "$DIR/b.s" << 'EOF'
+    push r0
+    push 0
+    ja back
+    end
+EOF
+start_watch "$DIR/a.s" "$DIR/b.s"
+if wait_rebuild 1; then
+    check_same "$DIR/a.s" "$DIR/b.s"
+
+    # The label moves, so b.s has to be compiled again
+    sed -i 's/^back:/    push 0\n    pop r1\nback:/' "$DIR/a.s"
+    if wait_rebuild 2; then
+        check_same "$DIR/a.s" "$DIR/b.s"
+    fi
+
+    # The label moves, but the size of a.s stays the same
+    sed -i '/^back:/d; s/^    push 0$/back:\n    push 0/' "$DIR/a.s"
+    if wait_rebuild 3; then
+        check_same "$DIR/a.s" "$DIR/b.s"
+    fi
+
+    # Only b.s changes, a.s is taken from the previous build
+    sed -i 's/push 0/push 1/' "$DIR/b.s"
+    if wait_rebuild 4; then
+        check_same "$DIR/a.s" "$DIR/b.s"
+    fi
+fi
+stop_watch
+
+# A label of a later file is not visible
+cat > "$DIR/forward.s" << 'EOF'
+    .friday_asm
+    jmp later
+EOF
+cat > "$DIR/later.s" << 'EOF'
+later:
+    end
+EOF
+check_rejected "$DIR/forward.s" "$DIR/later.s"
+
+# A label defined in two files
+cat > "$DIR/first.s" << 'EOF'
+    .friday_asm
+twice:
+    end
+EOF
+cat > "$DIR/second.s" << 'EOF'
+twice:
+    jmp twice
+EOF
+check_rejected "$DIR/first.s" "$DIR/second.s"
+
+exit $FAILED